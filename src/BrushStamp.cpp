@@ -0,0 +1,271 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "BrushStamp.h"
+#include <math.h>
+#include <algorithm>
+
+/**
+ * The number of brush sizes kept baked before they are thrown away.
+ **/
+static const unsigned int MAX_STAMPS = 32;
+
+/**
+ * Brush sizes are rounded to a quarter of a cell, so small changes to the size reuse a stamp.
+ **/
+static int getRadiusKey(float radius)
+{
+    int key = (int)(radius * 4.0f + 0.5f);
+    return key > 0 ? key : 0;
+}
+
+BrushStamp::BrushStamp() :
+_falloff(SMOOTHSTEP),
+_strength(10.0f),
+_opacity(1.0f)
+{
+}
+
+BrushStamp::~BrushStamp()
+{
+}
+
+void BrushStamp::setFalloff(Falloff falloff)
+{
+    if (falloff != _falloff) {
+        _falloff = falloff;
+        _stamps.clear();
+    }
+}
+
+BrushStamp::Falloff BrushStamp::getFalloff() const
+{
+    return _falloff;
+}
+
+void BrushStamp::setCurve(const std::vector<Vector2> &points)
+{
+    _curve = points;
+    if (_falloff == CUSTOM) {
+        _stamps.clear();
+    }
+}
+
+void BrushStamp::setStrength(float strength)
+{
+    _strength = strength;
+}
+
+float BrushStamp::getStrength() const
+{
+    return _strength;
+}
+
+void BrushStamp::setOpacity(float opacity)
+{
+    _opacity = opacity < 0 ? 0 : (opacity > 1 ? 1 : opacity);
+}
+
+float BrushStamp::getOpacity() const
+{
+    return _opacity;
+}
+
+float BrushStamp::getWeight(float distance) const
+{
+    if (distance >= 1.0f) {
+        return 0.0f;
+    }
+    if (_falloff == GAUSSIAN) {
+        // A standard deviation of a third of the radius, lowered so it reaches 0 at the edge.
+        const float edge = expf(-4.5f);
+        return (expf(-4.5f * distance * distance) - edge) / (1.0f - edge);
+    }
+    if (_falloff == CUSTOM) {
+        if (_curve.empty()) {
+            return 1.0f;
+        }
+        if (distance <= _curve.front().x) {
+            return _curve.front().y;
+        }
+        unsigned int i;
+        for (i = 1; i < _curve.size(); i++) {
+            if (distance < _curve[i].x) {
+                const Vector2 &a = _curve[i - 1], &b = _curve[i];
+                return a.y + (b.y - a.y) * (distance - a.x) / (b.x - a.x);
+            }
+        }
+        return _curve.back().y;
+    }
+    return 1.0f - distance * distance * (3.0f - 2.0f * distance);
+}
+
+const BrushStamp::Stamp& BrushStamp::getStamp(float radius)
+{
+    int key = getRadiusKey(radius);
+    std::map<int, Stamp>::iterator found = _stamps.find(key);
+
+    if (found != _stamps.end()) {
+        return found->second;
+    }
+    if (_stamps.size() >= MAX_STAMPS) {
+        _stamps.clear();
+    }
+
+    Stamp &stamp = _stamps[key];
+    float bakedRadius = key / 4.0f;
+    stamp.reach = (int)ceilf(bakedRadius);
+    int width = 2 * stamp.reach + 1;
+    int i, j;
+
+    stamp.weights.resize(width * width);
+    for (j = 0; j < width; j++) {
+        for (i = 0; i < width; i++) {
+            float dx = (float)(i - stamp.reach), dz = (float)(j - stamp.reach);
+            // A brush smaller than a cell is just the middle cell, at full strength.
+            float distance = bakedRadius > 0 ? sqrtf(dx * dx + dz * dz) / bakedRadius : 0.0f;
+            stamp.weights[i + (j * width)] = this->getWeight(distance);
+        }
+    }
+    return stamp;
+}
+
+void BrushStamp::getCenterCell(float centerX, float centerZ, int &column, int &row)
+{
+    column = (int)floorf(centerX + 0.5f);
+    row = (int)floorf(centerZ + 0.5f);
+}
+
+DirtyRect BrushStamp::getCells(float centerX, float centerZ, float radius, unsigned int size) const
+{
+    return this->getCells(centerX, centerZ, radius, DirtyRect(0, 0, size - 1, size - 1));
+}
+
+DirtyRect BrushStamp::getCells(float centerX, float centerZ, float radius, const DirtyRect &rect) const
+{
+    int column, row;
+    int reach = (int)ceilf(getRadiusKey(radius) / 4.0f);
+
+    getCenterCell(centerX, centerZ, column, row);
+    return DirtyRect(std::max(column - reach, rect.minX), std::max(row - reach, rect.minZ),
+                     std::min(column + reach, rect.maxX), std::min(row + reach, rect.maxZ));
+}
+
+void BrushStamp::accumulate(float *buffer, const DirtyRect &rect, float centerX, float centerZ, float radius, float amount)
+{
+    DirtyRect cells = this->getCells(centerX, centerZ, radius, rect);
+    if (cells.isEmpty()) {
+        return;
+    }
+
+    const Stamp &stamp = this->getStamp(radius);
+    int column, row, i, j;
+    int width = 2 * stamp.reach + 1;
+    int stride = rect.maxX - rect.minX + 1;
+    int count = cells.maxX - cells.minX + 1;
+    float scaled = amount * _opacity;
+
+    getCenterCell(centerX, centerZ, column, row);
+    for (j = cells.minZ; j <= cells.maxZ; j++) {
+        const float *weights = &stamp.weights[(cells.minX - column + stamp.reach) + (j - row + stamp.reach) * width];
+        float *output = buffer + (cells.minX - rect.minX) + (j - rect.minZ) * stride;
+        for (i = 0; i < count; i++) {
+            output[i] += weights[i] * scaled;
+        }
+    }
+}
+
+void BrushStamp::accumulateMax(float *mask, const DirtyRect &rect, float centerX, float centerZ, float radius)
+{
+    DirtyRect cells = this->getCells(centerX, centerZ, radius, rect);
+    if (cells.isEmpty()) {
+        return;
+    }
+
+    const Stamp &stamp = this->getStamp(radius);
+    int column, row, i, j;
+    int width = 2 * stamp.reach + 1;
+    int stride = rect.maxX - rect.minX + 1;
+    int count = cells.maxX - cells.minX + 1;
+
+    getCenterCell(centerX, centerZ, column, row);
+    for (j = cells.minZ; j <= cells.maxZ; j++) {
+        const float *weights = &stamp.weights[(cells.minX - column + stamp.reach) + (j - row + stamp.reach) * width];
+        float *output = mask + (cells.minX - rect.minX) + (j - rect.minZ) * stride;
+        for (i = 0; i < count; i++) {
+            float weight = weights[i] * _opacity;
+            output[i] = output[i] > weight ? output[i] : weight;
+        }
+    }
+}
+
+void BrushStamp::blend(float *heights, unsigned int size, const DirtyRect &rect, const float *mask, float target)
+{
+    int i, j;
+    int count = rect.maxX - rect.minX + 1;
+
+    for (j = rect.minZ; j <= rect.maxZ; j++) {
+        const float *weights = mask + (j - rect.minZ) * count;
+        float *output = heights + rect.minX + (j * size);
+        for (i = 0; i < count; i++) {
+            output[i] += (target - output[i]) * weights[i];
+        }
+    }
+}
+
+void BrushStamp::blend(float *heights, unsigned int size, const DirtyRect &rect, const float *mask, const float *targets)
+{
+    int i, j;
+    int count = rect.maxX - rect.minX + 1;
+
+    for (j = rect.minZ; j <= rect.maxZ; j++) {
+        const float *weights = mask + (j - rect.minZ) * count;
+        const float *input = targets + (j - rect.minZ) * count;
+        float *output = heights + rect.minX + (j * size);
+        for (i = 0; i < count; i++) {
+            output[i] += (input[i] - output[i]) * weights[i];
+        }
+    }
+}
+
+float BrushStamp::average(const float *heights, unsigned int size, float centerX, float centerZ, float radius)
+{
+    DirtyRect cells = this->getCells(centerX, centerZ, radius, size);
+    if (cells.isEmpty()) {
+        return 0.0f;
+    }
+
+    const Stamp &stamp = this->getStamp(radius);
+    int column, row, i, j;
+    int width = 2 * stamp.reach + 1;
+    int count = cells.maxX - cells.minX + 1;
+    float total = 0.0f, weight = 0.0f;
+
+    getCenterCell(centerX, centerZ, column, row);
+    for (j = cells.minZ; j <= cells.maxZ; j++) {
+        const float *weights = &stamp.weights[(cells.minX - column + stamp.reach) + (j - row + stamp.reach) * width];
+        const float *input = heights + cells.minX + (j * size);
+        for (i = 0; i < count; i++) {
+            total += input[i] * weights[i];
+            weight += weights[i];
+        }
+    }
+    return weight > 0 ? total / weight : heights[cells.minX + (cells.minZ * size)];
+}
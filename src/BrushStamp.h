@@ -0,0 +1,270 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BRUSHSTAMP_H
+#define BRUSHSTAMP_H
+
+#include "DirtyRect.h"
+
+#include "gameplay.h"
+#include <map>
+#include <vector>
+
+using namespace gameplay;
+
+/**
+ * The shape of a brush, from full strength in the middle to nothing at the edge. The falloff curve is
+ * baked once for each brush size into a square stamp of weights, one per height field cell, so applying
+ * the brush is a multiply-add of the stamp over the cells it covers, with no distances or curves to work
+ * out per cell.
+ *
+ * The stamp is centred on the height field cell nearest to the middle of the brush.
+ **/
+class BrushStamp
+{
+public:
+    /**
+     * The falloff curves.
+     *
+     * SMOOTHSTEP - a smooth dome, flat in the middle and at the edge.
+     * GAUSSIAN - a bell, pointed in the middle with long soft sides.
+     * CUSTOM - straight lines through the points given to setCurve.
+     **/
+    enum Falloff { SMOOTHSTEP, GAUSSIAN, CUSTOM };
+
+    /**
+     * Constructor - a smoothstep brush of strength 10 and full opacity.
+     **/
+    BrushStamp();
+
+    /**
+     * Destructor
+     **/
+    ~BrushStamp();
+
+    /**
+     * Choose the falloff curve.
+     *
+     * @param falloff The curve.
+     * @return void
+     **/
+    void setFalloff(Falloff falloff);
+
+    /**
+     * Get the falloff curve.
+     *
+     * @return Falloff
+     **/
+    Falloff getFalloff() const;
+
+    /**
+     * Set the points of the custom falloff curve. x is the distance from the middle (0) to the edge (1)
+     * and y the weight (0 to 1). The points must be sorted by x.
+     *
+     * @param points The points of the curve.
+     * @return void
+     **/
+    void setCurve(const std::vector<Vector2> &points);
+
+    /**
+     * Set how far the raise and lower brushes move the middle of the brush, in height units.
+     *
+     * @param strength The strength.
+     * @return void
+     **/
+    void setStrength(float strength);
+
+    /**
+     * Get the strength.
+     *
+     * @return float
+     **/
+    float getStrength() const;
+
+    /**
+     * Set how much of each brush is applied, from 0 (nothing) to 1.
+     *
+     * @param opacity The opacity.
+     * @return void
+     **/
+    void setOpacity(float opacity);
+
+    /**
+     * Get the opacity.
+     *
+     * @return float
+     **/
+    float getOpacity() const;
+
+    /**
+     * Get the weight of the falloff curve at a distance from the middle.
+     *
+     * @param distance From 0 in the middle to 1 at the edge.
+     * @return float
+     **/
+    float getWeight(float distance) const;
+
+    /**
+     * Get the cells of a height field covered by the brush.
+     *
+     * @param centerX The column of the middle of the brush.
+     * @param centerZ The row of the middle of the brush.
+     * @param radius The radius of the brush, in cells.
+     * @param size The size of one side of the height field.
+     * @return DirtyRect
+     **/
+    DirtyRect getCells(float centerX, float centerZ, float radius, unsigned int size) const;
+
+    /**
+     * Get the cells of a rect covered by the brush.
+     *
+     * @param centerX The column of the middle of the brush.
+     * @param centerZ The row of the middle of the brush.
+     * @param radius The radius of the brush, in cells.
+     * @param rect The rect to clip to.
+     * @return DirtyRect
+     **/
+    DirtyRect getCells(float centerX, float centerZ, float radius, const DirtyRect &rect) const;
+
+    /**
+     * Add the stamp times an amount into a buffer: buffer += weight * amount * opacity. Stamps of a stroke
+     * that overlap add up.
+     *
+     * @param buffer The buffer, covering rect a row at a time.
+     * @param rect The cells covered by the buffer.
+     * @param centerX The column of the middle of the brush.
+     * @param centerZ The row of the middle of the brush.
+     * @param radius The radius of the brush, in cells.
+     * @param amount The value in the middle of the brush at full opacity.
+     * @return void
+     **/
+    void accumulate(float *buffer, const DirtyRect &rect, float centerX, float centerZ, float radius, float amount);
+
+    /**
+     * Merge the stamp into a mask: mask = max(mask, weight * opacity). Stamps of a stroke that overlap
+     * don't add up, so a brush that moves heights towards a target never overshoots it.
+     *
+     * @param mask The mask, covering rect a row at a time.
+     * @param rect The cells covered by the mask.
+     * @param centerX The column of the middle of the brush.
+     * @param centerZ The row of the middle of the brush.
+     * @param radius The radius of the brush, in cells.
+     * @return void
+     **/
+    void accumulateMax(float *mask, const DirtyRect &rect, float centerX, float centerZ, float radius);
+
+    /**
+     * Move heights towards one height by a mask: heights += (target - heights) * mask.
+     *
+     * @param heights The height array.
+     * @param size The size of one side of the height field.
+     * @param rect The cells to change.
+     * @param mask The mask, covering rect a row at a time.
+     * @param target The height to move towards.
+     * @return void
+     **/
+    static void blend(float *heights, unsigned int size, const DirtyRect &rect, const float *mask, float target);
+
+    /**
+     * Move heights towards other heights by a mask: heights += (targets - heights) * mask.
+     *
+     * @param heights The height array.
+     * @param size The size of one side of the height field.
+     * @param rect The cells to change.
+     * @param mask The mask, covering rect a row at a time.
+     * @param targets The heights to move towards, covering rect a row at a time.
+     * @return void
+     **/
+    static void blend(float *heights, unsigned int size, const DirtyRect &rect, const float *mask, const float *targets);
+
+    /**
+     * Work out the average height under the brush, weighted by the stamp.
+     *
+     * @param heights The height array.
+     * @param size The size of one side of the height field.
+     * @param centerX The column of the middle of the brush.
+     * @param centerZ The row of the middle of the brush.
+     * @param radius The radius of the brush, in cells.
+     * @return float
+     **/
+    float average(const float *heights, unsigned int size, float centerX, float centerZ, float radius);
+
+private:
+    /**
+     * The weights of one brush size.
+     **/
+    struct Stamp
+    {
+        /**
+         * The number of cells from the middle to the edge of the stamp.
+         **/
+        int reach;
+
+        /**
+         * (2 * reach + 1) squared weights, a row at a time.
+         **/
+        std::vector<float> weights;
+    };
+
+    /**
+     * Get the stamp for a brush size, baking it the first time the size is used.
+     *
+     * @param radius The radius of the brush, in cells.
+     * @return const Stamp&
+     **/
+    const Stamp& getStamp(float radius);
+
+    /**
+     * Get the cell of the height field in the middle of the brush.
+     *
+     * @param centerX The column of the middle of the brush.
+     * @param centerZ The row of the middle of the brush.
+     * @param column Set to the column.
+     * @param row Set to the row.
+     * @return void
+     **/
+    static void getCenterCell(float centerX, float centerZ, int &column, int &row);
+
+    /**
+     * The falloff curve.
+     **/
+    Falloff _falloff;
+
+    /**
+     * The points of the custom curve.
+     **/
+    std::vector<Vector2> _curve;
+
+    /**
+     * The strength of the raise and lower brushes.
+     **/
+    float _strength;
+
+    /**
+     * How much of each brush is applied.
+     **/
+    float _opacity;
+
+    /**
+     * The baked stamps, by radius in quarter cells.
+     **/
+    std::map<int, Stamp> _stamps;
+};
+
+#endif // BRUSHSTAMP_H
@@ -0,0 +1,83 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "DirtyRect.h"
+
+DirtyRect::DirtyRect() :
+minX(0),
+minZ(0),
+maxX(-1),
+maxZ(-1)
+{
+}
+
+DirtyRect::DirtyRect(int minX, int minZ, int maxX, int maxZ) :
+minX(minX),
+minZ(minZ),
+maxX(maxX),
+maxZ(maxZ)
+{
+}
+
+bool DirtyRect::isEmpty() const
+{
+    return maxX < minX || maxZ < minZ;
+}
+
+void DirtyRect::merge(const DirtyRect &other)
+{
+    if (other.isEmpty()) {
+        return;
+    }
+    if (this->isEmpty()) {
+        *this = other;
+        return;
+    }
+    minX = other.minX < minX ? other.minX : minX;
+    minZ = other.minZ < minZ ? other.minZ : minZ;
+    maxX = other.maxX > maxX ? other.maxX : maxX;
+    maxZ = other.maxZ > maxZ ? other.maxZ : maxZ;
+}
+
+bool DirtyRect::overlaps(const DirtyRect &other) const
+{
+    if (this->isEmpty() || other.isEmpty()) {
+        return false;
+    }
+    return minX <= other.maxX && other.minX <= maxX && minZ <= other.maxZ && other.minZ <= maxZ;
+}
+
+void DirtyRect::inflate(int amount)
+{
+    if (this->isEmpty()) {
+        return;
+    }
+    minX -= amount;
+    minZ -= amount;
+    maxX += amount;
+    maxZ += amount;
+}
+
+void DirtyRect::clip(int width, int height)
+{
+    minX = minX < 0 ? 0 : minX;
+    minZ = minZ < 0 ? 0 : minZ;
+    maxX = maxX >= width ? width - 1 : maxX;
+    maxZ = maxZ >= height ? height - 1 : maxZ;
+}
@@ -0,0 +1,105 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DIRTYRECT_H
+#define DIRTYRECT_H
+
+/**
+ * An inclusive rectangle of cells or texels that has changed and needs to be regenerated.
+ * An empty rect has max < min.
+ **/
+struct DirtyRect
+{
+    /**
+     * Constructor - an empty rect.
+     **/
+    DirtyRect();
+
+    /**
+     * Constructor
+     *
+     * @param minX The first column.
+     * @param minZ The first row.
+     * @param maxX The last column.
+     * @param maxZ The last row.
+     **/
+    DirtyRect(int minX, int minZ, int maxX, int maxZ);
+
+    /**
+     * Is there nothing in the rect?
+     *
+     * @return bool
+     **/
+    bool isEmpty() const;
+
+    /**
+     * Grow the rect to cover another rect as well.
+     *
+     * @param other The other rect.
+     * @return void
+     **/
+    void merge(const DirtyRect &other);
+
+    /**
+     * Whether the rect shares any cells with another rect.
+     *
+     * @param other The other rect.
+     * @return bool
+     **/
+    bool overlaps(const DirtyRect &other) const;
+
+    /**
+     * Grow the rect by a number of cells on every side.
+     *
+     * @param amount The number of cells.
+     * @return void
+     **/
+    void inflate(int amount);
+
+    /**
+     * Limit the rect to a grid.
+     *
+     * @param width The number of columns in the grid.
+     * @param height The number of rows in the grid.
+     * @return void
+     **/
+    void clip(int width, int height);
+
+    /**
+     * The first column.
+     **/
+    int minX;
+
+    /**
+     * The first row.
+     **/
+    int minZ;
+
+    /**
+     * The last column.
+     **/
+    int maxX;
+
+    /**
+     * The last row.
+     **/
+    int maxZ;
+};
+
+#endif // DIRTYRECT_H
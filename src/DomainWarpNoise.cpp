@@ -0,0 +1,194 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "DomainWarpNoise.h"
+#include "SimplexNoise.h"
+#include <math.h>
+
+const unsigned int DomainWarpNoise::WARP_SPACING = 8;
+
+DomainWarpNoise::DomainWarpNoise() :
+_warpColumns(0),
+_warpRows(0),
+_warpStrength(0.08),
+_min(0),
+_max(0),
+_seed(0),
+_worldScale(1)
+{
+}
+
+DomainWarpNoise::~DomainWarpNoise()
+{
+}
+
+void DomainWarpNoise::setWarpStrength(double strength)
+{
+    _warpStrength = strength;
+}
+
+bool DomainWarpNoise::isTileable() const
+{
+    return true;
+}
+
+void DomainWarpNoise::init(double maxx, double maxz, double rangemin, double rangemax, int seed)
+{
+    _min = rangemin;
+    _max = rangemax;
+    _seed = seed;
+    _worldScale = maxx;
+    if (maxz > maxx) {
+        _worldScale = maxz;
+    }
+
+    // Cache one grid point past each edge, so every coordinate up to the maximum has a cell to blend in.
+    _warpColumns = static_cast<unsigned int>(ceil(maxx / WARP_SPACING)) + 2;
+    _warpRows = static_cast<unsigned int>(ceil(maxz / WARP_SPACING)) + 2;
+    _warpX.resize(_warpColumns * _warpRows);
+    _warpZ.resize(_warpColumns * _warpRows);
+
+    unsigned int row, column, index = 0;
+    for (row = 0; row < _warpRows; row++) {
+        for (column = 0; column < _warpColumns; column++, index++) {
+            this->computeWarp(column, row, _warpX[index], _warpZ[index]);
+        }
+    }
+}
+
+void DomainWarpNoise::computeWarp(int column, int row, float &warpX, float &warpZ) const
+{
+    // The warp has a couple of big features across the terrain - fine detail would just look like noise.
+    double frequency = 1.5 / _worldScale;
+    double offset = fmod(_seed * 1.6180339887, 256.0);
+    double distance = _warpStrength * _worldScale;
+    double x = column * (double) WARP_SPACING * frequency;
+    double z = row * (double) WARP_SPACING * frequency;
+    warpX = static_cast<float>(this->warpOctaves(x + offset + 31.7, z + 5.3) * distance);
+    warpZ = static_cast<float>(this->warpOctaves(x + 12.9, z + offset + 67.1) * distance);
+}
+
+void DomainWarpNoise::getWarp(int column, int row, float &warpX, float &warpZ) const
+{
+    if (column >= 0 && row >= 0 && column < (int) _warpColumns && row < (int) _warpRows) {
+        unsigned int index = column + (row * _warpColumns);
+        warpX = _warpX[index];
+        warpZ = _warpZ[index];
+    } else {
+        this->computeWarp(column, row, warpX, warpZ);
+    }
+}
+
+double DomainWarpNoise::warpOctaves(double x, double z) const
+{
+    double sum = 0.0, amplitude = 1.0, total = 0.0;
+    unsigned int octave;
+    for (octave = 0; octave < 3; octave++) {
+        sum += SimplexNoise::noiseSingle(x, z) * amplitude;
+        total += amplitude;
+        x *= 2.0;
+        z *= 2.0;
+        amplitude *= 0.5;
+    }
+    return sum / total;
+}
+
+double DomainWarpNoise::octaves(double x, double z) const
+{
+    double frequency = 2.0 / _worldScale;
+    double offset = fmod(_seed * 0.7548776662, 256.0);
+    double sum = 0.0, amplitude = 1.0, total = 0.0;
+    x = x * frequency + offset;
+    z = z * frequency + offset;
+
+    // Stop once the features are 2 cells across, anything smaller can't be seen.
+    while (frequency < 0.5) {
+        sum += SimplexNoise::noiseSingle(x, z) * amplitude;
+        total += amplitude;
+        x *= 2.0;
+        z *= 2.0;
+        frequency *= 2.0;
+        amplitude *= 0.5;
+    }
+    if (total == 0.0) {
+        return 0.0;
+    }
+    return sum / total;
+}
+
+void DomainWarpNoise::findCell(double value, int &cell, double &fraction)
+{
+    double position = value / WARP_SPACING;
+    double first = floor(position);
+    cell = static_cast<int>(first);
+    fraction = position - first;
+}
+
+double DomainWarpNoise::noise(double x, double z)
+{
+    // Share the blending with noiseTile, so a point comes out the same whichever way it was asked for.
+    float height;
+    this->noiseTile(x, z, 1, 1, &height);
+    return height;
+}
+
+void DomainWarpNoise::noiseTile(double x, double z, unsigned int width, unsigned int height, float *output)
+{
+    // Gather the warp grid points around the tile.
+    int firstColumn, lastColumn, firstRow, lastRow;
+    double fx, fz;
+    findCell(x, firstColumn, fx);
+    findCell(x + width - 1, lastColumn, fx);
+    findCell(z, firstRow, fz);
+    findCell(z + height - 1, lastRow, fz);
+    unsigned int columns = lastColumn - firstColumn + 2;
+    unsigned int rows = lastRow - firstRow + 2;
+    std::vector<float> gridX(columns * rows);
+    std::vector<float> gridZ(columns * rows);
+    unsigned int i, j, index = 0;
+    int column, row;
+    for (j = 0; j < rows; j++) {
+        for (i = 0; i < columns; i++, index++) {
+            this->getWarp(firstColumn + i, firstRow + j, gridX[index], gridZ[index]);
+        }
+    }
+
+    // Blend the two grid rows around each output row once, then each point only blends along x.
+    std::vector<double> rowX(columns);
+    std::vector<double> rowZ(columns);
+    for (j = 0; j < height; j++) {
+        findCell(z + j, row, fz);
+        const float *topX = &gridX[(row - firstRow) * columns];
+        const float *topZ = &gridZ[(row - firstRow) * columns];
+        for (i = 0; i < columns; i++) {
+            rowX[i] = topX[i] + (topX[i + columns] - topX[i]) * fz;
+            rowZ[i] = topZ[i] + (topZ[i + columns] - topZ[i]) * fz;
+        }
+
+        float *heights = output + (j * width);
+        for (i = 0; i < width; i++) {
+            findCell(x + i, column, fx);
+            column -= firstColumn;
+            double warpX = rowX[column] + (rowX[column + 1] - rowX[column]) * fx;
+            double warpZ = rowZ[column] + (rowZ[column + 1] - rowZ[column]) * fx;
+            double sum = this->octaves(x + i + warpX, z + j + warpZ);
+            heights[i] = static_cast<float>((sum + 1.0) * 0.5 * (_max - _min) + _min);
+        }
+    }
+}
@@ -0,0 +1,203 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DOMAINWARPNOISE_H
+#define DOMAINWARPNOISE_H
+
+#include "INoiseAlgorithm.h"
+
+#include "gameplay.h"
+
+using namespace gameplay;
+
+/**
+ * Simplex noise sampled at coordinates pushed around by two other, smoother, noise fields. This bends
+ * the hills and valleys into the winding ridges you get from real erosion.
+ *
+ * The warp fields only have large features, so instead of running their octaves for every sample they
+ * are worked out once on a coarse grid in init and blended between the grid points. The main octave stack
+ * then costs about the same as unwarped noise.
+ *
+ * The grid is anchored at the world origin, and points outside the cached part are worked out when
+ * needed, so the noise is the same function of position everywhere and tiles generated apart still match.
+ **/
+class DomainWarpNoise : public INoiseAlgorithm
+{
+    public:
+        /**
+         * Constructor
+         **/
+        DomainWarpNoise();
+
+        /**
+         * Destructor
+         **/
+        virtual ~DomainWarpNoise();
+
+        /**
+         * Initialiser - store the parameters and build the warp field.
+         *
+         * @param maxx Maximum X value this generator will be called with.
+         * @param maxz Maximum Z value this generator will be called with.
+         * @param rangemin The minumum height value to generate.
+         * @param rangemax The maximum height value to generate.
+         * @param seed A random seed
+         * @return void
+         **/
+        virtual void init(double maxx, double maxz, double rangemin, double rangemax, int seed);
+
+        /**
+         * Get the height value for a given x and z coordinate.
+         *
+         * @param x X coordinate
+         * @param z Z coordinate
+         * @return double
+         **/
+        virtual double noise(double x, double z);
+
+        /**
+         * Get the heights for a tile of coordinates. The warp field is blended a row at a time.
+         *
+         * @param x The x coordinate of the first column
+         * @param z The z coordinate of the first row
+         * @param width The number of columns
+         * @param height The number of rows
+         * @param output Filled with width * height heights
+         * @return void
+         **/
+        virtual void noiseTile(double x, double z, unsigned int width, unsigned int height, float *output);
+
+        /**
+         * Set how far the warp can move a sample, as a fraction of the terrain size. Call before init.
+         *
+         * @param strength The strength, 0 turns the warp off.
+         * @return void
+         **/
+        void setWarpStrength(double strength);
+
+        /**
+         * Warped noise can be sampled anywhere.
+         *
+         * @return bool
+         **/
+        virtual bool isTileable() const;
+
+    private:
+        /**
+         * Sum the octaves of the main noise at a (warped) point.
+         *
+         * @param x X coordinate
+         * @param z Z coordinate
+         * @return double From about -1 to 1.
+         **/
+        double octaves(double x, double z) const;
+
+        /**
+         * Sum the octaves of one warp channel at a point.
+         *
+         * @param x X coordinate
+         * @param z Z coordinate
+         * @return double From about -1 to 1.
+         **/
+        double warpOctaves(double x, double z) const;
+
+        /**
+         * Work out the warp offsets at a grid point.
+         *
+         * @param column The grid column, counted from the world origin.
+         * @param row The grid row.
+         * @param warpX Set to the x offset.
+         * @param warpZ Set to the z offset.
+         * @return void
+         **/
+        void computeWarp(int column, int row, float &warpX, float &warpZ) const;
+
+        /**
+         * Get the warp offsets at a grid point, from the cache when it covers the point.
+         *
+         * @param column The grid column, counted from the world origin.
+         * @param row The grid row.
+         * @param warpX Set to the x offset.
+         * @param warpZ Set to the z offset.
+         * @return void
+         **/
+        void getWarp(int column, int row, float &warpX, float &warpZ) const;
+
+        /**
+         * Find the warp grid cell containing a coordinate.
+         *
+         * @param value The coordinate.
+         * @param cell Set to the grid point before the coordinate.
+         * @param fraction Set to how far between the grid points the coordinate is.
+         * @return void
+         **/
+        static void findCell(double value, int &cell, double &fraction);
+
+        /**
+         * The number of height field cells between warp field grid points.
+         **/
+        static const unsigned int WARP_SPACING;
+
+        /**
+         * The cached warp offsets in x, one per grid point from the origin to just past the maximum coordinates.
+         **/
+        std::vector<float> _warpX;
+
+        /**
+         * The cached warp offsets in z.
+         **/
+        std::vector<float> _warpZ;
+
+        /**
+         * The number of cached warp grid points along x.
+         **/
+        unsigned int _warpColumns;
+
+        /**
+         * The number of cached warp grid points along z.
+         **/
+        unsigned int _warpRows;
+
+        /**
+         * How far the warp can move a sample, as a fraction of the terrain size.
+         **/
+        double _warpStrength;
+
+        /**
+         * The minumum allowed height value.
+         **/
+        double _min;
+
+        /**
+         * The max allowed height value.
+         **/
+        double _max;
+
+        /**
+         * Seed - offsets the main noise and the warp noise.
+         **/
+        int _seed;
+
+        /**
+         * The size of the terrain, features are scaled to it.
+         **/
+        double _worldScale;
+};
+
+#endif // DOMAINWARPNOISE_H
@@ -0,0 +1,270 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "DropletErosion.h"
+#include <math.h>
+
+/**
+ * The width of the delta tiles.
+ **/
+static const int TILE_SIZE = 64;
+
+/**
+ * The droplets each slot runs before the changes are added to the heights.
+ **/
+static const unsigned int BATCH_SIZE = 128;
+
+/**
+ * Mix the bits of a number (the murmur3 finalizer), for repeatable random numbers without shared state.
+ **/
+static unsigned int hash(unsigned int value)
+{
+    value ^= value >> 16;
+    value *= 0x85ebca6b;
+    value ^= value >> 13;
+    value *= 0xc2b2ae35;
+    value ^= value >> 16;
+    return value;
+}
+
+/**
+ * Bilinear height and gradient inside a cell, from the heights at its corners.
+ **/
+static float interpolate(float topLeft, float topRight, float bottomLeft, float bottomRight, float fx, float fz, float *gradientX, float *gradientZ)
+{
+    *gradientX = (topRight - topLeft) * (1 - fz) + (bottomRight - bottomLeft) * fz;
+    *gradientZ = (bottomLeft - topLeft) * (1 - fx) + (bottomRight - topRight) * fx;
+    return topLeft * (1 - fx) * (1 - fz) + topRight * fx * (1 - fz) + bottomLeft * (1 - fx) * fz + bottomRight * fx * fz;
+}
+
+DropletErosionSettings::DropletErosionSettings() :
+droplets(50000),
+seed(0),
+lifetime(30),
+inertia(0.05f),
+sedimentCapacity(0.5f),
+minSlope(0.01f),
+erodeRate(0.3f),
+depositRate(0.3f),
+evaporationRate(0.01f),
+gravity(4.0f),
+radius(3)
+{
+}
+
+DropletErosion::DropletErosion(const DropletErosionSettings &settings) :
+_settings(settings),
+_jobSystem(NULL),
+_tilesX(0)
+{
+    int x, z;
+    int radius = _settings.radius;
+    float total = 0;
+    unsigned int i;
+
+    // Closer cells are worn away more.
+    for (z = -radius; z <= radius; z++) {
+        for (x = -radius; x <= radius; x++) {
+            float distance = sqrtf((float)(x * x + z * z));
+            if (distance <= radius) {
+                float weight = 1.0f - distance / (radius + 1);
+                _brushX.push_back(x);
+                _brushZ.push_back(z);
+                _brushWeight.push_back(weight);
+                total += weight;
+            }
+        }
+    }
+    for (i = 0; i < _brushWeight.size(); i++) {
+        _brushWeight[i] /= total;
+    }
+}
+
+DropletErosion::~DropletErosion()
+{
+}
+
+void DropletErosion::setJobSystem(JobSystem *jobSystem)
+{
+    _jobSystem = jobSystem;
+}
+
+void DropletErosion::addDelta(DeltaTiles &deltas, const DirtyRect &region, int x, int z, float amount) const
+{
+    if (x < region.minX || x > region.maxX || z < region.minZ || z > region.maxZ) {
+        return;
+    }
+    x -= region.minX;
+    z -= region.minZ;
+
+    std::vector<float> &tile = deltas.tiles[(x / TILE_SIZE) + (z / TILE_SIZE) * _tilesX];
+    if (tile.empty()) {
+        tile.resize(TILE_SIZE * TILE_SIZE, 0.0f);
+    }
+    tile[(x % TILE_SIZE) + (z % TILE_SIZE) * TILE_SIZE] += amount;
+}
+
+float DropletErosion::sampleHeight(const float *heights, unsigned int size, const DirtyRect &region, const DeltaTiles &deltas,
+                                  float x, float z, float *gradientX, float *gradientZ) const
+{
+    int cellX = (int)x, cellZ = (int)z;
+    const float *cell = heights + cellX + cellZ * size;
+
+    return interpolate(cell[0] + this->getDelta(deltas, region, cellX, cellZ),
+                       cell[1] + this->getDelta(deltas, region, cellX + 1, cellZ),
+                       cell[size] + this->getDelta(deltas, region, cellX, cellZ + 1),
+                       cell[size + 1] + this->getDelta(deltas, region, cellX + 1, cellZ + 1),
+                       x - cellX, z - cellZ, gradientX, gradientZ);
+}
+
+float DropletErosion::getDelta(const DeltaTiles &deltas, const DirtyRect &region, int x, int z) const
+{
+    x -= region.minX;
+    z -= region.minZ;
+
+    const std::vector<float> &tile = deltas.tiles[(x / TILE_SIZE) + (z / TILE_SIZE) * _tilesX];
+    return tile.empty() ? 0.0f : tile[(x % TILE_SIZE) + (z % TILE_SIZE) * TILE_SIZE];
+}
+
+void DropletErosion::runDroplet(const float *heights, unsigned int size, const DirtyRect &region, unsigned int droplet, DeltaTiles &deltas) const
+{
+    unsigned int step, i;
+    unsigned int random = hash(_settings.seed * 0x9e3779b9 + droplet);
+
+    // Start somewhere that can be sampled, a cell in from the edges of the region.
+    float width = (float)(region.maxX - region.minX - 1);
+    float height = (float)(region.maxZ - region.minZ - 1);
+    float x = region.minX + (random & 0xffff) / 65536.0f * width;
+    float z = region.minZ + (hash(random) & 0xffff) / 65536.0f * height;
+    float directionX = 0, directionZ = 0;
+    float speed = 1, water = 1, sediment = 0;
+
+    for (step = 0; step < _settings.lifetime; step++) {
+        int cellX = (int)x, cellZ = (int)z;
+        float fx = x - cellX, fz = z - cellZ;
+        float gradientX, gradientZ;
+        float current = this->sampleHeight(heights, size, region, deltas, x, z, &gradientX, &gradientZ);
+
+        // Turn downhill, keeping some of the old direction.
+        directionX = directionX * _settings.inertia - gradientX * (1 - _settings.inertia);
+        directionZ = directionZ * _settings.inertia - gradientZ * (1 - _settings.inertia);
+        float length = sqrtf(directionX * directionX + directionZ * directionZ);
+        if (length <= 0) {
+            break;
+        }
+        directionX /= length;
+        directionZ /= length;
+        x += directionX;
+        z += directionZ;
+        if (x < region.minX || z < region.minZ || x >= region.maxX || z >= region.maxZ) {
+            break;
+        }
+
+        float next = this->sampleHeight(heights, size, region, deltas, x, z, &gradientX, &gradientZ);
+        float drop = current - next;
+        float slope = drop > _settings.minSlope ? drop : _settings.minSlope;
+        float capacity = slope * speed * water * _settings.sedimentCapacity;
+
+        if (sediment > capacity || drop < 0) {
+            // Going uphill fills the hole behind, otherwise drop the extra sediment.
+            float amount = drop < 0 ? (-drop < sediment ? -drop : sediment) : (sediment - capacity) * _settings.depositRate;
+            sediment -= amount;
+            this->addDelta(deltas, region, cellX, cellZ, amount * (1 - fx) * (1 - fz));
+            this->addDelta(deltas, region, cellX + 1, cellZ, amount * fx * (1 - fz));
+            this->addDelta(deltas, region, cellX, cellZ + 1, amount * (1 - fx) * fz);
+            this->addDelta(deltas, region, cellX + 1, cellZ + 1, amount * fx * fz);
+        } else {
+            // Never dig deeper than the drop, or the droplet leaves holes behind.
+            float amount = (capacity - sediment) * _settings.erodeRate;
+            amount = amount < drop ? amount : drop;
+            for (i = 0; i < _brushWeight.size(); i++) {
+                this->addDelta(deltas, region, cellX + _brushX[i], cellZ + _brushZ[i], -amount * _brushWeight[i]);
+            }
+            sediment += amount;
+        }
+
+        float energy = speed * speed + drop * _settings.gravity;
+        speed = energy > 0 ? sqrtf(energy) : 0;
+        water *= 1 - _settings.evaporationRate;
+    }
+}
+
+void DropletErosion::erode(float *heights, unsigned int size, const DirtyRect &cells)
+{
+    DirtyRect region = cells;
+    unsigned int slot, first;
+
+    region.clip(size, size);
+    if (region.maxX - region.minX < 2 || region.maxZ - region.minZ < 2) {
+        return;
+    }
+    _tilesX = (region.maxX - region.minX + TILE_SIZE) / TILE_SIZE;
+    unsigned int tilesZ = (region.maxZ - region.minZ + TILE_SIZE) / TILE_SIZE;
+
+    unsigned int slots = _jobSystem ? _jobSystem->getThreadCount() : 1;
+    std::vector<DeltaTiles> deltas(slots);
+    for (slot = 0; slot < slots; slot++) {
+        deltas[slot].tiles.resize(_tilesX * tilesZ);
+    }
+
+    for (first = 0; first < _settings.droplets; first += BATCH_SIZE * slots) {
+        unsigned int last = first + BATCH_SIZE * slots < _settings.droplets ? first + BATCH_SIZE * slots : _settings.droplets;
+
+        // Each slot always gets the same droplets, whichever thread runs it.
+        JobSystem::RangeTask runSlots = [&](unsigned int begin, unsigned int end) {
+            for (unsigned int s = begin; s < end; s++) {
+                for (unsigned int droplet = first + s; droplet < last; droplet += slots) {
+                    this->runDroplet(heights, size, region, droplet, deltas[s]);
+                }
+            }
+        };
+
+        // Add the tiles to the heights in slot order, so the sums are always done the same way.
+        JobSystem::RangeTask mergeTiles = [&](unsigned int begin, unsigned int end) {
+            for (unsigned int t = begin; t < end; t++) {
+                int tileX = region.minX + (t % _tilesX) * TILE_SIZE;
+                int tileZ = region.minZ + (t / _tilesX) * TILE_SIZE;
+                int width = region.maxX - tileX + 1 < TILE_SIZE ? region.maxX - tileX + 1 : TILE_SIZE;
+                int height = region.maxZ - tileZ + 1 < TILE_SIZE ? region.maxZ - tileZ + 1 : TILE_SIZE;
+
+                for (unsigned int s = 0; s < slots; s++) {
+                    std::vector<float> &tile = deltas[s].tiles[t];
+                    if (tile.empty()) {
+                        continue;
+                    }
+                    for (int z = 0; z < height; z++) {
+                        float *row = heights + tileX + (tileZ + z) * size;
+                        for (int x = 0; x < width; x++) {
+                            row[x] += tile[x + z * TILE_SIZE];
+                        }
+                    }
+                    tile.assign(TILE_SIZE * TILE_SIZE, 0.0f);
+                }
+            }
+        };
+
+        if (_jobSystem) {
+            _jobSystem->parallelFor(0, slots, 1, runSlots);
+            _jobSystem->parallelFor(0, _tilesX * tilesZ, 1, mergeTiles);
+        } else {
+            runSlots(0, slots);
+            mergeTiles(0, _tilesX * tilesZ);
+        }
+    }
+}
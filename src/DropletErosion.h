@@ -0,0 +1,220 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DROPLETEROSION_H
+#define DROPLETEROSION_H
+
+#include "DirtyRect.h"
+#include "JobSystem.h"
+#include <vector>
+
+/**
+ * Settings for droplet erosion. Distances are in height field cells and heights are in the units of the height array.
+ **/
+struct DropletErosionSettings
+{
+    /**
+     * Constructor
+     **/
+    DropletErosionSettings();
+
+    /**
+     * The number of droplets to simulate.
+     **/
+    unsigned int droplets;
+
+    /**
+     * Seed for the droplet start positions.
+     **/
+    unsigned int seed;
+
+    /**
+     * The most steps a droplet takes before it is dropped.
+     **/
+    unsigned int lifetime;
+
+    /**
+     * How much a droplet keeps its direction instead of turning downhill, 0 to 1.
+     **/
+    float inertia;
+
+    /**
+     * How much sediment a droplet carries, for its speed, water and the drop it is running down.
+     **/
+    float sedimentCapacity;
+
+    /**
+     * The smallest drop used for the capacity, so droplets on flat ground still carry something.
+     **/
+    float minSlope;
+
+    /**
+     * The share of the spare capacity that is dissolved from the ground in a step.
+     **/
+    float erodeRate;
+
+    /**
+     * The share of the extra sediment that is dropped in a step.
+     **/
+    float depositRate;
+
+    /**
+     * The share of the water that evaporates in a step.
+     **/
+    float evaporationRate;
+
+    /**
+     * How quickly droplets speed up going downhill.
+     **/
+    float gravity;
+
+    /**
+     * The radius of the area a droplet wears away.
+     **/
+    unsigned int radius;
+};
+
+/**
+ * Droplet erosion traces water droplets across the height array. Each droplet runs downhill, picking
+ * up ground while it is fast and steep and dropping it again as it slows, carving gullies.
+ *
+ * The droplets are split between as many slots as the job system has threads, and run in small batches.
+ * During a batch the height array is not changed - each slot adds its changes into its own sparse set
+ * of delta tiles, which are added to the heights in slot order once the batch is done. A droplet sees
+ * the changes made by the earlier droplets of its own slot straight away, and those of the other slots
+ * from the next batch. Every droplet
+ * starts from a hash of the seed and its number, so the result is the same for the same seed and
+ * thread count however the jobs are scheduled.
+ **/
+class DropletErosion
+{
+public:
+    /**
+     * Constructor
+     *
+     * @param settings How to erode.
+     **/
+    DropletErosion(const DropletErosionSettings &settings);
+
+    /**
+     * Destructor
+     **/
+    ~DropletErosion();
+
+    /**
+     * Set the jobs used to run the droplets. Without a job system everything runs on the calling thread.
+     *
+     * @param jobSystem The job system, which must outlive the erosion.
+     * @return void
+     **/
+    void setJobSystem(JobSystem *jobSystem);
+
+    /**
+     * Erode part of a height array. Droplets start inside the region and stop when they leave it.
+     *
+     * @param heights The height array, size * size values.
+     * @param size The size of one side of the height array.
+     * @param cells The region to erode.
+     * @return void
+     **/
+    void erode(float *heights, unsigned int size, const DirtyRect &cells);
+
+private:
+    /**
+     * The height changes made by one slot, in tiles that are only allocated once they are touched.
+     **/
+    struct DeltaTiles
+    {
+        std::vector< std::vector<float> > tiles;
+    };
+
+    /**
+     * Simulate one droplet.
+     *
+     * @param heights The height array.
+     * @param size The size of one side of the height array.
+     * @param region The region being eroded.
+     * @param droplet The number of the droplet.
+     * @param deltas Where the height changes go.
+     * @return void
+     **/
+    void runDroplet(const float *heights, unsigned int size, const DirtyRect &region, unsigned int droplet, DeltaTiles &deltas) const;
+
+    /**
+     * Bilinear height and gradient at a point, including a slot's changes.
+     *
+     * @param heights The height array.
+     * @param size The size of one side of the height array.
+     * @param region The region being eroded, the point must be inside it and a cell in from the far edges.
+     * @param deltas The slot's changes.
+     * @param x The x coordinate.
+     * @param z The z coordinate.
+     * @param gradientX Set to the slope along x.
+     * @param gradientZ Set to the slope along z.
+     * @return float
+     **/
+    float sampleHeight(const float *heights, unsigned int size, const DirtyRect &region, const DeltaTiles &deltas,
+                       float x, float z, float *gradientX, float *gradientZ) const;
+
+    /**
+     * Get the change a slot has made to a cell inside the region.
+     *
+     * @param deltas The slot's changes.
+     * @param region The region being eroded.
+     * @param x The column.
+     * @param z The row.
+     * @return float
+     **/
+    float getDelta(const DeltaTiles &deltas, const DirtyRect &region, int x, int z) const;
+
+    /**
+     * Add a height change to a slot's tiles.
+     *
+     * @param deltas The tiles.
+     * @param region The region being eroded.
+     * @param x The column.
+     * @param z The row.
+     * @param amount The change.
+     * @return void
+     **/
+    void addDelta(DeltaTiles &deltas, const DirtyRect &region, int x, int z, float amount) const;
+
+    /**
+     * The settings.
+     **/
+    DropletErosionSettings _settings;
+
+    /**
+     * The jobs to run on, or NULL.
+     **/
+    JobSystem *_jobSystem;
+
+    /**
+     * The number of tiles across the region.
+     **/
+    unsigned int _tilesX;
+
+    /**
+     * Offsets and weights of the cells worn away around a droplet.
+     **/
+    std::vector<int> _brushX, _brushZ;
+    std::vector<float> _brushWeight;
+};
+
+#endif // DROPLETEROSION_H
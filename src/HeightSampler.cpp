@@ -0,0 +1,206 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "HeightSampler.h"
+#include <math.h>
+
+/**
+ * Bisection steps when refining a ray hit, each one halves the error.
+ **/
+static const unsigned int RAY_REFINE_STEPS = 32;
+
+HeightSampler::HeightSampler() :
+_heights(NULL),
+_size(0),
+_maxCell(0),
+_gridXFromX(1),
+_gridXFromZ(0),
+_gridXOffset(0),
+_gridZFromX(0),
+_gridZFromZ(1),
+_gridZOffset(0),
+_yFromGridX(0),
+_yFromHeight(1),
+_yFromGridZ(0),
+_yOffset(0),
+_cellsPerUnit(1)
+{
+}
+
+HeightSampler::~HeightSampler()
+{
+}
+
+void HeightSampler::set(const float *heights, unsigned int size, const Vector3 &scale, const Matrix &worldMatrix)
+{
+    GP_ASSERT(heights == NULL || size > 0);
+
+    // The terrain draws cell (column, row) with height h at (column - centre, h, row - centre), scaled and then moved by the node.
+    Matrix world;
+    world.set(worldMatrix);
+    world.scale(scale);
+    Matrix inverse;
+    inverse.set(world);
+    inverse.invert();
+
+    float centre = (size > 0) ? (size - 1) * 0.5f : 0.0f;
+    _heights = heights;
+    _size = size;
+    _maxCell = (size > 0) ? (float) (size - 1) : 0.0f;
+
+    // Only the x and z rows of the inverse are needed, the point always has a y of 0.
+    _gridXFromX = inverse.m[0];
+    _gridXFromZ = inverse.m[8];
+    _gridXOffset = inverse.m[12] + centre;
+    _gridZFromX = inverse.m[2];
+    _gridZFromZ = inverse.m[10];
+    _gridZOffset = inverse.m[14] + centre;
+
+    // And only the y row of the forward transform.
+    _yFromGridX = world.m[1];
+    _yFromHeight = world.m[5];
+    _yFromGridZ = world.m[9];
+    _yOffset = world.m[13] - centre * (world.m[1] + world.m[9]);
+
+    _cellsPerUnit = sqrtf(_gridXFromX * _gridXFromX + _gridZFromX * _gridZFromX);
+}
+
+void HeightSampler::getHeights(const float *xs, const float *zs, unsigned int count, float *heights) const
+{
+    unsigned int i;
+    if (!_heights) {
+        for (i = 0; i < count; i++) {
+            heights[i] = 0.0f;
+        }
+        return;
+    }
+
+    float gridX, gridZ;
+    for (i = 0; i < count; i++) {
+        this->toGrid(xs[i], zs[i], gridX, gridZ);
+        heights[i] = _yFromGridX * gridX + _yFromHeight * this->getGridHeight(gridX, gridZ) + _yFromGridZ * gridZ + _yOffset;
+    }
+}
+
+Vector3 HeightSampler::getNormal(float x, float z) const
+{
+    // Central differences one cell either side, in world units so a scaled or rotated terrain still gets the right slope.
+    float step = (_cellsPerUnit > 0) ? 1.0f / _cellsPerUnit : 1.0f;
+    float left = this->getHeight(x - step, z);
+    float right = this->getHeight(x + step, z);
+    float back = this->getHeight(x, z - step);
+    float front = this->getHeight(x, z + step);
+
+    Vector3 normal(left - right, 2.0f * step, back - front);
+    normal.normalize();
+    return normal;
+}
+
+void HeightSampler::getNormals(const float *xs, const float *zs, unsigned int count, Vector3 *normals) const
+{
+    unsigned int i;
+    for (i = 0; i < count; i++) {
+        normals[i] = this->getNormal(xs[i], zs[i]);
+    }
+}
+
+bool HeightSampler::isAbove(const Vector3 &origin, const Vector3 &direction, float distance) const
+{
+    float x = origin.x + direction.x * distance;
+    float y = origin.y + direction.y * distance;
+    float z = origin.z + direction.z * distance;
+    return y > this->getHeight(x, z);
+}
+
+/**
+ * Narrow a range along a ray to the part where start + speed * t lies between 0 and max.
+ **/
+static bool clipRange(float start, float speed, float max, float &first, float &last)
+{
+    if (speed == 0.0f) {
+        return start >= 0.0f && start <= max;
+    }
+    float enter = (0.0f - start) / speed;
+    float leave = (max - start) / speed;
+    if (enter > leave) {
+        float swap = enter;
+        enter = leave;
+        leave = swap;
+    }
+    if (enter > first) {
+        first = enter;
+    }
+    if (leave < last) {
+        last = leave;
+    }
+    return first <= last;
+}
+
+bool HeightSampler::intersectRay(const Vector3 &origin, const Vector3 &direction, float maxDistance, Vector3 &point) const
+{
+    if (!_heights) {
+        return false;
+    }
+
+    // The ray is a straight line in cells too, so clip it to the height field before stepping.
+    float gridX, gridZ;
+    this->toGrid(origin.x, origin.z, gridX, gridZ);
+    float speedX = _gridXFromX * direction.x + _gridXFromZ * direction.z;
+    float speedZ = _gridZFromX * direction.x + _gridZFromZ * direction.z;
+    float first = 0.0f, last = maxDistance;
+    if (!clipRange(gridX, speedX, _maxCell, first, last) || !clipRange(gridZ, speedZ, _maxCell, first, last)) {
+        return false;
+    }
+    if (!this->isAbove(origin, direction, first)) {
+        return false;
+    }
+
+    // The height only changes as the ray crosses cells, so half a cell sideways can't step over a whole bump.
+    float speed = sqrtf(speedX * speedX + speedZ * speedZ);
+    float step = (speed > 0) ? 0.5f / speed : last - first;
+    float above = first, below = first;
+    bool hit = false;
+    while (above < last) {
+        below = above + step;
+        if (below > last) {
+            below = last;
+        }
+        if (!this->isAbove(origin, direction, below)) {
+            hit = true;
+            break;
+        }
+        above = below;
+    }
+    if (!hit) {
+        return false;
+    }
+
+    unsigned int i;
+    for (i = 0; i < RAY_REFINE_STEPS; i++) {
+        float middle = (above + below) * 0.5f;
+        if (this->isAbove(origin, direction, middle)) {
+            above = middle;
+        } else {
+            below = middle;
+        }
+    }
+    point = origin + direction * below;
+    return true;
+}
@@ -0,0 +1,216 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HEIGHTSAMPLER_H
+#define HEIGHTSAMPLER_H
+
+#include "gameplay.h"
+
+using namespace gameplay;
+
+/**
+ * Answers height queries in world space straight from the height array. The transform between world
+ * space and height field cells is worked out once when the sampler is set, so a query is a few multiplies
+ * and a bilinear blend - no matrix is built or inverted, and the small queries are inline.
+ *
+ * The sampler reads the height array as it is, so it sees edits without being set again. It has to be
+ * set again when the array, the scale or the world matrix of the terrain changes.
+ **/
+class HeightSampler
+{
+public:
+    /**
+     * Constructor - an empty sampler, every height is 0.
+     **/
+    HeightSampler();
+
+    /**
+     * Destructor
+     **/
+    ~HeightSampler();
+
+    /**
+     * Work out the transforms for a height field.
+     *
+     * @param heights The height array, size * size values. Must outlive the sampler or the next set.
+     * @param size The size of one side of the height array.
+     * @param scale The spacing of the cells in x and z, and the scale of the heights in y.
+     * @param worldMatrix The world matrix of the terrain node.
+     * @return void
+     **/
+    void set(const float *heights, unsigned int size, const Vector3 &scale, const Matrix &worldMatrix);
+
+    /**
+     * Find the height field cell under a point in world space.
+     *
+     * @param x The world x coordinate.
+     * @param z The world z coordinate.
+     * @param gridX Set to the column, fractional and not clamped to the height field.
+     * @param gridZ Set to the row.
+     * @return void
+     **/
+    void toGrid(float x, float z, float &gridX, float &gridZ) const
+    {
+        gridX = _gridXFromX * x + _gridXFromZ * z + _gridXOffset;
+        gridZ = _gridZFromX * x + _gridZFromZ * z + _gridZOffset;
+    }
+
+    /**
+     * Convert a distance across the terrain in world units to height field cells.
+     *
+     * @param distance The distance in world units.
+     * @return float
+     **/
+    float toGridDistance(float distance) const
+    {
+        return distance * _cellsPerUnit;
+    }
+
+    /**
+     * Blend the height array at a fractional cell. Cells past the edges take the height of the nearest edge.
+     *
+     * @param gridX The column.
+     * @param gridZ The row.
+     * @return float The height in height field units.
+     **/
+    float getGridHeight(float gridX, float gridZ) const
+    {
+        float max = _maxCell;
+        gridX = gridX < 0 ? 0 : (gridX > max ? max : gridX);
+        gridZ = gridZ < 0 ? 0 : (gridZ > max ? max : gridZ);
+
+        unsigned int x0 = (unsigned int)gridX;
+        unsigned int z0 = (unsigned int)gridZ;
+        unsigned int x1 = x0 + 1 < _size ? x0 + 1 : x0;
+        unsigned int z1 = z0 + 1 < _size ? z0 + 1 : z0;
+        float fx = gridX - x0;
+        float fz = gridZ - z0;
+        const float *row0 = _heights + z0 * _size;
+        const float *row1 = _heights + z1 * _size;
+        float top = row0[x0] + (row0[x1] - row0[x0]) * fx;
+        float bottom = row1[x0] + (row1[x1] - row1[x0]) * fx;
+        return top + (bottom - top) * fz;
+    }
+
+    /**
+     * Get the height of the terrain in world space.
+     *
+     * @param x The world x coordinate.
+     * @param z The world z coordinate.
+     * @return float
+     **/
+    float getHeight(float x, float z) const
+    {
+        float gridX, gridZ;
+
+        if (!_heights) {
+            return 0.0f;
+        }
+        this->toGrid(x, z, gridX, gridZ);
+        return _yFromGridX * gridX + _yFromHeight * this->getGridHeight(gridX, gridZ) + _yFromGridZ * gridZ + _yOffset;
+    }
+
+    /**
+     * Get the heights of a batch of points in world space.
+     *
+     * @param xs The world x coordinates.
+     * @param zs The world z coordinates.
+     * @param count The number of points.
+     * @param heights Filled with count heights.
+     * @return void
+     **/
+    void getHeights(const float *xs, const float *zs, unsigned int count, float *heights) const;
+
+    /**
+     * Get the normal of the terrain in world space, from the heights one cell either side.
+     *
+     * @param x The world x coordinate.
+     * @param z The world z coordinate.
+     * @return Vector3 The unit normal.
+     **/
+    Vector3 getNormal(float x, float z) const;
+
+    /**
+     * Get the normals of a batch of points in world space.
+     *
+     * @param xs The world x coordinates.
+     * @param zs The world z coordinates.
+     * @param count The number of points.
+     * @param normals Filled with count unit normals.
+     * @return void
+     **/
+    void getNormals(const float *xs, const float *zs, unsigned int count, Vector3 *normals) const;
+
+    /**
+     * Find where a ray first hits the terrain. The ray is clipped to the height field, then stepped half a
+     * cell at a time until it passes below the surface, and the crossing is refined by bisection.
+     *
+     * @param origin The start of the ray, in world space.
+     * @param direction The direction of the ray, a unit vector.
+     * @param maxDistance How far along the ray to look.
+     * @param point Set to the hit.
+     * @return bool false if the ray misses, or starts below the surface.
+     **/
+    bool intersectRay(const Vector3 &origin, const Vector3 &direction, float maxDistance, Vector3 &point) const;
+
+private:
+    /**
+     * Is a point along a ray above the terrain?
+     *
+     * @param origin The start of the ray.
+     * @param direction The direction of the ray.
+     * @param distance The distance along the ray.
+     * @return bool
+     **/
+    bool isAbove(const Vector3 &origin, const Vector3 &direction, float distance) const;
+
+    /**
+     * The height array, or NULL.
+     **/
+    const float *_heights;
+
+    /**
+     * The size of one side of the height array.
+     **/
+    unsigned int _size;
+
+    /**
+     * The last cell along each side.
+     **/
+    float _maxCell;
+
+    /**
+     * World x and z to cells.
+     **/
+    float _gridXFromX, _gridXFromZ, _gridXOffset;
+    float _gridZFromX, _gridZFromZ, _gridZOffset;
+
+    /**
+     * Cells and height back to world y.
+     **/
+    float _yFromGridX, _yFromHeight, _yFromGridZ, _yOffset;
+
+    /**
+     * Cells for each world unit along x.
+     **/
+    float _cellsPerUnit;
+};
+
+#endif // HEIGHTSAMPLER_H
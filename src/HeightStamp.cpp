@@ -0,0 +1,129 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "HeightStamp.h"
+#include "LodePNG.h"
+#include <math.h>
+#include <algorithm>
+
+HeightStamp::HeightStamp()
+{
+}
+
+HeightStamp::~HeightStamp()
+{
+}
+
+bool HeightStamp::load(const std::string &path)
+{
+    std::vector<unsigned char> image;
+    unsigned int width, height;
+
+    _levels.clear();
+    unsigned error = lodepng::decode(image, width, height, path, LCT_GREY, 16);
+    if (error) {
+        GP_WARN("Could not load height stamp %s: %s", path.c_str(), lodepng_error_text(error));
+        return false;
+    }
+
+    // 16 bit samples come out big endian.
+    Level level;
+    level.width = width;
+    level.height = height;
+    level.values.resize(width * height);
+    unsigned int i;
+    for (i = 0; i < level.values.size(); i++) {
+        level.values[i] = ((image[i * 2] << 8) | image[i * 2 + 1]) / 65535.0f;
+    }
+    _levels.push_back(level);
+
+    this->buildMipChain();
+    return true;
+}
+
+void HeightStamp::buildMipChain()
+{
+    while (_levels.back().width > 1 || _levels.back().height > 1) {
+        const Level &source = _levels.back();
+        Level level;
+        level.width = std::max(source.width / 2, 1u);
+        level.height = std::max(source.height / 2, 1u);
+        level.values.resize(level.width * level.height);
+
+        // Odd sizes drop the last row or column into the one before.
+        unsigned int i, j;
+        for (j = 0; j < level.height; j++) {
+            const float *top = &source.values[std::min(j * 2, source.height - 1) * source.width];
+            const float *bottom = &source.values[std::min(j * 2 + 1, source.height - 1) * source.width];
+            for (i = 0; i < level.width; i++) {
+                unsigned int left = std::min(i * 2, source.width - 1);
+                unsigned int right = std::min(i * 2 + 1, source.width - 1);
+                level.values[i + (j * level.width)] = (top[left] + top[right] + bottom[left] + bottom[right]) * 0.25f;
+            }
+        }
+        _levels.push_back(level);
+    }
+}
+
+unsigned int HeightStamp::getSize() const
+{
+    if (_levels.empty()) {
+        return 0;
+    }
+    return std::max(_levels[0].width, _levels[0].height);
+}
+
+float HeightStamp::sampleLevel(const Level &level, float u, float v)
+{
+    // Texel centers are at half texels.
+    float x = std::min(std::max(u * level.width - 0.5f, 0.0f), level.width - 1.0f);
+    float z = std::min(std::max(v * level.height - 0.5f, 0.0f), level.height - 1.0f);
+    unsigned int left = static_cast<unsigned int>(x);
+    unsigned int top = static_cast<unsigned int>(z);
+    unsigned int right = std::min(left + 1, level.width - 1);
+    unsigned int bottom = std::min(top + 1, level.height - 1);
+    float fx = x - left;
+    float fz = z - top;
+
+    const float *upper = &level.values[top * level.width];
+    const float *lower = &level.values[bottom * level.width];
+    float first = upper[left] + (upper[right] - upper[left]) * fx;
+    float second = lower[left] + (lower[right] - lower[left]) * fx;
+    return first + (second - first) * fz;
+}
+
+float HeightStamp::sample(float u, float v, float footprint) const
+{
+    if (_levels.empty()) {
+        return 0.0f;
+    }
+
+    // Each level halves the resolution, so the level whose texels match the footprint is its log.
+    float lod = footprint > 1.0f ? log2f(footprint) : 0.0f;
+    lod = std::min(lod, (float)(_levels.size() - 1));
+    unsigned int level = static_cast<unsigned int>(lod);
+    float blend = lod - level;
+
+    float value = sampleLevel(_levels[level], u, v);
+    if (blend > 0.0f) {
+        value += (sampleLevel(_levels[level + 1], u, v) - value) * blend;
+    }
+    return value;
+}
@@ -0,0 +1,119 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HEIGHTSTAMP_H
+#define HEIGHTSTAMP_H
+
+#include "gameplay.h"
+#include <vector>
+#include <string>
+
+using namespace gameplay;
+
+/**
+ * A pre-made heightmap (a mesa, a crater, a riverbed) that can be stamped onto the terrain.
+ *
+ * The image is decoded once as 16 bit grey, black is the ground and white the full height of the
+ * stamp. It is kept as a chain of mip levels, each half the size of the one before, so a stamp
+ * that covers far fewer cells than it has texels reads a level that is already averaged down
+ * instead of skipping over most of the image.
+ **/
+class HeightStamp
+{
+public:
+    /**
+     * How the stamp is combined with the terrain.
+     *
+     * ADD - the stamp is added to the ground.
+     * MAX - the ground is raised to the stamp where the stamp is higher.
+     * REPLACE - the ground is blended to the stamp by the brush falloff.
+     **/
+    enum Mode { ADD, MAX, REPLACE };
+
+    /**
+     * Constructor - an empty stamp.
+     **/
+    HeightStamp();
+
+    /**
+     * Destructor
+     **/
+    ~HeightStamp();
+
+    /**
+     * Decode a PNG and build the mip chain.
+     *
+     * @param path The path to the image.
+     * @return bool false if the image could not be read.
+     **/
+    bool load(const std::string &path);
+
+    /**
+     * Get the size of the longest side of the full resolution image.
+     *
+     * @return unsigned int 0 when nothing is loaded.
+     **/
+    unsigned int getSize() const;
+
+    /**
+     * Read the stamp at a point, blending between the two mip levels nearest the footprint.
+     *
+     * @param u Across the image, 0 to 1.
+     * @param v Down the image, 0 to 1.
+     * @param footprint The number of full resolution texels covered by one sample.
+     * @return float 0 to 1.
+     **/
+    float sample(float u, float v, float footprint) const;
+
+private:
+    /**
+     * One level of the mip chain.
+     **/
+    struct Level
+    {
+        unsigned int width;
+        unsigned int height;
+        std::vector<float> values;
+    };
+
+    /**
+     * Bilinear sample of one level, clamped at the edges.
+     *
+     * @param level The level.
+     * @param u Across the image, 0 to 1.
+     * @param v Down the image, 0 to 1.
+     * @return float
+     **/
+    static float sampleLevel(const Level &level, float u, float v);
+
+    /**
+     * Box filter the last level down to half its size until it is a single texel.
+     *
+     * @return void
+     **/
+    void buildMipChain();
+
+    /**
+     * The mip chain, full resolution first.
+     **/
+    std::vector<Level> _levels;
+};
+
+#endif // HEIGHTSTAMP_H
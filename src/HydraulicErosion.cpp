@@ -0,0 +1,258 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "HydraulicErosion.h"
+#include "gameplay.h"
+#include <math.h>
+
+using namespace gameplay;
+
+/**
+ * Gravity, for the water flowing through the pipes.
+ **/
+static const float GRAVITY = 9.81f;
+
+HydraulicErosionSettings::HydraulicErosionSettings() :
+iterations(200),
+maxSeconds(0.0f),
+timeStep(0.02f),
+rainRate(0.5f),
+evaporationRate(0.5f),
+sedimentCapacity(0.1f),
+dissolveRate(0.3f),
+depositRate(0.3f),
+minSlope(0.05f)
+{
+}
+
+HydraulicErosion::HydraulicErosion(const HydraulicErosionSettings &settings) :
+_settings(settings),
+_jobSystem(NULL),
+_width(0),
+_height(0)
+{
+}
+
+HydraulicErosion::~HydraulicErosion()
+{
+}
+
+void HydraulicErosion::setJobSystem(JobSystem *jobSystem)
+{
+    _jobSystem = jobSystem;
+}
+
+unsigned int HydraulicErosion::erode(float *heights, unsigned int size, const DirtyRect &cells)
+{
+    DirtyRect region = cells;
+    unsigned int x, z, step;
+
+    region.clip(size, size);
+    if (region.isEmpty()) {
+        return 0;
+    }
+    _width = region.maxX - region.minX + 1;
+    _height = region.maxZ - region.minZ + 1;
+
+    unsigned int count = _width * _height;
+    _ground.resize(count);
+    _nextGround.resize(count);
+    _water.assign(count, _settings.rainRate * _settings.timeStep);
+    _nextWater.assign(count, 0.0f);
+    _sediment.assign(count, 0.0f);
+    _nextSediment.assign(count, 0.0f);
+    _fluxLeft.assign(count, 0.0f);
+    _fluxRight.assign(count, 0.0f);
+    _fluxTop.assign(count, 0.0f);
+    _fluxBottom.assign(count, 0.0f);
+    _velocityX.assign(count, 0.0f);
+    _velocityZ.assign(count, 0.0f);
+    _outflowShare.assign(count, 0.0f);
+
+    for (z = 0; z < _height; z++) {
+        for (x = 0; x < _width; x++) {
+            _ground[x + z * _width] = heights[(region.minX + x) + (region.minZ + z) * size];
+        }
+    }
+
+    double start = Game::getAbsoluteTime();
+    for (step = 0; step < _settings.iterations; step++) {
+        if (_settings.maxSeconds > 0 && (Game::getAbsoluteTime() - start) > _settings.maxSeconds * 1000.0) {
+            break;
+        }
+        this->run(&HydraulicErosion::updateFlux);
+        this->run(&HydraulicErosion::updateWater);
+        this->run(&HydraulicErosion::updateSediment);
+        _ground.swap(_nextGround);
+        this->run(&HydraulicErosion::transportSediment);
+    }
+
+    // Whatever is still being carried settles where it is.
+    for (z = 0; z < _height; z++) {
+        for (x = 0; x < _width; x++) {
+            heights[(region.minX + x) + (region.minZ + z) * size] = _ground[x + z * _width] + _sediment[x + z * _width];
+        }
+    }
+    return step;
+}
+
+void HydraulicErosion::run(Pass pass)
+{
+    if (_jobSystem) {
+        _jobSystem->parallelFor(0, _height, 8, [this, pass](unsigned int begin, unsigned int end) {
+            (this->*pass)(begin, end);
+        });
+    } else {
+        (this->*pass)(0, _height);
+    }
+}
+
+void HydraulicErosion::updateFlux(unsigned int begin, unsigned int end)
+{
+    float scale = _settings.timeStep * GRAVITY;
+    unsigned int x, z;
+
+    for (z = begin; z < end; z++) {
+        for (x = 0; x < _width; x++) {
+            unsigned int i = x + z * _width;
+            float level = _ground[i] + _water[i];
+
+            // The region is closed, so there are no pipes out of the edges.
+            float left = x > 0 ? _fluxLeft[i] + scale * (level - _ground[i - 1] - _water[i - 1]) : 0.0f;
+            float right = x + 1 < _width ? _fluxRight[i] + scale * (level - _ground[i + 1] - _water[i + 1]) : 0.0f;
+            float top = z > 0 ? _fluxTop[i] + scale * (level - _ground[i - _width] - _water[i - _width]) : 0.0f;
+            float bottom = z + 1 < _height ? _fluxBottom[i] + scale * (level - _ground[i + _width] - _water[i + _width]) : 0.0f;
+            left = left > 0 ? left : 0;
+            right = right > 0 ? right : 0;
+            top = top > 0 ? top : 0;
+            bottom = bottom > 0 ? bottom : 0;
+
+            // Never let more water out than the cell holds.
+            float total = (left + right + top + bottom) * _settings.timeStep;
+            float limit = total > _water[i] ? _water[i] / total : 1.0f;
+
+            _fluxLeft[i] = left * limit;
+            _fluxRight[i] = right * limit;
+            _fluxTop[i] = top * limit;
+            _fluxBottom[i] = bottom * limit;
+        }
+    }
+}
+
+void HydraulicErosion::updateWater(unsigned int begin, unsigned int end)
+{
+    unsigned int x, z;
+
+    for (z = begin; z < end; z++) {
+        for (x = 0; x < _width; x++) {
+            unsigned int i = x + z * _width;
+            float fromLeft = x > 0 ? _fluxRight[i - 1] : 0.0f;
+            float fromRight = x + 1 < _width ? _fluxLeft[i + 1] : 0.0f;
+            float fromTop = z > 0 ? _fluxBottom[i - _width] : 0.0f;
+            float fromBottom = z + 1 < _height ? _fluxTop[i + _width] : 0.0f;
+            float inflow = fromLeft + fromRight + fromTop + fromBottom;
+            float outflow = _fluxLeft[i] + _fluxRight[i] + _fluxTop[i] + _fluxBottom[i];
+
+            float water = _water[i] + _settings.timeStep * (inflow - outflow);
+            water = water > 0 ? water : 0;
+            _nextWater[i] = water;
+
+            // The speed is the water passing through the cell over the average depth.
+            float depth = (_water[i] + water) * 0.5f;
+            float passX = (fromLeft - _fluxLeft[i] + _fluxRight[i] - fromRight) * 0.5f;
+            float passZ = (fromTop - _fluxTop[i] + _fluxBottom[i] - fromBottom) * 0.5f;
+            _velocityX[i] = depth > 0.0001f ? passX / depth : 0.0f;
+            _velocityZ[i] = depth > 0.0001f ? passZ / depth : 0.0f;
+
+            // The share of the water in the cell that leaves through a pipe, per unit of flux.
+            _outflowShare[i] = _water[i] > 0 ? _settings.timeStep / _water[i] : 0.0f;
+        }
+    }
+}
+
+void HydraulicErosion::updateSediment(unsigned int begin, unsigned int end)
+{
+    unsigned int x, z;
+
+    for (z = begin; z < end; z++) {
+        unsigned int above = z > 0 ? z - 1 : 0;
+        unsigned int below = z + 1 < _height ? z + 1 : z;
+
+        for (x = 0; x < _width; x++) {
+            unsigned int i = x + z * _width;
+            unsigned int left = x > 0 ? x - 1 : 0;
+            unsigned int right = x + 1 < _width ? x + 1 : x;
+
+            float slopeX = (_ground[right + z * _width] - _ground[left + z * _width]) / (float)(right - left > 0 ? right - left : 1);
+            float slopeZ = (_ground[x + below * _width] - _ground[x + above * _width]) / (float)(below - above > 0 ? below - above : 1);
+            float slope = sqrtf(slopeX * slopeX + slopeZ * slopeZ);
+            float tilt = slope / sqrtf(1.0f + slope * slope);
+            tilt = tilt > _settings.minSlope ? tilt : _settings.minSlope;
+
+            // Deeper, faster water on steeper ground carries more.
+            float speed = sqrtf(_velocityX[i] * _velocityX[i] + _velocityZ[i] * _velocityZ[i]);
+            float capacity = _settings.sedimentCapacity * tilt * speed * _nextWater[i];
+            float sediment = _sediment[i];
+
+            if (capacity > sediment) {
+                float amount = _settings.dissolveRate * (capacity - sediment);
+                _nextGround[i] = _ground[i] - amount;
+                _nextSediment[i] = sediment + amount;
+            } else {
+                float amount = _settings.depositRate * (sediment - capacity);
+                _nextGround[i] = _ground[i] + amount;
+                _nextSediment[i] = sediment - amount;
+            }
+        }
+    }
+}
+
+void HydraulicErosion::transportSediment(unsigned int begin, unsigned int end)
+{
+    float keep = 1.0f - _settings.evaporationRate * _settings.timeStep;
+    float rain = _settings.rainRate * _settings.timeStep;
+    unsigned int x, z;
+
+    keep = keep > 0 ? keep : 0;
+    for (z = begin; z < end; z++) {
+        for (x = 0; x < _width; x++) {
+            unsigned int i = x + z * _width;
+
+            // Sediment moves with the same share of the water that flowed through each pipe,
+            // so none is lost or made up along the way.
+            float outflow = (_fluxLeft[i] + _fluxRight[i] + _fluxTop[i] + _fluxBottom[i]) * _outflowShare[i];
+            float sediment = _nextSediment[i] * (1.0f - outflow);
+            if (x > 0) {
+                sediment += _nextSediment[i - 1] * _fluxRight[i - 1] * _outflowShare[i - 1];
+            }
+            if (x + 1 < _width) {
+                sediment += _nextSediment[i + 1] * _fluxLeft[i + 1] * _outflowShare[i + 1];
+            }
+            if (z > 0) {
+                sediment += _nextSediment[i - _width] * _fluxBottom[i - _width] * _outflowShare[i - _width];
+            }
+            if (z + 1 < _height) {
+                sediment += _nextSediment[i + _width] * _fluxTop[i + _width] * _outflowShare[i + _width];
+            }
+            _sediment[i] = sediment;
+
+            _water[i] = _nextWater[i] * keep + rain;
+        }
+    }
+}
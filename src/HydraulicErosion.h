@@ -0,0 +1,212 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef HYDRAULICEROSION_H
+#define HYDRAULICEROSION_H
+
+#include "DirtyRect.h"
+#include "JobSystem.h"
+#include <vector>
+
+/**
+ * Settings for the hydraulic erosion simulation. Distances are in height field cells and heights
+ * are in the units of the height array.
+ **/
+struct HydraulicErosionSettings
+{
+    /**
+     * Constructor - settings that give a visible result on the default terrain.
+     **/
+    HydraulicErosionSettings();
+
+    /**
+     * The most simulation steps to run.
+     **/
+    unsigned int iterations;
+
+    /**
+     * Stop early after this many seconds, 0 for no limit.
+     **/
+    float maxSeconds;
+
+    /**
+     * The length of one simulation step. Larger steps erode faster but can become unstable.
+     **/
+    float timeStep;
+
+    /**
+     * Water added to every cell per second.
+     **/
+    float rainRate;
+
+    /**
+     * The fraction of the water that evaporates per second.
+     **/
+    float evaporationRate;
+
+    /**
+     * How much sediment moving water can carry, for its speed and the steepness of the ground.
+     **/
+    float sedimentCapacity;
+
+    /**
+     * How quickly ground is dissolved when the water can carry more sediment.
+     **/
+    float dissolveRate;
+
+    /**
+     * How quickly sediment is dropped when the water carries too much.
+     **/
+    float depositRate;
+
+    /**
+     * The smallest slope used for the sediment capacity, so water on flat ground still carries something.
+     **/
+    float minSlope;
+};
+
+/**
+ * Grid based hydraulic erosion (the "virtual pipes" model). Every cell holds water and suspended
+ * sediment. Water flows to the neighbouring cells through pipes driven by the difference in water
+ * level, fast water dissolves ground and slow water drops it, and the sediment moves through the
+ * pipes with the water.
+ *
+ * Each step is split into passes over bands of rows. Every pass only writes to its own cell and
+ * reads what the last pass wrote, with the fields it reads around a cell double buffered, so the
+ * bands can run on the job system in any order.
+ **/
+class HydraulicErosion
+{
+public:
+    /**
+     * Constructor
+     *
+     * @param settings How to run the simulation.
+     **/
+    HydraulicErosion(const HydraulicErosionSettings &settings);
+
+    /**
+     * Destructor
+     **/
+    ~HydraulicErosion();
+
+    /**
+     * Set the jobs used for the simulation. Without a job system everything runs on the calling thread.
+     *
+     * @param jobSystem The job system, which must outlive the erosion.
+     * @return void
+     **/
+    void setJobSystem(JobSystem *jobSystem);
+
+    /**
+     * Erode part of a height array. Water can not flow out of the region, so it acts like a basin.
+     *
+     * @param heights The height array, size * size values.
+     * @param size The size of one side of the height array.
+     * @param cells The region to erode.
+     * @return unsigned int The number of steps that were run.
+     **/
+    unsigned int erode(float *heights, unsigned int size, const DirtyRect &cells);
+
+private:
+    /**
+     * A pass over a band of rows.
+     **/
+    typedef void (HydraulicErosion::*Pass)(unsigned int begin, unsigned int end);
+
+    /**
+     * Run a pass over every row of the region.
+     *
+     * @param pass The pass.
+     * @return void
+     **/
+    void run(Pass pass);
+
+    /**
+     * Update the outflow through the pipes from the difference in water level.
+     **/
+    void updateFlux(unsigned int begin, unsigned int end);
+
+    /**
+     * Move the water through the pipes and work out the speed it is moving.
+     **/
+    void updateWater(unsigned int begin, unsigned int end);
+
+    /**
+     * Dissolve or deposit sediment.
+     **/
+    void updateSediment(unsigned int begin, unsigned int end);
+
+    /**
+     * Carry the sediment through the pipes with the water, and evaporate and rain for the next step.
+     **/
+    void transportSediment(unsigned int begin, unsigned int end);
+
+    /**
+     * The settings.
+     **/
+    HydraulicErosionSettings _settings;
+
+    /**
+     * The jobs to run on, or NULL.
+     **/
+    JobSystem *_jobSystem;
+
+    /**
+     * The width of the region.
+     **/
+    unsigned int _width;
+
+    /**
+     * The height of the region.
+     **/
+    unsigned int _height;
+
+    /**
+     * The ground height, read and written copies.
+     **/
+    std::vector<float> _ground, _nextGround;
+
+    /**
+     * The water depth, read and written copies.
+     **/
+    std::vector<float> _water, _nextWater;
+
+    /**
+     * The suspended sediment, read and written copies.
+     **/
+    std::vector<float> _sediment, _nextSediment;
+
+    /**
+     * The outflow from each cell to the left, right, top and bottom neighbours.
+     **/
+    std::vector<float> _fluxLeft, _fluxRight, _fluxTop, _fluxBottom;
+
+    /**
+     * The velocity of the water.
+     **/
+    std::vector<float> _velocityX, _velocityZ;
+
+    /**
+     * The share of a cell's water (and sediment) that one unit of flux carries away in a step.
+     **/
+    std::vector<float> _outflowShare;
+};
+
+#endif // HYDRAULICEROSION_H
@@ -0,0 +1,77 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef IMESHWRITER_H
+#define IMESHWRITER_H
+
+#include <string>
+
+/**
+ * Interface for writing a triangle mesh to a file a piece at a time. The vertices are written first,
+ * then the triangles, so the mesh never has to be held in memory as a whole.
+ **/
+class IMeshWriter
+{
+    public:
+        /**
+         * Just to make subclasses desctructors work.
+         *
+         **/
+        virtual ~IMeshWriter() {}
+
+        /**
+         * Create the file and write the header.
+         *
+         * @param path The path of the file.
+         * @param vertexCount The number of vertices that will be written.
+         * @param triangleCount The number of triangles that will be written.
+         * @return bool false if the file could not be created.
+         **/
+        virtual bool open(const std::string &path, unsigned int vertexCount, unsigned int triangleCount) = 0;
+
+        /**
+         * Write the next vertex.
+         *
+         * @param x The x coordinate
+         * @param y The y coordinate
+         * @param z The z coordinate
+         * @return void
+         **/
+        virtual void writeVertex(float x, float y, float z) = 0;
+
+        /**
+         * Write the next triangle, after all the vertices. The corners go counter clockwise seen from the front.
+         *
+         * @param a The index of the first corner, counting vertices from 0.
+         * @param b The index of the second corner.
+         * @param c The index of the third corner.
+         * @return void
+         **/
+        virtual void writeTriangle(unsigned int a, unsigned int b, unsigned int c) = 0;
+
+        /**
+         * Finish and close the file.
+         *
+         * @return bool false if anything could not be written.
+         **/
+        virtual bool close() = 0;
+};
+
+#endif // IMESHWRITER_H
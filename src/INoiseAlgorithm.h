@@ -52,6 +52,38 @@ class INoiseAlgorithm
          * @return double
          **/
         virtual double noise(double x, double z) = 0;
+
+        /**
+         * Generate the heights for a whole tile of coordinates at once. Generators that can share work
+         * between neighbouring points override this, the default just calls noise for every point.
+         *
+         * @param x The x coordinate of the first column
+         * @param z The z coordinate of the first row
+         * @param width The number of columns
+         * @param height The number of rows
+         * @param output Filled with width * height heights, a row at a time
+         * @return void
+         **/
+        virtual void noiseTile(double x, double z, unsigned int width, unsigned int height, float *output)
+        {
+            unsigned int i, j;
+            for (j = 0; j < height; j++) {
+                for (i = 0; i < width; i++) {
+                    output[i + (j * width)] = static_cast<float>(this->noise(x + i, z + j));
+                }
+            }
+        }
+
+        /**
+         * Whether the noise is a fixed function of position that can be sampled outside 0 to max. Tiles of a
+         * larger world can then be generated separately, and match exactly where they meet.
+         *
+         * @return bool
+         **/
+        virtual bool isTileable() const
+        {
+            return false;
+        }
 };
 
 #endif // INOISEALGORITHM_H
@@ -0,0 +1,351 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "JobSystem.h"
+#include <chrono>
+#include <algorithm>
+
+/**
+ * How long pumpMainThread spends running queued jobs when there are no workers.
+ **/
+static const int MAIN_THREAD_JOB_MS = 8;
+
+struct JobSystem::Job
+{
+    /**
+     * The work to do.
+     **/
+    Task task;
+
+    /**
+     * The number of unfinished dependencies, plus one while the job is being submitted.
+     **/
+    std::atomic<unsigned int> pending;
+
+    /**
+     * Set once the task has run.
+     **/
+    std::atomic<bool> done;
+
+    /**
+     * Protects the lists below and the change to done.
+     **/
+    std::mutex mutex;
+
+    /**
+     * Jobs waiting for this one.
+     **/
+    std::vector<JobHandle> dependents;
+
+    /**
+     * Main thread tasks waiting for this one.
+     **/
+    std::vector<Task> continuations;
+};
+
+JobSystem::JobSystem(unsigned int workerCount) :
+_queued(0),
+_quit(false),
+_started(false)
+{
+    unsigned int i;
+
+    if (workerCount == 0) {
+        unsigned int cores = std::thread::hardware_concurrency();
+        workerCount = cores > 1 ? cores - 1 : 0;
+    }
+    for (i = 0; i < workerCount + 1; i++) {
+        _queues.push_back(new WorkQueue());
+    }
+    for (i = 0; i < workerCount; i++) {
+        _workers.push_back(std::thread(&JobSystem::work, this));
+    }
+    // The workers look themselves up in _workers, so hold them back until it has stopped growing.
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _started = true;
+    }
+    _wake.notify_all();
+}
+
+JobSystem::~JobSystem()
+{
+    unsigned int i;
+
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _quit = true;
+    }
+    _wake.notify_all();
+    for (i = 0; i < _workers.size(); i++) {
+        _workers[i].join();
+    }
+    // Anything the workers didn't get to.
+    while (this->runOne()) {
+    }
+    for (i = 0; i < _queues.size(); i++) {
+        delete _queues[i];
+    }
+}
+
+unsigned int JobSystem::getThreadCount() const
+{
+    return _workers.size() + 1;
+}
+
+unsigned int JobSystem::getQueueIndex() const
+{
+    std::thread::id id = std::this_thread::get_id();
+
+    for (unsigned int i = 0; i < _workers.size(); i++) {
+        if (_workers[i].get_id() == id) {
+            return i;
+        }
+    }
+    return _workers.size();
+}
+
+void JobSystem::work()
+{
+    {
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        while (!_started) {
+            _wake.wait(lock);
+        }
+    }
+    while (true) {
+        if (this->runOne()) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        while (!_quit && _queued == 0) {
+            _wake.wait(lock);
+        }
+        if (_quit && _queued == 0) {
+            return;
+        }
+    }
+}
+
+void JobSystem::schedule(const JobHandle &job)
+{
+    WorkQueue *queue = _queues[this->getQueueIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->jobs.push_back(job);
+    }
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _queued++;
+    }
+    _wake.notify_one();
+}
+
+bool JobSystem::runOne()
+{
+    unsigned int own = this->getQueueIndex();
+    unsigned int i;
+    JobHandle job;
+
+    // Newest first from our own queue, it is most likely to still be in the cache.
+    {
+        WorkQueue *queue = _queues[own];
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (!queue->jobs.empty()) {
+            job = queue->jobs.back();
+            queue->jobs.pop_back();
+        }
+    }
+    // Otherwise the oldest job from someone else.
+    for (i = 1; !job && i < _queues.size(); i++) {
+        WorkQueue *queue = _queues[(own + i) % _queues.size()];
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (!queue->jobs.empty()) {
+            job = queue->jobs.front();
+            queue->jobs.pop_front();
+        }
+    }
+    if (!job) {
+        return false;
+    }
+    _queued--;
+    this->execute(job);
+    return true;
+}
+
+void JobSystem::execute(const JobHandle &job)
+{
+    std::vector<JobHandle> dependents;
+    std::vector<Task> continuations;
+    unsigned int i;
+
+    job->task();
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->done = true;
+        dependents.swap(job->dependents);
+        continuations.swap(job->continuations);
+    }
+    for (i = 0; i < dependents.size(); i++) {
+        if (--dependents[i]->pending == 0) {
+            this->schedule(dependents[i]);
+        }
+    }
+    for (i = 0; i < continuations.size(); i++) {
+        this->runOnMainThread(continuations[i]);
+    }
+}
+
+JobSystem::JobHandle JobSystem::submit(const Task &task)
+{
+    return this->submit(task, std::vector<JobHandle>());
+}
+
+JobSystem::JobHandle JobSystem::submit(const Task &task, const std::vector<JobHandle> &dependencies)
+{
+    JobHandle job(new Job());
+    unsigned int i;
+
+    job->task = task;
+    job->pending = dependencies.size() + 1;
+    job->done = false;
+
+    for (i = 0; i < dependencies.size(); i++) {
+        const JobHandle &dependency = dependencies[i];
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (dependency->done) {
+            job->pending--;
+        } else {
+            dependency->dependents.push_back(job);
+        }
+    }
+    // Drop the submit reference - if every dependency is done, the job is ready.
+    if (--job->pending == 0) {
+        this->schedule(job);
+    }
+    return job;
+}
+
+void JobSystem::then(const JobHandle &job, const Task &continuation)
+{
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if (!job->done) {
+            job->continuations.push_back(continuation);
+            return;
+        }
+    }
+    this->runOnMainThread(continuation);
+}
+
+void JobSystem::runOnMainThread(const Task &task)
+{
+    std::lock_guard<std::mutex> lock(_mainMutex);
+    _mainTasks.push_back(task);
+}
+
+void JobSystem::pumpMainThread()
+{
+    std::vector<Task> tasks;
+    unsigned int i;
+
+    if (_workers.empty()) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(MAIN_THREAD_JOB_MS) && this->runOne()) {
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mainMutex);
+        tasks.swap(_mainTasks);
+    }
+    // Tasks queued while these run wait for the next pump.
+    for (i = 0; i < tasks.size(); i++) {
+        tasks[i]();
+    }
+}
+
+bool JobSystem::isDone(const JobHandle &job) const
+{
+    return job->done;
+}
+
+void JobSystem::wait(const JobHandle &job)
+{
+    while (!job->done) {
+        if (!this->runOne()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::parallelFor(unsigned int begin, unsigned int end, unsigned int grain, const RangeTask &task)
+{
+    std::vector<JobHandle> bands;
+    unsigned int i;
+
+    if (end <= begin) {
+        return;
+    }
+    grain = grain > 0 ? grain : 1;
+
+    // A few bands per thread evens out bands that take longer than others.
+    unsigned int count = this->getThreadCount() * 4;
+    unsigned int size = (end - begin + count - 1) / count;
+    size = size > grain ? size : grain;
+    count = (end - begin + size - 1) / size;
+
+    if (count == 1 || _workers.empty()) {
+        task(begin, end);
+        return;
+    }
+    // The last band runs here, the rest go to the queue.
+    for (i = 0; i + 1 < count; i++) {
+        unsigned int first = begin + i * size;
+        unsigned int last = first + size;
+        bands.push_back(this->submit([&task, first, last]() {
+            task(first, last);
+        }));
+    }
+    task(begin + i * size, end);
+
+    for (i = 0; i < bands.size(); i++) {
+        this->wait(bands[i]);
+    }
+}
+
+void JobSystem::parallelFor2D(const DirtyRect &range, unsigned int tileSize, const TileTask &task)
+{
+    if (range.isEmpty()) {
+        return;
+    }
+    tileSize = tileSize > 0 ? tileSize : 1;
+
+    unsigned int tilesX = (range.maxX - range.minX + tileSize) / tileSize;
+    unsigned int tilesZ = (range.maxZ - range.minZ + tileSize) / tileSize;
+
+    this->parallelFor(0, tilesX * tilesZ, 1, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; i++) {
+            DirtyRect tile(range.minX + (i % tilesX) * tileSize, range.minZ + (i / tilesX) * tileSize, 0, 0);
+            tile.maxX = std::min(tile.minX + (int) tileSize - 1, range.maxX);
+            tile.maxZ = std::min(tile.minZ + (int) tileSize - 1, range.maxZ);
+            task(tile);
+        }
+    });
+}
@@ -0,0 +1,272 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include "DirtyRect.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Runs jobs on a set of worker threads. Each worker has its own queue, and takes work from the
+ * other queues when its own is empty, so jobs that spawn more jobs keep their work local while
+ * idle threads still find something to do.
+ *
+ * A job can wait for other jobs to finish before it starts, and can queue a continuation to run on
+ * the main thread (from pumpMainThread) once it is done - for anything that must touch the scene.
+ * Threads that wait for a job help run queued jobs, so waiting from inside a job is safe.
+ **/
+class JobSystem
+{
+public:
+    /**
+     * A unit of work.
+     **/
+    typedef std::function<void()> Task;
+
+    /**
+     * A piece of a loop, from begin up to (but not including) end.
+     **/
+    typedef std::function<void(unsigned int begin, unsigned int end)> RangeTask;
+
+    /**
+     * A tile of a 2D range.
+     **/
+    typedef std::function<void(const DirtyRect &tile)> TileTask;
+
+    /**
+     * A submitted job.
+     **/
+    struct Job;
+
+    /**
+     * Handle used to wait for, or depend on, a job.
+     **/
+    typedef std::shared_ptr<Job> JobHandle;
+
+    /**
+     * Constructor
+     *
+     * @param workerCount The number of threads to start. 0 starts one less than the number of cores.
+     **/
+    JobSystem(unsigned int workerCount = 0);
+
+    /**
+     * Destructor - finishes the queued jobs and stops the workers.
+     **/
+    ~JobSystem();
+
+    /**
+     * Get the number of threads that run jobs (the workers and a waiting caller).
+     *
+     * @return unsigned int
+     **/
+    unsigned int getThreadCount() const;
+
+    /**
+     * Queue a job.
+     *
+     * @param task The work to do.
+     * @return JobHandle
+     **/
+    JobHandle submit(const Task &task);
+
+    /**
+     * Queue a job that starts once other jobs have finished.
+     *
+     * @param task The work to do.
+     * @param dependencies The jobs to wait for.
+     * @return JobHandle
+     **/
+    JobHandle submit(const Task &task, const std::vector<JobHandle> &dependencies);
+
+    /**
+     * Run a continuation on the main thread once a job has finished.
+     *
+     * @param job The job.
+     * @param continuation Run from pumpMainThread.
+     * @return void
+     **/
+    void then(const JobHandle &job, const Task &continuation);
+
+    /**
+     * Queue a task for the main thread.
+     *
+     * @param task Run from pumpMainThread.
+     * @return void
+     **/
+    void runOnMainThread(const Task &task);
+
+    /**
+     * Run the tasks queued for the main thread. Call this once a frame from the main thread.
+     * Without any workers nothing else would run queued jobs, so they are also given a few
+     * milliseconds of the frame here.
+     *
+     * @return void
+     **/
+    void pumpMainThread();
+
+    /**
+     * Has a job finished?
+     *
+     * @param job The job.
+     * @return bool
+     **/
+    bool isDone(const JobHandle &job) const;
+
+    /**
+     * Wait for a job to finish, running other jobs in the meantime.
+     *
+     * @param job The job.
+     * @return void
+     **/
+    void wait(const JobHandle &job);
+
+    /**
+     * Split a range into bands and run them as jobs. Returns when every band is done.
+     *
+     * @param begin The start of the range.
+     * @param end The end of the range (not included).
+     * @param grain The smallest band worth making a job for.
+     * @param task Called once for each band.
+     * @return void
+     **/
+    void parallelFor(unsigned int begin, unsigned int end, unsigned int grain, const RangeTask &task);
+
+    /**
+     * Split a 2D range into square tiles and run them as jobs. Returns when every tile is done.
+     *
+     * @param range The inclusive range to cover.
+     * @param tileSize The width and height of the tiles.
+     * @param task Called once for each tile with the inclusive rect of the tile.
+     * @return void
+     **/
+    void parallelFor2D(const DirtyRect &range, unsigned int tileSize, const TileTask &task);
+
+private:
+    /**
+     * The queue of one worker. The worker takes from the back, other threads steal from the front.
+     **/
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<JobHandle> jobs;
+    };
+
+    /**
+     * Hidden copy constructor.
+     **/
+    JobSystem(const JobSystem &copy);
+
+    /**
+     * Hidden assignment.
+     **/
+    JobSystem& operator=(const JobSystem &copy);
+
+    /**
+     * The loop for the worker threads. Waits for the constructor to start every worker first.
+     *
+     * @return void
+     **/
+    void work();
+
+    /**
+     * Get the index of the queue belonging to the calling thread.
+     *
+     * @return unsigned int The queue for threads that are not workers is the last one.
+     **/
+    unsigned int getQueueIndex() const;
+
+    /**
+     * Put a job that is ready to run on a queue.
+     *
+     * @param job The job.
+     * @return void
+     **/
+    void schedule(const JobHandle &job);
+
+    /**
+     * Take a job from the calling thread's queue, or steal one from another queue, and run it.
+     *
+     * @return bool False if there was nothing to run.
+     **/
+    bool runOne();
+
+    /**
+     * Run a job, then release the jobs and continuations waiting for it.
+     *
+     * @param job The job.
+     * @return void
+     **/
+    void execute(const JobHandle &job);
+
+    /**
+     * One queue per worker, plus one shared by every other thread.
+     **/
+    std::vector<WorkQueue*> _queues;
+
+    /**
+     * The worker threads.
+     **/
+    std::vector<std::thread> _workers;
+
+    /**
+     * The number of jobs sitting in the queues.
+     **/
+    std::atomic<unsigned int> _queued;
+
+    /**
+     * Protects sleeping and waking the workers.
+     **/
+    std::mutex _sleepMutex;
+
+    /**
+     * Wakes the workers when jobs are queued.
+     **/
+    std::condition_variable _wake;
+
+    /**
+     * Tells the workers to stop.
+     **/
+    bool _quit;
+
+    /**
+     * Set once every worker thread has been created, so _workers no longer changes.
+     **/
+    bool _started;
+
+    /**
+     * Protects the main thread queue.
+     **/
+    std::mutex _mainMutex;
+
+    /**
+     * Tasks waiting for the main thread.
+     **/
+    std::vector<Task> _mainTasks;
+};
+
+#endif // JOBSYSTEM_H
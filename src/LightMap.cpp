@@ -0,0 +1,370 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "LightMap.h"
+#include "PngFile.h"
+#include <algorithm>
+#include <math.h>
+
+const unsigned int LightMap::DIRECTIONS = 16;
+
+/**
+ * The angle over which the sun fades out as it sets behind the terrain, about 2 degrees.
+ **/
+static const float PENUMBRA = 0.035f;
+
+LightMap::LightMap(unsigned int resolution) :
+_resolution(resolution),
+_spacingX(1.0f),
+_spacingZ(1.0f),
+_sunAzimuth(MATH_DEG_TO_RAD(225.0f)),
+_sunElevation(MATH_DEG_TO_RAD(35.0f)),
+_ambient(0.4f),
+_baked(false),
+_jobSystem(NULL)
+{
+    GP_ASSERT(resolution >= 2);
+}
+
+LightMap::~LightMap()
+{
+}
+
+unsigned int LightMap::getResolution() const
+{
+    return _resolution;
+}
+
+void LightMap::setResolution(unsigned int resolution)
+{
+    GP_ASSERT(resolution >= 2);
+
+    // The buffers are only allocated by the next bake.
+    _resolution = resolution;
+    _heights.clear();
+    _horizons.clear();
+    _shadows.clear();
+    _pixels.clear();
+    _baked = false;
+}
+
+void LightMap::setJobSystem(JobSystem *jobSystem)
+{
+    _jobSystem = jobSystem;
+}
+
+void LightMap::setSun(float azimuth, float elevation)
+{
+    _sunAzimuth = azimuth;
+    _sunElevation = elevation;
+    if (_baked) {
+        this->bakeShadows();
+        this->combine();
+    }
+}
+
+void LightMap::setAmbient(float ambient)
+{
+    _ambient = ambient;
+    if (_baked) {
+        this->combine();
+    }
+}
+
+bool LightMap::isBaked() const
+{
+    return _baked;
+}
+
+void LightMap::bake(const float* heights, unsigned int heightFieldSize, const Vector3& terrainScale)
+{
+    unsigned int texelCount = _resolution * _resolution;
+
+    if (heightFieldSize < 2) {
+        return;
+    }
+    _heights.resize(texelCount);
+    _horizons.resize(texelCount * DIRECTIONS);
+    _shadows.resize(texelCount);
+    _pixels.resize(texelCount);
+
+    DirtyRect texels(0, 0, _resolution - 1, _resolution - 1);
+    this->sampleHeights(heights, heightFieldSize, terrainScale, texels);
+    this->bakeTexels(texels);
+    _baked = true;
+}
+
+void LightMap::bake(const float* heights, unsigned int heightFieldSize, const Vector3& terrainScale, const DirtyRect& cells)
+{
+    if (heightFieldSize < 2 || cells.isEmpty()) {
+        return;
+    }
+    if (!_baked) {
+        this->bake(heights, heightFieldSize, terrainScale);
+        return;
+    }
+
+    // Each texel blends the cells around it.
+    float gridScale = (float)(heightFieldSize - 1) / (float)(_resolution - 1);
+    DirtyRect texels((int)floorf((cells.minX - 1) / gridScale), (int)floorf((cells.minZ - 1) / gridScale),
+                     (int)ceilf((cells.maxX + 1) / gridScale), (int)ceilf((cells.maxZ + 1) / gridScale));
+    texels.clip(_resolution, _resolution);
+
+    this->sampleHeights(heights, heightFieldSize, terrainScale, texels);
+    this->bakeTexels(texels);
+}
+
+void LightMap::sampleHeights(const float* heights, unsigned int heightFieldSize, const Vector3& terrainScale, const DirtyRect& texels)
+{
+    float gridScale = (float)(heightFieldSize - 1) / (float)(_resolution - 1);
+    float max = (float)(heightFieldSize - 1);
+
+    _spacingX = gridScale * terrainScale.x;
+    _spacingZ = gridScale * terrainScale.z;
+
+    JobSystem::RangeTask band = [&](unsigned int begin, unsigned int end) {
+        unsigned int x, z;
+
+        for (z = begin; z < end; z++) {
+            float gridz = std::min(z * gridScale, max);
+            unsigned int z0 = (unsigned int)gridz;
+            unsigned int z1 = z0 + 1 < heightFieldSize ? z0 + 1 : z0;
+            float fz = gridz - z0;
+            const float *row0 = heights + z0 * heightFieldSize;
+            const float *row1 = heights + z1 * heightFieldSize;
+            float *output = &_heights[z * _resolution];
+
+            for (x = texels.minX; x <= (unsigned int)texels.maxX; x++) {
+                float gridx = std::min(x * gridScale, max);
+                unsigned int x0 = (unsigned int)gridx;
+                unsigned int x1 = x0 + 1 < heightFieldSize ? x0 + 1 : x0;
+                float fx = gridx - x0;
+                float top = row0[x0] + (row0[x1] - row0[x0]) * fx;
+                float bottom = row1[x0] + (row1[x1] - row1[x0]) * fx;
+                output[x] = (top + (bottom - top) * fz) * terrainScale.y;
+            }
+        }
+    };
+
+    if (_jobSystem) {
+        _jobSystem->parallelFor(texels.minZ, texels.maxZ + 1, 16, band);
+    } else {
+        band(texels.minZ, texels.maxZ + 1);
+    }
+}
+
+void LightMap::bakeTexels(const DirtyRect& texels)
+{
+    Sweep sweep;
+    unsigned int direction;
+
+    // A sweep finds the horizon behind each texel, so it walks away from the direction being looked in.
+    for (direction = 0; direction < DIRECTIONS; direction++) {
+        this->setupSweep(MATH_PIX2 * direction / DIRECTIONS, sweep);
+        this->sweepLines(sweep, texels, false, &_horizons[direction * _resolution * _resolution]);
+    }
+    this->setupSweep(_sunAzimuth + MATH_PI, sweep);
+    this->sweepLines(sweep, texels, true, &_shadows[0]);
+
+    this->combine();
+}
+
+void LightMap::bakeShadows()
+{
+    Sweep sweep;
+
+    this->setupSweep(_sunAzimuth + MATH_PI, sweep);
+    this->sweepLines(sweep, DirtyRect(0, 0, _resolution - 1, _resolution - 1), true, &_shadows[0]);
+}
+
+void LightMap::setupSweep(float angle, Sweep& sweep) const
+{
+    float directionX = cosf(angle), directionZ = sinf(angle);
+    unsigned int step;
+
+    // Step one texel at a time along whichever axis the direction crosses texels fastest.
+    float texelsX = directionX / _spacingX, texelsZ = directionZ / _spacingZ;
+    sweep.alongX = fabsf(texelsX) >= fabsf(texelsZ);
+    float major = sweep.alongX ? texelsX : texelsZ;
+    float slope = (sweep.alongX ? texelsZ : texelsX) / fabsf(major);
+    float majorDistance = (sweep.alongX ? _spacingX : _spacingZ) * fabsf(sweep.alongX ? directionX : directionZ);
+    float minorDistance = (sweep.alongX ? _spacingZ : _spacingX) * (sweep.alongX ? directionZ : directionX);
+    sweep.step = major >= 0 ? 1 : -1;
+
+    sweep.offsets.resize(_resolution);
+    sweep.distances.resize(_resolution);
+    for (step = 0; step < _resolution; step++) {
+        sweep.offsets[step] = (int)floorf(step * slope + 0.5f);
+        sweep.distances[step] = step * majorDistance + sweep.offsets[step] * minorDistance;
+    }
+}
+
+void LightMap::sweepLines(const Sweep& sweep, const DirtyRect& texels, bool shadows, unsigned char* output) const
+{
+    int last = (int)_resolution - 1;
+
+    // The steps that cross the texels, then the lines that reach them on those steps.
+    int minMajor = sweep.alongX ? texels.minX : texels.minZ;
+    int maxMajor = sweep.alongX ? texels.maxX : texels.maxZ;
+    int minMinor = sweep.alongX ? texels.minZ : texels.minX;
+    int maxMinor = sweep.alongX ? texels.maxZ : texels.maxX;
+    int firstStep = sweep.step > 0 ? minMajor : last - maxMajor;
+    int lastStep = sweep.step > 0 ? maxMajor : last - minMajor;
+    int lowOffset = std::min(sweep.offsets[firstStep], sweep.offsets[lastStep]);
+    int highOffset = std::max(sweep.offsets[firstStep], sweep.offsets[lastStep]);
+    int firstLine = minMinor - highOffset;
+    int lastLine = maxMinor - lowOffset;
+
+    JobSystem::RangeTask band = [&](unsigned int begin, unsigned int end) {
+        std::vector<HullPoint> hull;
+        std::vector<unsigned int> indices(_resolution);
+        std::vector<float> tangents(_resolution);
+        unsigned int line, i;
+
+        hull.reserve(_resolution);
+        for (line = begin; line < end; line++) {
+            unsigned int count = this->traceLine(sweep, firstLine + (int)line, hull, &indices[0], &tangents[0]);
+
+            for (i = 0; i < count; i++) {
+                float tangent = tangents[i];
+                if (shadows) {
+                    float lit = (_sunElevation - atanf(tangent)) / PENUMBRA + 0.5f;
+                    lit = lit < 0 ? 0 : (lit > 1 ? 1 : lit);
+                    output[indices[i]] = (unsigned char)(lit * 255.0f + 0.5f);
+                } else if (tangent > 0) {
+                    output[indices[i]] = (unsigned char)(tangent / sqrtf(1.0f + tangent * tangent) * 255.0f + 0.5f);
+                } else {
+                    output[indices[i]] = 0;
+                }
+            }
+        }
+    };
+
+    if (_jobSystem) {
+        _jobSystem->parallelFor(0, lastLine - firstLine + 1, 16, band);
+    } else {
+        band(0, lastLine - firstLine + 1);
+    }
+}
+
+unsigned int LightMap::traceLine(const Sweep& sweep, int line, std::vector<HullPoint>& hull, unsigned int* texels, float* tangents) const
+{
+    unsigned int step, count = 0;
+
+    hull.clear();
+    for (step = 0; step < _resolution; step++) {
+        int minor = line + sweep.offsets[step];
+        if (minor < 0 || minor >= (int)_resolution) {
+            // The offsets only grow or only shrink, so once a line leaves the map it stays off it.
+            if (count > 0) {
+                break;
+            }
+            continue;
+        }
+        unsigned int major = sweep.step > 0 ? step : _resolution - 1 - step;
+        unsigned int texel = sweep.alongX ? major + minor * _resolution : minor + major * _resolution;
+        HullPoint point;
+        point.distance = sweep.distances[step];
+        point.height = _heights[texel];
+
+        // Points under the line from the one before them to here can't be the horizon from here or from
+        // anywhere further along, what is left on top is the horizon.
+        while (hull.size() >= 2) {
+            const HullPoint &top = hull[hull.size() - 1];
+            const HullPoint &below = hull[hull.size() - 2];
+            if ((below.height - point.height) * (point.distance - top.distance) <
+                (top.height - point.height) * (point.distance - below.distance)) {
+                break;
+            }
+            hull.pop_back();
+        }
+
+        if (hull.empty()) {
+            tangents[count] = -1.0e30f;
+        } else {
+            tangents[count] = (hull.back().height - point.height) / (point.distance - hull.back().distance);
+        }
+        texels[count++] = texel;
+        hull.push_back(point);
+    }
+    return count;
+}
+
+void LightMap::combine()
+{
+    float sunX = cosf(_sunElevation) * cosf(_sunAzimuth);
+    float sunY = sinf(_sunElevation);
+    float sunZ = cosf(_sunElevation) * sinf(_sunAzimuth);
+    float occlusionScale = 1.0f / (255.0f * DIRECTIONS);
+    unsigned int texelCount = _resolution * _resolution;
+
+    JobSystem::RangeTask band = [&](unsigned int begin, unsigned int end) {
+        std::vector<float> occlusion(_resolution);
+        unsigned int x, z, direction;
+
+        for (z = begin; z < end; z++) {
+            // Add up the horizons a row at a time, so the loop vectorizes.
+            std::fill(occlusion.begin(), occlusion.end(), 0.0f);
+            for (direction = 0; direction < DIRECTIONS; direction++) {
+                const unsigned char *horizons = &_horizons[direction * texelCount + z * _resolution];
+                for (x = 0; x < _resolution; x++) {
+                    occlusion[x] += horizons[x];
+                }
+            }
+
+            unsigned int up = z > 0 ? z - 1 : z;
+            unsigned int down = z + 1 < _resolution ? z + 1 : z;
+            const float *above = &_heights[up * _resolution];
+            const float *below = &_heights[down * _resolution];
+            const float *row = &_heights[z * _resolution];
+            const unsigned char *shadows = &_shadows[z * _resolution];
+            unsigned char *output = &_pixels[z * _resolution];
+            float slopeZ = 1.0f / ((down - up) * _spacingZ);
+
+            for (x = 0; x < _resolution; x++) {
+                unsigned int left = x > 0 ? x - 1 : x;
+                unsigned int right = x + 1 < _resolution ? x + 1 : x;
+                float normalX = -(row[right] - row[left]) / ((right - left) * _spacingX);
+                float normalZ = -(below[x] - above[x]) * slopeZ;
+                float facing = (normalX * sunX + sunY + normalZ * sunZ) / sqrtf(normalX * normalX + 1.0f + normalZ * normalZ);
+                facing = facing > 0 ? facing : 0;
+
+                float sky = 1.0f - occlusion[x] * occlusionScale;
+                float light = _ambient * sky + (1.0f - _ambient) * facing * shadows[x] * (1.0f / 255.0f);
+                output[x] = (unsigned char)(light * 255.0f + 0.5f);
+            }
+        }
+    };
+
+    if (_jobSystem) {
+        _jobSystem->parallelFor(0, _resolution, 16, band);
+    } else {
+        band(0, _resolution);
+    }
+}
+
+bool LightMap::exportTexture(const std::string& path) const
+{
+    if (!_baked) {
+        GP_WARN("The light map has not been baked.");
+        return false;
+    }
+    return PngFile::save(path, _pixels, _resolution, _resolution, LCT_GREY, _jobSystem);
+}
@@ -0,0 +1,302 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef LIGHTMAP_H
+#define LIGHTMAP_H
+
+#include "gameplay.h"
+#include "DirtyRect.h"
+#include "JobSystem.h"
+#include <string>
+#include <vector>
+
+using namespace gameplay;
+
+/**
+ * Bakes the lighting of the terrain into a grey texture - ambient occlusion from the sky, plus the sun
+ * with the shadows cast by the terrain - for targets that can't afford to shade the terrain at runtime.
+ *
+ * Both come from the horizon, the highest angle the terrain rises to when looking from a texel in one
+ * direction. Rather than marching a ray from every texel, the map is swept along parallel lines in each
+ * direction. Every texel is on exactly one line, and walking a line keeps the upper convex hull of the
+ * heights already passed, so the horizon of each texel is found from the top of the hull in amortized
+ * constant time - the whole map costs O(n) for each direction, and the lines are swept in parallel.
+ * The occlusion averages the horizons of 16 directions, the shadows sweep towards the sun.
+ *
+ * The horizon of every direction is kept, so after an edit only the lines crossing the changed texels
+ * are swept again, then the directions are recombined.
+ **/
+class LightMap
+{
+public:
+    /**
+     * Constructor
+     *
+     * @param resolution The size of one side of the (square) light map, at least 2.
+     **/
+    LightMap(unsigned int resolution);
+
+    /**
+     * Destructor
+     **/
+    ~LightMap();
+
+    /**
+     * Get the size of one side of the light map.
+     *
+     * @return unsigned int
+     **/
+    unsigned int getResolution() const;
+
+    /**
+     * Change the size of the light map. The light map needs baking again.
+     *
+     * @param resolution The new size, at least 2.
+     * @return void
+     **/
+    void setResolution(unsigned int resolution);
+
+    /**
+     * Set the jobs used to bake and save the light map. Without a job system everything runs on the calling thread.
+     *
+     * @param jobSystem The job system, which must outlive the light map.
+     * @return void
+     **/
+    void setJobSystem(JobSystem *jobSystem);
+
+    /**
+     * Move the sun. If the light map is baked the shadows are swept again straight away.
+     *
+     * @param azimuth The direction of the sun around the y axis in radians, 0 is along +x and PI / 2 along +z.
+     * @param elevation The angle of the sun above the horizon in radians.
+     * @return void
+     **/
+    void setSun(float azimuth, float elevation);
+
+    /**
+     * Set how much of the light comes from the sky rather than the sun.
+     *
+     * @param ambient From 0 to 1.
+     * @return void
+     **/
+    void setAmbient(float ambient);
+
+    /**
+     * Bake the whole light map.
+     *
+     * @param heights The height array, heightFieldSize * heightFieldSize values.
+     * @param heightFieldSize The size of one side of the height array.
+     * @param terrainScale The scale of the terrain, the horizons are measured in world units.
+     * @return void
+     **/
+    void bake(const float *heights, unsigned int heightFieldSize, const Vector3 &terrainScale);
+
+    /**
+     * Bake again after some cells of the height field have been edited. Bakes everything if the light
+     * map has not been baked yet.
+     *
+     * @param heights The height array, heightFieldSize * heightFieldSize values.
+     * @param heightFieldSize The size of one side of the height array.
+     * @param terrainScale The scale of the terrain.
+     * @param cells The cells of the height field that changed.
+     * @return void
+     **/
+    void bake(const float *heights, unsigned int heightFieldSize, const Vector3 &terrainScale, const DirtyRect &cells);
+
+    /**
+     * Has the light map been baked since the resolution was set?
+     *
+     * @return bool
+     **/
+    bool isBaked() const;
+
+    /**
+     * Write the light map to a grey png file.
+     *
+     * @param path The path of the file.
+     * @return bool
+     **/
+    bool exportTexture(const std::string &path) const;
+
+private:
+    /**
+     * The number of directions averaged for the ambient occlusion.
+     **/
+    static const unsigned int DIRECTIONS;
+
+    /**
+     * How the lines of a sweep cross the map. Each step moves one texel along the major axis and the
+     * offset along the other axis is rounded, so the lines of a sweep are copies of each other shifted
+     * sideways, and every texel is on exactly one of them.
+     **/
+    struct Sweep
+    {
+        /**
+         * Whether x is the major axis.
+         **/
+        bool alongX;
+
+        /**
+         * The direction of a step along the major axis, 1 or -1.
+         **/
+        int step;
+
+        /**
+         * The offset along the minor axis after each number of steps.
+         **/
+        std::vector<int> offsets;
+
+        /**
+         * The distance travelled in the direction of the sweep after each number of steps, in world units.
+         **/
+        std::vector<float> distances;
+    };
+
+    /**
+     * A point on the horizon hull of a line.
+     **/
+    struct HullPoint
+    {
+        float distance;
+        float height;
+    };
+
+    /**
+     * Work out the lines for a sweep in a direction.
+     *
+     * @param angle The direction the lines are walked, in radians around the y axis.
+     * @param sweep Filled with the lines.
+     * @return void
+     **/
+    void setupSweep(float angle, Sweep &sweep) const;
+
+    /**
+     * Sweep the lines crossing some texels, writing the horizon of every texel on them.
+     *
+     * @param sweep The lines.
+     * @param texels The texels that need their lines swept.
+     * @param shadows Write sun visibility rather than the sine of the horizon.
+     * @param output One byte per texel.
+     * @return void
+     **/
+    void sweepLines(const Sweep &sweep, const DirtyRect &texels, bool shadows, unsigned char *output) const;
+
+    /**
+     * Walk one line, finding the tangent of the horizon behind each texel.
+     *
+     * @param sweep The lines.
+     * @param line The line, its offset along the minor axis at the start.
+     * @param hull Scratch space for the hull.
+     * @param texels Filled with the index of each texel on the line.
+     * @param tangents Filled with the tangent of the horizon of each texel, very negative with nothing behind it.
+     * @return unsigned int The number of texels on the line.
+     **/
+    unsigned int traceLine(const Sweep &sweep, int line, std::vector<HullPoint> &hull, unsigned int *texels, float *tangents) const;
+
+    /**
+     * Resample the height field at the texels.
+     *
+     * @param heights The height array.
+     * @param heightFieldSize The size of one side of the height array.
+     * @param terrainScale The scale of the terrain.
+     * @param texels The texels to sample.
+     * @return void
+     **/
+    void sampleHeights(const float *heights, unsigned int heightFieldSize, const Vector3 &terrainScale, const DirtyRect &texels);
+
+    /**
+     * Sweep the ambient occlusion and sun directions over some texels, then combine them.
+     *
+     * @param texels The texels that changed.
+     * @return void
+     **/
+    void bakeTexels(const DirtyRect &texels);
+
+    /**
+     * Sweep the shadows of the whole map.
+     *
+     * @return void
+     **/
+    void bakeShadows();
+
+    /**
+     * Combine the occlusion, shadows and sun angle into the light of every texel.
+     *
+     * @return void
+     **/
+    void combine();
+
+    /**
+     * The size of one side of the light map.
+     **/
+    unsigned int _resolution;
+
+    /**
+     * The heights at the texels, in world units.
+     **/
+    std::vector<float> _heights;
+
+    /**
+     * The sine of the horizon of each texel in each direction, 0 to 255, one map after another.
+     **/
+    std::vector<unsigned char> _horizons;
+
+    /**
+     * How much of the sun reaches each texel, 0 to 255.
+     **/
+    std::vector<unsigned char> _shadows;
+
+    /**
+     * The baked light.
+     **/
+    std::vector<unsigned char> _pixels;
+
+    /**
+     * The distance between texels along x and z, in world units.
+     **/
+    float _spacingX, _spacingZ;
+
+    /**
+     * The direction of the sun around the y axis.
+     **/
+    float _sunAzimuth;
+
+    /**
+     * The angle of the sun above the horizon.
+     **/
+    float _sunElevation;
+
+    /**
+     * How much of the light comes from the sky.
+     **/
+    float _ambient;
+
+    /**
+     * Whether the maps are baked.
+     **/
+    bool _baked;
+
+    /**
+     * The job system to work on, or NULL.
+     **/
+    JobSystem *_jobSystem;
+};
+
+#endif // LIGHTMAP_H
@@ -1597,7 +1597,7 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
 
 /* /////////////////////////////////////////////////////////////////////////// */
 
-static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize)
+static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize, int final)
 {
   /*non compressed deflate block data: 1 bit BFINAL,2 bits BTYPE,(5 bits): it jumps to start of next byte,
   2 bytes LEN, 2 bytes NLEN, LEN bytes literal DATA*/
@@ -1609,7 +1609,7 @@ static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, s
     unsigned BFINAL, BTYPE, LEN, NLEN;
     unsigned char firstbyte;
 
-    BFINAL = (i == numdeflateblocks - 1);
+    BFINAL = final && (i == numdeflateblocks - 1);
     BTYPE = 0;
 
     firstbyte = (unsigned char)(BFINAL + ((BTYPE & 1) << 1) + ((BTYPE & 2) << 1));
@@ -1736,7 +1736,7 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
     else
     {
       if(!uivector_resize(&lz77_encoded, datasize)) ERROR_BREAK(83 /*alloc fail*/);
-      for(i = datapos; i < dataend; i++) lz77_encoded.data[i] = data[i]; /*no LZ77, but still will be Huffman compressed*/
+      for(i = datapos; i < dataend; i++) lz77_encoded.data[i - datapos] = data[i]; /*no LZ77, but still will be Huffman compressed*/
     }
 
     if(!uivector_resizev(&frequencies_ll, 286, 0)) ERROR_BREAK(83 /*alloc fail*/);
@@ -1961,8 +1961,12 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
   return error;
 }
 
-static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
-                                 const LodePNGCompressSettings* settings)
+/*
+Deflate in as a part of a larger deflate stream. If final is false, the last block is not marked
+as final and the output ends on a byte boundary, so another part can be appended to it as bytes.
+*/
+static unsigned deflatePart(ucvector* out, const unsigned char* in, size_t insize,
+                            const LodePNGCompressSettings* settings, int final)
 {
   unsigned error = 0;
   size_t i, blocksize, numdeflateblocks;
@@ -1970,7 +1974,7 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
   Hash hash;
 
   if(settings->btype > 2) return 61;
-  else if(settings->btype == 0) return deflateNoCompression(out, in, insize);
+  else if(settings->btype == 0) return deflateNoCompression(out, in, insize, final);
   else if(settings->btype == 1) blocksize = insize;
   else /*if(settings->btype == 2)*/
   {
@@ -1986,13 +1990,25 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
 
   for(i = 0; i < numdeflateblocks && !error; i++)
   {
-    int final = i == numdeflateblocks - 1;
+    int lastblock = final && i == numdeflateblocks - 1;
     size_t start = i * blocksize;
     size_t end = start + blocksize;
     if(end > insize) end = insize;
 
-    if(settings->btype == 1) error = deflateFixed(out, &bp, &hash, in, start, end, settings, final);
-    else if(settings->btype == 2) error = deflateDynamic(out, &bp, &hash, in, start, end, settings, final);
+    if(settings->btype == 1) error = deflateFixed(out, &bp, &hash, in, start, end, settings, lastblock);
+    else if(settings->btype == 2) error = deflateDynamic(out, &bp, &hash, in, start, end, settings, lastblock);
+  }
+
+  if(!error && !final)
+  {
+    /*an empty non-final stored block pads the stream to the next byte boundary*/
+    addBitToStream(&bp, out, 0); /*BFINAL*/
+    addBitToStream(&bp, out, 0); /*first bit of BTYPE*/
+    addBitToStream(&bp, out, 0); /*second bit of BTYPE*/
+    ucvector_push_back(out, 0); /*LEN*/
+    ucvector_push_back(out, 0);
+    ucvector_push_back(out, 255); /*NLEN*/
+    ucvector_push_back(out, 255);
   }
 
   hash_cleanup(&hash);
@@ -2000,6 +2016,12 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
   return error;
 }
 
+static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
+                                 const LodePNGCompressSettings* settings)
+{
+  return deflatePart(out, in, insize, settings, 1);
+}
+
 unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGCompressSettings* settings)
@@ -2062,6 +2084,37 @@ static unsigned adler32(const unsigned char* data, unsigned len)
   return update_adler32(1L, data, len);
 }
 
+#ifdef LODEPNG_COMPILE_ENCODER
+/*Return the adler32 of two concatenated buffers, given the adler32 of each and the length of the second*/
+static unsigned combine_adler32(unsigned adler1, unsigned adler2, size_t len2)
+{
+  unsigned rem = (unsigned)(len2 % 65521);
+  unsigned s1 = adler1 & 0xffff;
+  unsigned s2 = (unsigned)(((unsigned long)rem * s1) % 65521);
+  s1 += (adler2 & 0xffff) + 65521 - 1;
+  s2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + 65521 - rem;
+  if(s1 >= 65521) s1 -= 65521;
+  if(s1 >= 65521) s1 -= 65521;
+  if(s2 >= 65521 * 2) s2 -= 65521 * 2;
+  if(s2 >= 65521) s2 -= 65521;
+  return (s2 << 16) | s1;
+}
+
+/*zlib data starts with 1 byte CMF (CM+CINFO) and 1 byte FLG*/
+static void addZlibHeader(ucvector* out)
+{
+  unsigned CMF = 120; /*0b01111000: CM 8, CINFO 7. With CINFO 7, any window size up to 32768 can be used.*/
+  unsigned FLEVEL = 0;
+  unsigned FDICT = 0;
+  unsigned CMFFLG = 256 * CMF + FDICT * 32 + FLEVEL * 64;
+  unsigned FCHECK = 31 - CMFFLG % 31;
+  CMFFLG += FCHECK;
+
+  ucvector_push_back(out, (unsigned char)(CMFFLG / 256));
+  ucvector_push_back(out, (unsigned char)(CMFFLG % 256));
+}
+#endif /*LODEPNG_COMPILE_ENCODER*/
+
 /* ////////////////////////////////////////////////////////////////////////// */
 /* / Zlib                                                                   / */
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -2143,18 +2196,11 @@ unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsig
 
   unsigned ADLER32;
   /*zlib data: 1 byte CMF (CM+CINFO), 1 byte FLG, deflate data, 4 byte ADLER32 checksum of the Decompressed data*/
-  unsigned CMF = 120; /*0b01111000: CM 8, CINFO 7. With CINFO 7, any window size up to 32768 can be used.*/
-  unsigned FLEVEL = 0;
-  unsigned FDICT = 0;
-  unsigned CMFFLG = 256 * CMF + FDICT * 32 + FLEVEL * 64;
-  unsigned FCHECK = 31 - CMFFLG % 31;
-  CMFFLG += FCHECK;
 
   /*ucvector-controlled version of the output buffer, for dynamic array*/
   ucvector_init_buffer(&outv, *out, *outsize);
 
-  ucvector_push_back(&outv, (unsigned char)(CMFFLG / 256));
-  ucvector_push_back(&outv, (unsigned char)(CMFFLG % 256));
+  addZlibHeader(&outv);
 
   error = deflate(&deflatedata, &deflatesize, in, insize, settings);
 
@@ -4982,15 +5028,115 @@ static unsigned addChunk_tRNS(ucvector* out, const LodePNGColorMode* info)
   return error;
 }
 
+#ifdef LODEPNG_COMPILE_ZLIB
+/*One stripe of the IDAT data, deflated independently of the others*/
+typedef struct IDATStripe
+{
+  const unsigned char* data;
+  size_t datasize;
+  const LodePNGCompressSettings* zlibsettings;
+  int final;
+  ucvector deflated;
+  unsigned adler;
+  unsigned error;
+} IDATStripe;
+
+/*task for custom_parallel: data is the array of stripes*/
+static void deflateIDATStripe(void* data, unsigned index)
+{
+  IDATStripe* stripe = &((IDATStripe*)data)[index];
+  stripe->error = deflatePart(&stripe->deflated, stripe->data, stripe->datasize,
+                              stripe->zlibsettings, stripe->final);
+  stripe->adler = adler32(stripe->data, (unsigned)stripe->datasize);
+}
+
+/*
+Write the zlib stream as one IDAT chunk per stripe. The deflate stream of every stripe except
+the last ends byte aligned and without a final block, so the concatenated chunk data is a single
+valid zlib stream, as the PNG specification requires.
+*/
+static unsigned addChunk_IDAT_stripes(ucvector* out, const unsigned char* data, size_t datasize,
+                                      const LodePNGEncoderSettings* settings)
+{
+  unsigned error = 0;
+  unsigned i, numstripes = settings->stripes;
+  size_t stripesize;
+  unsigned adler;
+  IDATStripe* stripes;
+
+  if(numstripes > datasize) numstripes = (unsigned)datasize;
+  stripesize = (datasize + numstripes - 1) / numstripes;
+  numstripes = (unsigned)((datasize + stripesize - 1) / stripesize);
+
+  stripes = (IDATStripe*)lodepng_malloc(sizeof(IDATStripe) * numstripes);
+  if(!stripes) return 83; /*alloc fail*/
+
+  for(i = 0; i < numstripes; i++)
+  {
+    size_t start = i * stripesize;
+    stripes[i].data = &data[start];
+    stripes[i].datasize = (start + stripesize > datasize) ? datasize - start : stripesize;
+    stripes[i].zlibsettings = &settings->zlibsettings;
+    stripes[i].final = (i == numstripes - 1);
+    ucvector_init(&stripes[i].deflated);
+    stripes[i].adler = 1;
+    stripes[i].error = 0;
+  }
+
+  if(settings->custom_parallel)
+  {
+    settings->custom_parallel(deflateIDATStripe, stripes, numstripes, settings->parallel_context);
+  }
+  else
+  {
+    for(i = 0; i < numstripes; i++) deflateIDATStripe(stripes, i);
+  }
+
+  for(i = 0; i < numstripes && !error; i++) error = stripes[i].error;
+
+  adler = stripes[0].adler;
+  for(i = 1; i < numstripes; i++) adler = combine_adler32(adler, stripes[i].adler, stripes[i].datasize);
+
+  for(i = 0; i < numstripes && !error; i++)
+  {
+    ucvector chunkdata;
+    ucvector_init(&chunkdata);
+    if(i == 0) addZlibHeader(&chunkdata);
+    if(!ucvector_resize(&chunkdata, chunkdata.size + stripes[i].deflated.size)) error = 83; /*alloc fail*/
+    if(!error)
+    {
+      memcpy(&chunkdata.data[chunkdata.size - stripes[i].deflated.size],
+             stripes[i].deflated.data, stripes[i].deflated.size);
+      if(i == numstripes - 1) lodepng_add32bitInt(&chunkdata, adler);
+      error = addChunk(out, "IDAT", chunkdata.data, chunkdata.size);
+    }
+    ucvector_cleanup(&chunkdata);
+  }
+
+  for(i = 0; i < numstripes; i++) ucvector_cleanup(&stripes[i].deflated);
+  lodepng_free(stripes);
+
+  return error;
+}
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
 static unsigned addChunk_IDAT(ucvector* out, const unsigned char* data, size_t datasize,
-                              LodePNGCompressSettings* zlibsettings)
+                              const LodePNGEncoderSettings* settings)
 {
   ucvector zlibdata;
   unsigned error = 0;
 
+#ifdef LODEPNG_COMPILE_ZLIB
+  if(settings->stripes > 1 && datasize > 1
+     && !settings->zlibsettings.custom_zlib && !settings->zlibsettings.custom_deflate)
+  {
+    return addChunk_IDAT_stripes(out, data, datasize, settings);
+  }
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
   /*compress with the Zlib compressor*/
   ucvector_init(&zlibdata);
-  error = zlib_compress(&zlibdata.data, &zlibdata.size, data, datasize, zlibsettings);
+  error = zlib_compress(&zlibdata.data, &zlibdata.size, data, datasize, &settings->zlibsettings);
   if(!error) error = addChunk(out, "IDAT", zlibdata.data, zlibdata.size);
   ucvector_cleanup(&zlibdata);
 
@@ -5265,14 +5411,16 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
 
   if(bpp == 0) return 31; /*error: invalid color type*/
 
-  if(strategy == LFS_ZERO)
+  if(strategy >= LFS_ZERO && strategy <= LFS_FOUR)
   {
+    /*the strategies LFS_ZERO to LFS_FOUR have the value of their filter type*/
+    unsigned char type = (unsigned char)strategy;
     for(y = 0; y < h; y++)
     {
       size_t outindex = (1 + linebytes) * y; /*the extra filterbyte added to each row*/
       size_t inindex = linebytes * y;
-      out[outindex] = 0; /*filter type byte*/
-      filterScanline(&out[outindex + 1], &in[inindex], prevline, linebytes, bytewidth, 0);
+      out[outindex] = type; /*filter type byte*/
+      filterScanline(&out[outindex + 1], &in[inindex], prevline, linebytes, bytewidth, type);
       prevline = &in[inindex];
     }
   }
@@ -5769,7 +5917,7 @@ unsigned lodepng_encode(unsigned char** out, size_t* outsize,
     }
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
     /*IDAT (multiple IDAT chunks must be consecutive)*/
-    state->error = addChunk_IDAT(&outv, data, datasize, &state->encoder.zlibsettings);
+    state->error = addChunk_IDAT(&outv, data, datasize, &state->encoder);
     if(state->error) break;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
     /*tIME*/
@@ -5909,12 +6057,53 @@ void lodepng_encoder_settings_init(LodePNGEncoderSettings* settings)
   settings->auto_convert = LAC_AUTO;
   settings->force_palette = 0;
   settings->predefined_filters = 0;
+  settings->stripes = 1;
+  settings->custom_parallel = 0;
+  settings->parallel_context = 0;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
   settings->add_id = 0;
   settings->text_compression = 1;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 }
 
+void lodepng_encoder_settings_preset(LodePNGEncoderSettings* settings, LodePNGEncoderPreset preset)
+{
+  LodePNGCompressSettings* zlibsettings = &settings->zlibsettings;
+  if(preset == LEP_FAST)
+  {
+    settings->filter_palette_zero = 0;
+    settings->filter_strategy = LFS_FOUR;
+    settings->auto_convert = LAC_NO;
+    zlibsettings->btype = 2;
+    zlibsettings->use_lz77 = 1;
+    /*small windows also limit the hash chain length, see encodeLZ77*/
+    zlibsettings->windowsize = 256;
+    zlibsettings->minmatch = 3;
+    zlibsettings->nicematch = 32;
+    zlibsettings->lazymatching = 0;
+  }
+  else if(preset == LEP_FASTEST)
+  {
+    settings->filter_palette_zero = 0;
+    settings->filter_strategy = LFS_ONE;
+    settings->auto_convert = LAC_NO;
+    zlibsettings->btype = 2;
+    zlibsettings->use_lz77 = 0;
+  }
+  else /*LEP_DEFAULT*/
+  {
+    settings->filter_palette_zero = 1;
+    settings->filter_strategy = LFS_MINSUM;
+    settings->auto_convert = LAC_AUTO;
+    zlibsettings->btype = 2;
+    zlibsettings->use_lz77 = 1;
+    zlibsettings->windowsize = DEFAULT_WINDOWSIZE;
+    zlibsettings->minmatch = 3;
+    zlibsettings->nicematch = 128;
+    zlibsettings->lazymatching = 1;
+  }
+}
+
 #endif /*LODEPNG_COMPILE_ENCODER*/
 #endif /*LODEPNG_COMPILE_PNG*/
 
@@ -542,6 +542,12 @@ typedef enum LodePNGFilterStrategy
 {
   /*every filter at zero*/
   LFS_ZERO,
+  /*every filter at 1 (Sub), 2 (Up), 3 (Average) or 4 (Paeth). A single fixed filter skips the
+  per scanline search of the adaptive strategies, which makes filtering about five times faster.*/
+  LFS_ONE,
+  LFS_TWO,
+  LFS_THREE,
+  LFS_FOUR,
   /*Use filter that gives minumum sum, as described in the official PNG filter heuristic.*/
   LFS_MINSUM,
   /*Use the filter type that gives smallest Shannon entropy for this scanline. Depending
@@ -614,6 +620,19 @@ typedef struct LodePNGEncoderSettings
   /*force creating a PLTE chunk if colortype is 2 or 6 (= a suggested palette).
   If colortype is 3, PLTE is _always_ created.*/
   unsigned force_palette;
+
+  /*Split the filtered image data into this many equal stripes of consecutive bytes before
+  compressing. Every stripe is deflated on its own and stored in its own IDAT chunk, so the
+  stripes can be compressed at the same time with custom_parallel. Costs a little compression
+  because LZ77 can't match across a stripe boundary. Ignored if a custom_zlib or custom_deflate
+  function is set. Default: 1*/
+  unsigned stripes;
+  /*Runs task(data, 0) ... task(data, count - 1), possibly concurrently, and returns once all of
+  them have finished. Used to deflate the stripes; if null they are deflated one after the other.
+  Default: null*/
+  void (*custom_parallel)(void (*task)(void*, unsigned), void* data, unsigned count,
+                          const void* context);
+  const void* parallel_context; /*optional context passed to custom_parallel*/
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
   /*add LodePNG identifier and version as a text chunk, for debugging*/
   unsigned add_id;
@@ -623,6 +642,24 @@ typedef struct LodePNGEncoderSettings
 } LodePNGEncoderSettings;
 
 void lodepng_encoder_settings_init(LodePNGEncoderSettings* settings);
+
+/*Speed versus size tradeoffs for lodepng_encoder_settings_preset.*/
+typedef enum LodePNGEncoderPreset
+{
+  /*the lodepng_encoder_settings_init values: adaptive filtering and a full LZ77 search*/
+  LEP_DEFAULT,
+  /*Paeth filter on every scanline, small LZ77 window without lazy matching and no automatic
+  color type selection. Good for smooth images like terrain blend maps.*/
+  LEP_FAST,
+  /*Sub filter on every scanline and Huffman coding only, no LZ77 at all*/
+  LEP_FASTEST
+} LodePNGEncoderPreset;
+
+/*
+Set the filter and compression fields of settings to one of the presets. The other fields,
+such as the stripes and custom_parallel, are left alone.
+*/
+void lodepng_encoder_settings_preset(LodePNGEncoderSettings* settings, LodePNGEncoderPreset preset);
 #endif /*LODEPNG_COMPILE_ENCODER*/
 
 
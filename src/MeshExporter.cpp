@@ -0,0 +1,338 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "MeshExporter.h"
+#include "ObjWriter.h"
+#include "PlyWriter.h"
+#include <math.h>
+#include <ctype.h>
+#include <algorithm>
+
+/**
+ * Count the set bits in a word.
+ **/
+static unsigned int countBits(unsigned long long bits)
+{
+    bits = bits - ((bits >> 1) & 0x5555555555555555ULL);
+    bits = (bits & 0x3333333333333333ULL) + ((bits >> 2) & 0x3333333333333333ULL);
+    bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<unsigned int>((bits * 0x0101010101010101ULL) >> 56);
+}
+
+bool MeshExporter::Block::operator<(const Block &other) const
+{
+    return error < other.error;
+}
+
+MeshExporter::MeshExporter() :
+_maxError(0),
+_targetTriangles(0),
+_triangleCount(0),
+_heights(NULL),
+_size(0),
+_wordsPerRow(0)
+{
+}
+
+MeshExporter::~MeshExporter()
+{
+}
+
+void MeshExporter::setMaxError(float maxError)
+{
+    _maxError = maxError;
+}
+
+void MeshExporter::setTargetTriangles(unsigned int triangles)
+{
+    _targetTriangles = triangles;
+}
+
+unsigned int MeshExporter::getTriangleCount() const
+{
+    return _triangleCount;
+}
+
+bool MeshExporter::save(const std::string &path, const float *heights, unsigned int size, const Vector3 &scale)
+{
+    std::string extension;
+    size_t dot = path.find_last_of('.');
+    if (dot != std::string::npos) {
+        extension = path.substr(dot + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    }
+
+    if (extension == "ply") {
+        PlyWriter writer;
+        return this->write(writer, path, heights, size, scale);
+    }
+    ObjWriter writer;
+    return this->write(writer, path, heights, size, scale);
+}
+
+bool MeshExporter::write(IMeshWriter &writer, const std::string &path, const float *heights, unsigned int size, const Vector3 &scale)
+{
+    unsigned int i, j;
+
+    GP_ASSERT(heights);
+    GP_ASSERT(size >= 2);
+    _heights = heights;
+    _size = size;
+    _scale = scale;
+
+    if (_maxError <= 0 && _targetTriangles == 0) {
+        return this->writeFull(writer, path);
+    }
+
+    std::vector<Block> blocks;
+    this->decimate(blocks);
+
+    // Mark the corners of every block. A block with more vertices on its edges than its corners
+    // is drawn as a fan, which needs its center as well. The centers are inside their blocks, so
+    // marking them never adds vertices to the edge of another block.
+    _wordsPerRow = (size + 63) / 64;
+    _used.assign(_wordsPerRow * size, 0);
+    for (i = 0; i < blocks.size(); i++) {
+        const Block &block = blocks[i];
+        this->useVertex(block.x, block.z);
+        this->useVertex(block.x, block.z + block.size);
+        this->useVertex(block.x + block.size, block.z + block.size);
+        this->useVertex(block.x + block.size, block.z);
+    }
+
+    std::vector<unsigned int> edge;
+    std::vector<bool> fans(blocks.size(), false);
+    _triangleCount = 0;
+    for (i = 0; i < blocks.size(); i++) {
+        const Block &block = blocks[i];
+        this->getEdgeVertices(block, edge);
+        if (edge.size() > 4) {
+            fans[i] = true;
+            _triangleCount += edge.size();
+            this->useVertex(block.x + block.size / 2, block.z + block.size / 2);
+        } else {
+            _triangleCount += 2;
+        }
+    }
+
+    // Count the vertices before each word, then any index is a count of the bits before it.
+    unsigned int vertexCount = 0;
+    _usedBefore.resize(_used.size());
+    for (i = 0; i < _used.size(); i++) {
+        _usedBefore[i] = vertexCount;
+        vertexCount += countBits(_used[i]);
+    }
+
+    if (!writer.open(path, vertexCount, _triangleCount)) {
+        return false;
+    }
+    for (j = 0; j < size; j++) {
+        for (i = 0; i < size; i++) {
+            if (this->isUsed(i, j)) {
+                this->writeVertex(writer, i, j);
+            }
+        }
+    }
+
+    for (i = 0; i < blocks.size(); i++) {
+        const Block &block = blocks[i];
+        if (fans[i]) {
+            this->getEdgeVertices(block, edge);
+            unsigned int center = this->getVertexIndex(block.x + block.size / 2, block.z + block.size / 2);
+            for (j = 0; j < edge.size(); j++) {
+                unsigned int first = edge[j], second = edge[(j + 1) % edge.size()];
+                writer.writeTriangle(center,
+                                     this->getVertexIndex(first & 0xffff, first >> 16),
+                                     this->getVertexIndex(second & 0xffff, second >> 16));
+            }
+        } else {
+            unsigned int a = this->getVertexIndex(block.x, block.z);
+            unsigned int b = this->getVertexIndex(block.x, block.z + block.size);
+            unsigned int c = this->getVertexIndex(block.x + block.size, block.z + block.size);
+            unsigned int d = this->getVertexIndex(block.x + block.size, block.z);
+            writer.writeTriangle(a, b, c);
+            writer.writeTriangle(a, c, d);
+        }
+    }
+
+    _used.clear();
+    _usedBefore.clear();
+    return writer.close();
+}
+
+bool MeshExporter::writeFull(IMeshWriter &writer, const std::string &path)
+{
+    unsigned int i, j;
+    unsigned int cells = _size - 1;
+
+    _triangleCount = cells * cells * 2;
+    if (!writer.open(path, _size * _size, _triangleCount)) {
+        return false;
+    }
+    for (j = 0; j < _size; j++) {
+        for (i = 0; i < _size; i++) {
+            this->writeVertex(writer, i, j);
+        }
+    }
+    for (j = 0; j < cells; j++) {
+        for (i = 0; i < cells; i++) {
+            unsigned int a = i + j * _size;
+            unsigned int b = a + _size;
+            writer.writeTriangle(a, b, b + 1);
+            writer.writeTriangle(a, b + 1, a + 1);
+        }
+    }
+    return writer.close();
+}
+
+void MeshExporter::decimate(std::vector<Block> &blocks) const
+{
+    // The root block is a power of two, the parts of it off the height field are split away.
+    unsigned int rootSize = 1;
+    while (rootSize < _size - 1) {
+        rootSize *= 2;
+    }
+    float errorLimit = _scale.y > 0 ? _maxError / _scale.y : _maxError;
+
+    // A heap of blocks, the worst one at the front.
+    blocks.clear();
+    this->queueBlock(blocks, 0, 0, rootSize);
+    while (!blocks.empty()) {
+        if (blocks.front().error <= errorLimit) {
+            break;
+        }
+        if (_targetTriangles > 0 && blocks.size() * 2 >= _targetTriangles) {
+            break;
+        }
+        std::pop_heap(blocks.begin(), blocks.end());
+        Block block = blocks.back();
+        blocks.pop_back();
+
+        unsigned int half = block.size / 2;
+        this->queueBlock(blocks, block.x, block.z, half);
+        this->queueBlock(blocks, block.x + half, block.z, half);
+        this->queueBlock(blocks, block.x, block.z + half, half);
+        this->queueBlock(blocks, block.x + half, block.z + half, half);
+    }
+}
+
+void MeshExporter::queueBlock(std::vector<Block> &queue, unsigned int x, unsigned int z, unsigned int size) const
+{
+    unsigned int last = _size - 1;
+
+    if (x >= last || z >= last) {
+        return;
+    }
+    if (x + size > last || z + size > last) {
+        unsigned int half = size / 2;
+        this->queueBlock(queue, x, z, half);
+        this->queueBlock(queue, x + half, z, half);
+        this->queueBlock(queue, x, z + half, half);
+        this->queueBlock(queue, x + half, z + half, half);
+        return;
+    }
+
+    Block block;
+    block.x = x;
+    block.z = z;
+    block.size = size;
+    block.error = this->getError(x, z, size);
+    queue.push_back(block);
+    std::push_heap(queue.begin(), queue.end());
+}
+
+float MeshExporter::getError(unsigned int x, unsigned int z, unsigned int size) const
+{
+    if (size <= 1) {
+        return 0.0f;
+    }
+
+    // The block is split along the diagonal from the first corner to the opposite one.
+    float a = _heights[x + z * _size];
+    float b = _heights[x + (z + size) * _size];
+    float c = _heights[x + size + (z + size) * _size];
+    float d = _heights[x + size + z * _size];
+    float step = 1.0f / size;
+    float error = 0.0f;
+    unsigned int i, j;
+
+    for (j = 0; j <= size; j++) {
+        const float *row = _heights + x + (z + j) * _size;
+        float fz = j * step;
+        for (i = 0; i <= size; i++) {
+            float fx = i * step;
+            float flat = fz >= fx ? a + (b - a) * fz + (c - b) * fx : a + (d - a) * fx + (c - d) * fz;
+            error = std::max(error, fabsf(row[i] - flat));
+        }
+    }
+    return error;
+}
+
+void MeshExporter::useVertex(unsigned int x, unsigned int z)
+{
+    _used[z * _wordsPerRow + x / 64] |= 1ULL << (x % 64);
+}
+
+bool MeshExporter::isUsed(unsigned int x, unsigned int z) const
+{
+    return (_used[z * _wordsPerRow + x / 64] >> (x % 64)) & 1;
+}
+
+unsigned int MeshExporter::getVertexIndex(unsigned int x, unsigned int z) const
+{
+    unsigned int word = z * _wordsPerRow + x / 64;
+    return _usedBefore[word] + countBits(_used[word] & ((1ULL << (x % 64)) - 1));
+}
+
+void MeshExporter::getEdgeVertices(const Block &block, std::vector<unsigned int> &vertices) const
+{
+    unsigned int left = block.x, right = block.x + block.size;
+    unsigned int top = block.z, bottom = block.z + block.size;
+    unsigned int i;
+
+    // Down the left side, along the bottom, up the right side and back along the top.
+    vertices.clear();
+    for (i = top; i < bottom; i++) {
+        if (this->isUsed(left, i)) {
+            vertices.push_back(left | (i << 16));
+        }
+    }
+    for (i = left; i < right; i++) {
+        if (this->isUsed(i, bottom)) {
+            vertices.push_back(i | (bottom << 16));
+        }
+    }
+    for (i = bottom; i > top; i--) {
+        if (this->isUsed(right, i)) {
+            vertices.push_back(right | (i << 16));
+        }
+    }
+    for (i = right; i > left; i--) {
+        if (this->isUsed(i, top)) {
+            vertices.push_back(i | (top << 16));
+        }
+    }
+}
+
+void MeshExporter::writeVertex(IMeshWriter &writer, unsigned int x, unsigned int z) const
+{
+    float center = (_size - 1) * 0.5f;
+    writer.writeVertex((x - center) * _scale.x, _heights[x + z * _size] * _scale.y, (z - center) * _scale.z);
+}
@@ -0,0 +1,248 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef MESHEXPORTER_H
+#define MESHEXPORTER_H
+
+#include "IMeshWriter.h"
+
+#include "gameplay.h"
+#include <vector>
+
+using namespace gameplay;
+
+/**
+ * Turns a height field into a triangle mesh and streams it to a file.
+ *
+ * At full resolution every cell is two triangles. Otherwise the height field is cut into a quadtree of
+ * square blocks - the block that differs most from two flat triangles is split in four until every block
+ * is within the maximum error, or there are enough triangles. A block with smaller neighbours has extra
+ * vertices on its edges, it is drawn as a fan around its center through all of them, so there are no
+ * cracks however much the sizes of neighbours differ.
+ *
+ * The used vertices are kept as one bit per cell, and a vertex index is found by counting the bits
+ * before it, so only the blocks and the bits are in memory while the file is written.
+ **/
+class MeshExporter
+{
+public:
+    /**
+     * Constructor - full resolution.
+     **/
+    MeshExporter();
+
+    /**
+     * Destructor
+     **/
+    ~MeshExporter();
+
+    /**
+     * Set the largest height difference allowed between the mesh and the height field.
+     *
+     * @param maxError The error in world units. With no target triangle count, 0 exports every cell.
+     * @return void
+     **/
+    void setMaxError(float maxError);
+
+    /**
+     * Stop splitting blocks at about this many triangles, even when the error is larger.
+     *
+     * @param triangles The number of triangles, or 0 for no limit.
+     * @return void
+     **/
+    void setTargetTriangles(unsigned int triangles);
+
+    /**
+     * Export a height field, as PLY if the path ends in .ply or OBJ otherwise. The mesh is centered like
+     * the terrain built from the height field.
+     *
+     * @param path The path of the file.
+     * @param heights The height array.
+     * @param size The size of one side of the height field.
+     * @param scale The spacing of the cells in x and z, and the scale of the heights in y.
+     * @return bool false if the file could not be written.
+     **/
+    bool save(const std::string &path, const float *heights, unsigned int size, const Vector3 &scale);
+
+    /**
+     * Export a height field through any writer.
+     *
+     * @param writer The writer.
+     * @param path The path of the file.
+     * @param heights The height array.
+     * @param size The size of one side of the height field.
+     * @param scale The spacing of the cells in x and z, and the scale of the heights in y.
+     * @return bool false if the file could not be written.
+     **/
+    bool write(IMeshWriter &writer, const std::string &path, const float *heights, unsigned int size, const Vector3 &scale);
+
+    /**
+     * Get the number of triangles in the last export.
+     *
+     * @return unsigned int
+     **/
+    unsigned int getTriangleCount() const;
+
+private:
+    /**
+     * A square block of cells.
+     **/
+    struct Block
+    {
+        unsigned int x, z, size;
+        float error;
+
+        /**
+         * Orders the blocks by error, for the split queue.
+         **/
+        bool operator<(const Block &other) const;
+    };
+
+    /**
+     * Write every cell as two triangles.
+     *
+     * @param writer The writer.
+     * @param path The path of the file.
+     * @return bool
+     **/
+    bool writeFull(IMeshWriter &writer, const std::string &path);
+
+    /**
+     * Split the height field into blocks until the error or the triangle count is reached.
+     *
+     * @param blocks Filled with the blocks.
+     * @return void
+     **/
+    void decimate(std::vector<Block> &blocks) const;
+
+    /**
+     * Queue a block to be split, or split it straight away if it is partly off the height field.
+     *
+     * @param queue The queue.
+     * @param x The first column.
+     * @param z The first row.
+     * @param size The number of cells across.
+     * @return void
+     **/
+    void queueBlock(std::vector<Block> &queue, unsigned int x, unsigned int z, unsigned int size) const;
+
+    /**
+     * Get the largest difference between the heights in a block and its two triangles.
+     *
+     * @param x The first column.
+     * @param z The first row.
+     * @param size The number of cells across.
+     * @return float In height field units.
+     **/
+    float getError(unsigned int x, unsigned int z, unsigned int size) const;
+
+    /**
+     * Mark a vertex as used.
+     *
+     * @param x The column.
+     * @param z The row.
+     * @return void
+     **/
+    void useVertex(unsigned int x, unsigned int z);
+
+    /**
+     * Whether a vertex is used.
+     *
+     * @param x The column.
+     * @param z The row.
+     * @return bool
+     **/
+    bool isUsed(unsigned int x, unsigned int z) const;
+
+    /**
+     * Get the index of a used vertex in the file.
+     *
+     * @param x The column.
+     * @param z The row.
+     * @return unsigned int
+     **/
+    unsigned int getVertexIndex(unsigned int x, unsigned int z) const;
+
+    /**
+     * Collect the used vertices around the edge of a block, counter clockwise from the first corner.
+     *
+     * @param block The block.
+     * @param vertices Filled with the positions, x in the low half and z in the high.
+     * @return void
+     **/
+    void getEdgeVertices(const Block &block, std::vector<unsigned int> &vertices) const;
+
+    /**
+     * Write the position of a vertex.
+     *
+     * @param writer The writer.
+     * @param x The column.
+     * @param z The row.
+     * @return void
+     **/
+    void writeVertex(IMeshWriter &writer, unsigned int x, unsigned int z) const;
+
+    /**
+     * The largest error allowed, in world units.
+     **/
+    float _maxError;
+
+    /**
+     * The triangle count to stop at, or 0.
+     **/
+    unsigned int _targetTriangles;
+
+    /**
+     * The number of triangles in the last export.
+     **/
+    unsigned int _triangleCount;
+
+    /**
+     * The height field being exported.
+     **/
+    const float *_heights;
+
+    /**
+     * The size of one side of the height field.
+     **/
+    unsigned int _size;
+
+    /**
+     * The scale of the height field.
+     **/
+    Vector3 _scale;
+
+    /**
+     * One bit for each vertex, set when it is used. Each row starts a new word.
+     **/
+    std::vector<unsigned long long> _used;
+
+    /**
+     * The number of words in each row of the used bits.
+     **/
+    unsigned int _wordsPerRow;
+
+    /**
+     * The number of used vertices before each word of the used bits.
+     **/
+    std::vector<unsigned int> _usedBefore;
+};
+
+#endif // MESHEXPORTER_H
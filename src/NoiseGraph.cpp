@@ -0,0 +1,381 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "NoiseGraph.h"
+#include "SimplexNoise.h"
+#include <math.h>
+#include <algorithm>
+
+// The number of points evaluated together, small enough for all the node buffers to stay in the cache.
+static const unsigned int TILE_POINTS = 4096;
+
+/**
+ * Mix two seeds into a position in the noise, so each source samples a different part of it.
+ **/
+static double seedOffset(int seed, int nodeSeed, unsigned int axis)
+{
+    unsigned int h = static_cast<unsigned int>(seed) * 0x9E3779B1u;
+    h ^= static_cast<unsigned int>(nodeSeed) * 0x85EBCA77u + axis * 0xC2B2AE3Du;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    // The simplex permutation repeats every 256 units.
+    return (h & 0xffff) / 256.0;
+}
+
+NoiseGraph::NoiseGraph() :
+_output(-1),
+_min(0),
+_max(0),
+_worldScale(1)
+{
+}
+
+NoiseGraph::~NoiseGraph()
+{
+}
+
+int NoiseGraph::addNode(NodeType type)
+{
+    Node node;
+    node.type = type;
+    node.fractalType = FBM;
+    node.blendType = ADD;
+    node.inputs[0] = node.inputs[1] = node.inputs[2] = -1;
+    node.value = 0;
+    node.frequency = 1;
+    node.octaves = 1;
+    node.lacunarity = 2;
+    node.gain = 0.5f;
+    node.seed = 0;
+    node.offsetX = 0;
+    node.offsetZ = 0;
+    _nodes.push_back(node);
+    _output = _nodes.size() - 1;
+    return _output;
+}
+
+int NoiseGraph::addConstant(float value)
+{
+    int index = this->addNode(CONSTANT);
+    _nodes[index].value = value;
+    return index;
+}
+
+int NoiseGraph::addSource(float frequency, int seed)
+{
+    int index = this->addNode(SOURCE);
+    _nodes[index].frequency = frequency;
+    _nodes[index].seed = seed;
+    return index;
+}
+
+int NoiseGraph::addFractal(FractalType type, float frequency, unsigned int octaves, float lacunarity, float gain, int seed)
+{
+    GP_ASSERT(octaves > 0);
+    int index = this->addNode(FRACTAL);
+    Node &node = _nodes[index];
+    node.fractalType = type;
+    node.frequency = frequency;
+    node.octaves = octaves;
+    node.lacunarity = lacunarity;
+    node.gain = gain;
+    node.seed = seed;
+    return index;
+}
+
+int NoiseGraph::addWarp(int input, int warpX, int warpZ, float strength)
+{
+    GP_ASSERT(input >= 0 && warpX >= 0 && warpZ >= 0 && input < (int) _nodes.size() && warpX < (int) _nodes.size() && warpZ < (int) _nodes.size());
+    int index = this->addNode(WARP);
+    Node &node = _nodes[index];
+    node.inputs[0] = input;
+    node.inputs[1] = warpX;
+    node.inputs[2] = warpZ;
+    node.value = strength;
+    return index;
+}
+
+int NoiseGraph::addCurve(int input, const std::vector<Vector2> &points)
+{
+    GP_ASSERT(input >= 0 && input < (int) _nodes.size());
+    GP_ASSERT(!points.empty());
+    int index = this->addNode(CURVE);
+    _nodes[index].inputs[0] = input;
+    _nodes[index].points = points;
+    return index;
+}
+
+int NoiseGraph::addScaleBias(int input, float scale, float bias)
+{
+    GP_ASSERT(input >= 0 && input < (int) _nodes.size());
+    int index = this->addNode(SCALE_BIAS);
+    _nodes[index].inputs[0] = input;
+    _nodes[index].gain = scale;
+    _nodes[index].value = bias;
+    return index;
+}
+
+int NoiseGraph::addBlend(BlendType type, int first, int second, int weight)
+{
+    GP_ASSERT(first >= 0 && second >= 0 && first < (int) _nodes.size() && second < (int) _nodes.size());
+    GP_ASSERT(type != LERP || (weight >= 0 && weight < (int) _nodes.size()));
+    int index = this->addNode(BLEND);
+    Node &node = _nodes[index];
+    node.blendType = type;
+    node.inputs[0] = first;
+    node.inputs[1] = second;
+    node.inputs[2] = weight;
+    return index;
+}
+
+void NoiseGraph::setOutput(int node)
+{
+    GP_ASSERT(node >= 0 && node < (int) _nodes.size());
+    _output = node;
+}
+
+unsigned int NoiseGraph::getNodeCount() const
+{
+    return _nodes.size();
+}
+
+void NoiseGraph::init(double maxx, double maxz, double rangemin, double rangemax, int seed)
+{
+    GP_ASSERT(_output >= 0);
+    _min = rangemin;
+    _max = rangemax;
+    _worldScale = maxx;
+    if (maxz > maxx) {
+        _worldScale = maxz;
+    }
+
+    std::vector<Node>::iterator node;
+    for (node = _nodes.begin(); node != _nodes.end(); node++) {
+        node->offsetX = seedOffset(seed, node->seed, 0);
+        node->offsetZ = seedOffset(seed, node->seed, 1);
+    }
+}
+
+bool NoiseGraph::isTileable() const
+{
+    return true;
+}
+
+double NoiseGraph::noise(double x, double z)
+{
+    float height;
+    this->noiseTile(x, z, 1, 1, &height);
+    return height;
+}
+
+void NoiseGraph::noiseTile(double x, double z, unsigned int width, unsigned int height, float *output)
+{
+    // Work through the tile a few rows at a time so the buffers of every node stay small.
+    unsigned int rows = TILE_POINTS / width;
+    if (rows < 1) {
+        rows = 1;
+    }
+    std::vector<double> xs(rows * width);
+    std::vector<double> zs(rows * width);
+    std::vector<int> chain;
+    float scale = (_max - _min) * 0.5;
+    float offset = _min + scale;
+    unsigned int i, j, k, row, count;
+
+    for (row = 0; row < height; row += rows) {
+        count = std::min(rows, height - row) * width;
+        for (j = 0, k = 0; k < count; j++) {
+            for (i = 0; i < width; i++, k++) {
+                xs[k] = (x + i) / _worldScale;
+                zs[k] = (z + row + j) / _worldScale;
+            }
+        }
+        float *values = output + (row * width);
+        this->evaluate(_output, &xs[0], &zs[0], count, values, chain);
+        for (k = 0; k < count; k++) {
+            values[k] = values[k] * scale + offset;
+        }
+    }
+}
+
+float NoiseGraph::applyChain(const std::vector<int> &chain, float value) const
+{
+    // The innermost operation was added last.
+    unsigned int c = chain.size();
+    while (c--) {
+        const Node &node = _nodes[chain[c]];
+        if (node.type == SCALE_BIAS) {
+            value = value * node.gain + node.value;
+        } else {
+            const std::vector<Vector2> &points = node.points;
+            unsigned int last = points.size() - 1;
+            if (value <= points[0].x) {
+                value = points[0].y;
+            } else if (value >= points[last].x) {
+                value = points[last].y;
+            } else {
+                unsigned int p = 1;
+                while (points[p].x < value) {
+                    p++;
+                }
+                float span = points[p].x - points[p - 1].x;
+                float t = span > 0 ? (value - points[p - 1].x) / span : 1.0f;
+                value = points[p - 1].y + (points[p].y - points[p - 1].y) * t;
+            }
+        }
+    }
+    return value;
+}
+
+void NoiseGraph::evaluate(int index, const double *xs, const double *zs, unsigned int count, float *output, const std::vector<int> &chain) const
+{
+    const Node &node = _nodes[index];
+    unsigned int k;
+
+    switch (node.type) {
+        case CONSTANT: {
+            float value = this->applyChain(chain, node.value);
+            for (k = 0; k < count; k++) {
+                output[k] = value;
+            }
+            break;
+        }
+        case SOURCE:
+        case FRACTAL: {
+            this->evaluateFractal(node, xs, zs, count, output, chain);
+            break;
+        }
+        case CURVE:
+        case SCALE_BIAS: {
+            // No buffer of our own - whoever makes the input value applies us as they write it.
+            std::vector<int> inner(chain);
+            inner.push_back(index);
+            this->evaluate(node.inputs[0], xs, zs, count, output, inner);
+            break;
+        }
+        case WARP: {
+            std::vector<int> none;
+            std::vector<double> warped(count * 2);
+            // The output buffer is free until the input is evaluated, so hold the offsets there.
+            this->evaluate(node.inputs[1], xs, zs, count, output, none);
+            for (k = 0; k < count; k++) {
+                warped[k] = xs[k] + output[k] * node.value;
+            }
+            this->evaluate(node.inputs[2], xs, zs, count, output, none);
+            for (k = 0; k < count; k++) {
+                warped[count + k] = zs[k] + output[k] * node.value;
+            }
+            // The chain passes through the warp to the node being sampled.
+            this->evaluate(node.inputs[0], &warped[0], &warped[count], count, output, chain);
+            break;
+        }
+        case BLEND: {
+            std::vector<int> none;
+            std::vector<float> second(count);
+            this->evaluate(node.inputs[0], xs, zs, count, output, none);
+            this->evaluate(node.inputs[1], xs, zs, count, &second[0], none);
+            switch (node.blendType) {
+                case ADD:
+                    for (k = 0; k < count; k++) {
+                        output[k] = this->applyChain(chain, output[k] + second[k]);
+                    }
+                    break;
+                case MULTIPLY:
+                    for (k = 0; k < count; k++) {
+                        output[k] = this->applyChain(chain, output[k] * second[k]);
+                    }
+                    break;
+                case MIN:
+                    for (k = 0; k < count; k++) {
+                        output[k] = this->applyChain(chain, std::min(output[k], second[k]));
+                    }
+                    break;
+                case MAX:
+                    for (k = 0; k < count; k++) {
+                        output[k] = this->applyChain(chain, std::max(output[k], second[k]));
+                    }
+                    break;
+                case LERP: {
+                    std::vector<float> weight(count);
+                    this->evaluate(node.inputs[2], xs, zs, count, &weight[0], none);
+                    for (k = 0; k < count; k++) {
+                        float t = std::min(std::max(weight[k], 0.0f), 1.0f);
+                        output[k] = this->applyChain(chain, output[k] + (second[k] - output[k]) * t);
+                    }
+                    break;
+                }
+            }
+            break;
+        }
+    }
+}
+
+void NoiseGraph::evaluateFractal(const Node &node, const double *xs, const double *zs, unsigned int count, float *output, const std::vector<int> &chain) const
+{
+    // Octaves finer than half a cell only add aliasing.
+    unsigned int octaves = node.octaves;
+    double finest = node.frequency * pow((double) node.lacunarity, (double) (octaves - 1));
+    while (octaves > 1 && finest > _worldScale * 0.5) {
+        finest /= node.lacunarity;
+        octaves--;
+    }
+
+    // Scale the sum back to about -1 to 1 whatever the number of octaves.
+    float totalAmplitude = 0;
+    float amplitude = 1;
+    unsigned int octave, k;
+    for (octave = 0; octave < octaves; octave++) {
+        totalAmplitude += amplitude;
+        amplitude *= node.gain;
+    }
+    float normalise = 1.0f / totalAmplitude;
+    FractalType type = node.type == SOURCE ? FBM : node.fractalType;
+
+    // All the octaves of a point are summed together, so there is one pass over the buffer however many there are.
+    for (k = 0; k < count; k++) {
+        double x = xs[k] * node.frequency + node.offsetX;
+        double z = zs[k] * node.frequency + node.offsetZ;
+        float sum = 0;
+        float weight = 1;
+        amplitude = 1;
+        for (octave = 0; octave < octaves; octave++) {
+            float n = SimplexNoise::noiseSingle(x, z);
+            if (type == FBM) {
+                sum += n * amplitude;
+            } else if (type == BILLOW) {
+                sum += (fabs(n) * 2.0f - 1.0f) * amplitude;
+            } else {
+                // Ridges where the noise crosses zero, and later octaves mostly add detail on the ridges.
+                float signal = 1.0f - fabs(n);
+                signal *= signal * weight;
+                weight = std::min(std::max(signal * 2.0f, 0.0f), 1.0f);
+                sum += signal * amplitude;
+            }
+            x *= node.lacunarity;
+            z *= node.lacunarity;
+            amplitude *= node.gain;
+        }
+        sum *= normalise;
+        if (type == RIDGED) {
+            sum = sum * 2.0f - 1.0f;
+        }
+        output[k] = this->applyChain(chain, sum);
+    }
+}
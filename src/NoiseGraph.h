@@ -0,0 +1,285 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef NOISEGRAPH_H
+#define NOISEGRAPH_H
+
+#include "INoiseAlgorithm.h"
+
+#include "gameplay.h"
+
+using namespace gameplay;
+
+/**
+ * A noise generator built from a graph of simple nodes - simplex sources, octave combiners (fBm, ridged
+ * and billow), domain warps, curves and blends. Every node works in coordinates where 1 unit covers
+ * the whole terrain, so a frequency of 4 gives about 4 features across the map. Node values are
+ * roughly -1 to 1 and the output node is mapped onto the height range.
+ *
+ * The graph is evaluated a tile at a time. Each node fills a whole buffer before the next one reads it,
+ * and chains of point operations (curves, scale and bias) are not given buffers of their own - they are
+ * applied by the node producing the value as it writes it, so they cost no extra pass over the tile.
+ *
+ * The graph must not be changed after init, then it is safe to evaluate from several threads.
+ **/
+class NoiseGraph : public INoiseAlgorithm
+{
+public:
+    /**
+     * How the octaves of a fractal node are combined.
+     **/
+    enum FractalType { FBM, RIDGED, BILLOW };
+
+    /**
+     * How the inputs of a blend node are combined. LERP blends from the first input to the second by the weight.
+     **/
+    enum BlendType { ADD, MULTIPLY, MIN, MAX, LERP };
+
+    /**
+     * Constructor - an empty graph.
+     **/
+    NoiseGraph();
+
+    /**
+     * Destructor
+     **/
+    virtual ~NoiseGraph();
+
+    /**
+     * Add a constant value.
+     *
+     * @param value The value.
+     * @return int The index of the new node.
+     **/
+    int addConstant(float value);
+
+    /**
+     * Add a single octave of simplex noise.
+     *
+     * @param frequency Features across the terrain.
+     * @param seed Sources with different seeds give different noise.
+     * @return int The index of the new node.
+     **/
+    int addSource(float frequency, int seed);
+
+    /**
+     * Add several octaves of simplex noise. Octaves smaller than a height field cell are skipped.
+     *
+     * @param type How the octaves are combined.
+     * @param frequency Features across the terrain for the first octave.
+     * @param octaves The number of octaves.
+     * @param lacunarity How much the frequency grows for each octave.
+     * @param gain How much the amplitude shrinks for each octave.
+     * @param seed Nodes with different seeds give different noise.
+     * @return int The index of the new node.
+     **/
+    int addFractal(FractalType type, float frequency, unsigned int octaves, float lacunarity, float gain, int seed);
+
+    /**
+     * Add a domain warp - the input is sampled at coordinates pushed around by two other nodes.
+     *
+     * @param input The node to sample.
+     * @param warpX The node giving the x offset.
+     * @param warpZ The node giving the z offset.
+     * @param strength Scales the offsets, in terrain widths.
+     * @return int The index of the new node.
+     **/
+    int addWarp(int input, int warpX, int warpZ, float strength);
+
+    /**
+     * Add a curve that remaps the value of a node through a list of points, with straight lines between them.
+     *
+     * @param input The node to remap.
+     * @param points The points of the curve (x is the input value and y the output), sorted by x.
+     * @return int The index of the new node.
+     **/
+    int addCurve(int input, const std::vector<Vector2> &points);
+
+    /**
+     * Add a node that multiplies the value of another node and adds an offset.
+     *
+     * @param input The node to change.
+     * @param scale Multiplies the value.
+     * @param bias Added after the scale.
+     * @return int The index of the new node.
+     **/
+    int addScaleBias(int input, float scale, float bias);
+
+    /**
+     * Add a node combining two other nodes.
+     *
+     * @param type How to combine them.
+     * @param first The first node.
+     * @param second The second node.
+     * @param weight For LERP, the node giving the blend weight (0 to 1). Ignored by the other types.
+     * @return int The index of the new node.
+     **/
+    int addBlend(BlendType type, int first, int second, int weight = -1);
+
+    /**
+     * Choose the node that gives the final height. Defaults to the last node added.
+     *
+     * @param node The node index.
+     * @return void
+     **/
+    void setOutput(int node);
+
+    /**
+     * Get the number of nodes in the graph.
+     *
+     * @return unsigned int
+     **/
+    unsigned int getNodeCount() const;
+
+    /**
+     * Initialiser - store the parameters for the noise generation.
+     *
+     * @param maxx Maximum X value this generator will be called with.
+     * @param maxz Maximum Z value this generator will be called with.
+     * @param rangemin The height generated for an output of -1.
+     * @param rangemax The height generated for an output of 1.
+     * @param seed A random seed, mixed into the seed of every node.
+     * @return void
+     **/
+    virtual void init(double maxx, double maxz, double rangemin, double rangemax, int seed);
+
+    /**
+     * Get the height for a single point. Use noiseTile where possible.
+     *
+     * @param x X coordinate
+     * @param z Z coordinate
+     * @return double
+     **/
+    virtual double noise(double x, double z);
+
+    /**
+     * Get the heights for a tile of points.
+     *
+     * @param x The x coordinate of the first column
+     * @param z The z coordinate of the first row
+     * @param width The number of columns
+     * @param height The number of rows
+     * @param output Filled with width * height heights
+     * @return void
+     **/
+    virtual void noiseTile(double x, double z, unsigned int width, unsigned int height, float *output);
+
+    /**
+     * Every node can be sampled anywhere, so the graph can too.
+     *
+     * @return bool
+     **/
+    virtual bool isTileable() const;
+
+private:
+    /**
+     * The kinds of node.
+     **/
+    enum NodeType { CONSTANT, SOURCE, FRACTAL, WARP, CURVE, SCALE_BIAS, BLEND };
+
+    /**
+     * One node of the graph. Which fields are used depends on the type.
+     **/
+    struct Node
+    {
+        NodeType type;
+        FractalType fractalType;
+        BlendType blendType;
+        int inputs[3];
+        float value;
+        float frequency;
+        unsigned int octaves;
+        float lacunarity;
+        float gain;
+        int seed;
+        double offsetX;
+        double offsetZ;
+        std::vector<Vector2> points;
+    };
+
+    /**
+     * Add a node with everything else cleared.
+     *
+     * @param type The type of node.
+     * @return int The index of the new node.
+     **/
+    int addNode(NodeType type);
+
+    /**
+     * Fill a buffer with the values of a node at a list of points.
+     *
+     * @param node The node to evaluate.
+     * @param xs The x coordinates of the points, in terrain widths.
+     * @param zs The z coordinates of the points.
+     * @param count The number of points.
+     * @param output Filled with count values.
+     * @param chain Point operations to apply to each value as it is written, outermost first.
+     * @return void
+     **/
+    void evaluate(int node, const double *xs, const double *zs, unsigned int count, float *output, const std::vector<int> &chain) const;
+
+    /**
+     * Evaluate a source or fractal node, applying the chain as the values are written.
+     *
+     * @param node The node.
+     * @param xs The x coordinates.
+     * @param zs The z coordinates.
+     * @param count The number of points.
+     * @param output Filled with count values.
+     * @param chain Point operations to apply, outermost first.
+     * @return void
+     **/
+    void evaluateFractal(const Node &node, const double *xs, const double *zs, unsigned int count, float *output, const std::vector<int> &chain) const;
+
+    /**
+     * Apply a chain of point operations to one value.
+     *
+     * @param chain The operations, outermost first.
+     * @param value The value.
+     * @return float
+     **/
+    float applyChain(const std::vector<int> &chain, float value) const;
+
+    /**
+     * The nodes, inputs always come before the nodes using them.
+     **/
+    std::vector<Node> _nodes;
+
+    /**
+     * The node giving the final height.
+     **/
+    int _output;
+
+    /**
+     * The minimum height
+     **/
+    double _min;
+
+    /**
+     * The maximum height
+     **/
+    double _max;
+
+    /**
+     * Grid units across the terrain.
+     **/
+    double _worldScale;
+};
+
+#endif // NOISEGRAPH_H
@@ -0,0 +1,251 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "NormalMap.h"
+#include "PngFile.h"
+#include <math.h>
+#include <stdio.h>
+
+NormalMap::NormalMap(unsigned int resolution) :
+_resolution(0),
+_changed(true),
+_jobSystem(NULL)
+{
+    this->setResolution(resolution);
+}
+
+NormalMap::~NormalMap()
+{
+    // The file is left behind for the terrain that is still using it.
+}
+
+unsigned int NormalMap::getResolution() const
+{
+    return _resolution;
+}
+
+void NormalMap::setResolution(unsigned int resolution)
+{
+    GP_ASSERT(resolution >= 2);
+    unsigned int i;
+
+    // Straight up until something is generated.
+    _resolution = resolution;
+    _pixels.resize(_resolution * _resolution * 3);
+    for (i = 0; i < _pixels.size(); i += 3) {
+        _pixels[i] = 128;
+        _pixels[i + 1] = 255;
+        _pixels[i + 2] = 128;
+    }
+    _changed = true;
+}
+
+void NormalMap::setJobSystem(JobSystem *jobSystem)
+{
+    _jobSystem = jobSystem;
+}
+
+void NormalMap::generate(const float* heights, unsigned int heightFieldSize, const Vector3& terrainScale)
+{
+    this->generateTexels(heights, heightFieldSize, terrainScale, DirtyRect(0, 0, _resolution - 1, _resolution - 1));
+}
+
+void NormalMap::generate(const float* heights, unsigned int heightFieldSize, const Vector3& terrainScale, const DirtyRect& cells)
+{
+    if (heightFieldSize < 2 || cells.isEmpty()) {
+        return;
+    }
+
+    // Each texel blends the cells around it, and the filter reaches one texel further out.
+    float gridScale = (float)(heightFieldSize - 1) / (float)(_resolution - 1);
+    DirtyRect texels((int)floorf((cells.minX - 1) / gridScale) - 1, (int)floorf((cells.minZ - 1) / gridScale) - 1,
+                     (int)ceilf((cells.maxX + 1) / gridScale) + 1, (int)ceilf((cells.maxZ + 1) / gridScale) + 1);
+    texels.clip(_resolution, _resolution);
+
+    this->generateTexels(heights, heightFieldSize, terrainScale, texels);
+}
+
+void NormalMap::generateTexels(const float* heights, unsigned int heightFieldSize, const Vector3& terrainScale, const DirtyRect& texels)
+{
+    ColumnSamples columns;
+    unsigned int column;
+
+    if (texels.isEmpty() || heightFieldSize < 2) {
+        return;
+    }
+
+    // Texels to height field cells, and the filter sums (weights of 4, across 2 texels) to slopes in world units.
+    float gridScale = (float)(heightFieldSize - 1) / (float)(_resolution - 1);
+    float slopeScaleX = terrainScale.y / (8.0f * gridScale * terrainScale.x);
+    float slopeScaleZ = terrainScale.y / (8.0f * gridScale * terrainScale.z);
+
+    // One entry for each texel column, plus the padding on each side.
+    float max = (float)(heightFieldSize - 1);
+    columns.first.resize(_resolution + 2);
+    columns.second.resize(_resolution + 2);
+    columns.fraction.resize(_resolution + 2);
+    for (column = 0; column < _resolution + 2; column++) {
+        float gridx = ((int)column - 1) * gridScale;
+        gridx = gridx < 0 ? 0 : (gridx > max ? max : gridx);
+
+        columns.first[column] = (unsigned int)gridx;
+        columns.second[column] = columns.first[column] + 1 < heightFieldSize ? columns.first[column] + 1 : columns.first[column];
+        columns.fraction[column] = gridx - columns.first[column];
+    }
+
+    int minX = texels.minX, maxX = texels.maxX;
+    unsigned int width = maxX - minX + 1;
+    unsigned int padded = width + 2;
+
+    JobSystem::RangeTask band = [&](unsigned int begin, unsigned int end) {
+        unsigned int rows = end - begin + 2;
+        std::vector<float> samples(rows * padded), sums(padded), differences(padded);
+        unsigned int i;
+        int z;
+
+        // The rows of the band and one more on each side.
+        for (z = (int)begin - 1; z <= (int)end; z++) {
+            if (z >= 0 && z < (int)_resolution) {
+                this->sampleRow(heights, heightFieldSize, z * gridScale, columns, minX, maxX, &samples[(z - begin + 1) * padded]);
+            }
+        }
+
+        // Past the top and bottom edges the heights carry on in a straight line.
+        if (begin == 0) {
+            for (i = 0; i < padded; i++) {
+                samples[i] = 2.0f * samples[padded + i] - samples[2 * padded + i];
+            }
+        }
+        if (end == _resolution) {
+            float *last = &samples[(rows - 1) * padded];
+            const float *previous = last - padded;
+            const float *before = previous - padded;
+            for (i = 0; i < padded; i++) {
+                last[i] = 2.0f * previous[i] - before[i];
+            }
+        }
+
+        for (z = begin; z < (int)end; z++) {
+            const float *above = &samples[(z - begin) * padded];
+            filterRow(above, above + padded, above + 2 * padded, width, slopeScaleX, slopeScaleZ,
+                      &sums[0], &differences[0], &_pixels[(minX + z * _resolution) * 3]);
+        }
+    };
+
+    if (_jobSystem) {
+        _jobSystem->parallelFor(texels.minZ, texels.maxZ + 1, 16, band);
+    } else {
+        band(texels.minZ, texels.maxZ + 1);
+    }
+    _changed = true;
+}
+
+void NormalMap::sampleRow(const float* heights, unsigned int heightFieldSize, float gridz, const ColumnSamples& columns,
+                          int minX, int maxX, float* output) const
+{
+    float max = (float)(heightFieldSize - 1);
+    gridz = gridz > max ? max : gridz;
+
+    unsigned int z0 = (unsigned int)gridz;
+    unsigned int z1 = z0 + 1 < heightFieldSize ? z0 + 1 : z0;
+    float fz = gridz - z0;
+    const float *row0 = heights + z0 * heightFieldSize;
+    const float *row1 = heights + z1 * heightFieldSize;
+    unsigned int i = 0;
+    int x;
+
+    for (x = minX - 1; x <= maxX + 1; x++, i++) {
+        if (x < 0 || x >= (int)_resolution) {
+            continue;
+        }
+        unsigned int first = columns.first[x + 1], second = columns.second[x + 1];
+        float fraction = columns.fraction[x + 1];
+        float top = row0[first] + (row0[second] - row0[first]) * fraction;
+        float bottom = row1[first] + (row1[second] - row1[first]) * fraction;
+        output[i] = top + (bottom - top) * fz;
+    }
+
+    // Past the left and right edges the heights carry on in a straight line.
+    if (minX == 0) {
+        output[0] = 2.0f * output[1] - output[2];
+    }
+    if (maxX == (int)_resolution - 1) {
+        output[i - 1] = 2.0f * output[i - 2] - output[i - 3];
+    }
+}
+
+void NormalMap::filterRow(const float* above, const float* middle, const float* below, unsigned int count,
+                          float slopeScaleX, float slopeScaleZ, float* sums, float* differences, unsigned char* output)
+{
+    unsigned int i;
+
+    // Down the columns - smoothed for the x slope, differenced for the z slope.
+    for (i = 0; i < count + 2; i++) {
+        sums[i] = above[i] + 2.0f * middle[i] + below[i];
+        differences[i] = below[i] - above[i];
+    }
+
+    // Then along the row. No branches, so this loop vectorizes.
+    for (i = 0; i < count; i++) {
+        float x = (sums[i] - sums[i + 2]) * slopeScaleX;
+        float z = -(differences[i] + 2.0f * differences[i + 1] + differences[i + 2]) * slopeScaleZ;
+        float scale = 127.5f / sqrtf(x * x + 1.0f + z * z);
+
+        output[i * 3] = (unsigned char)(x * scale + 128.0f);
+        output[i * 3 + 1] = (unsigned char)(scale + 128.0f);
+        output[i * 3 + 2] = (unsigned char)(z * scale + 128.0f);
+    }
+}
+
+bool NormalMap::save(const char* directory)
+{
+    char path[2048];
+
+    if (!_changed && !_path.empty()) {
+        return true;
+    }
+
+    // Delete the file from the last save.
+    if (!_path.empty()) {
+        remove(_path.c_str());
+    }
+    sprintf(path, "%s/normal.png", directory);
+    _path = path;
+
+    if (!this->exportTexture(_path)) {
+        _path.clear();
+        return false;
+    }
+    _changed = false;
+    return true;
+}
+
+bool NormalMap::exportTexture(const std::string& path) const
+{
+    return PngFile::save(path, _pixels, _resolution, _resolution, LCT_RGB, _jobSystem);
+}
+
+const char* NormalMap::getPath() const
+{
+    if (_path.empty()) {
+        return NULL;
+    }
+    return _path.c_str();
+}
@@ -0,0 +1,208 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef NORMALMAP_H
+#define NORMALMAP_H
+
+#include "gameplay.h"
+#include "DirtyRect.h"
+#include "JobSystem.h"
+#include <string>
+#include <vector>
+
+using namespace gameplay;
+
+/**
+ * An object space normal map for the terrain, so the lighting keeps the detail of the height field on
+ * the coarse meshes of the distant patches. Each normal is packed as RGB = xyz * 0.5 + 0.5, y up.
+ *
+ * The normals come from a 3x3 Sobel filter over the height field, resampled at the texel spacing so the
+ * map can be any resolution. Generation runs a row at a time in bands on the job system. The rows under
+ * a band are resampled into flat padded arrays first, then the filter is split into a vertical pass and a
+ * horizontal pass, each a straight loop the compiler can vectorize. Past the edges the heights are
+ * extended in a straight line, so the border normals are as steep as the terrain really is.
+ *
+ * After an edit only the texels near the changed cells are regenerated, and the file is only rewritten
+ * when something changed since the last save.
+ **/
+class NormalMap
+{
+public:
+    /**
+     * Constructor
+     *
+     * @param resolution The size of one side of the (square) normal map, at least 2.
+     **/
+    NormalMap(unsigned int resolution);
+
+    /**
+     * Destructor
+     **/
+    ~NormalMap();
+
+    /**
+     * Get the size of one side of the normal map.
+     *
+     * @return unsigned int
+     **/
+    unsigned int getResolution() const;
+
+    /**
+     * Change the size of the normal map. The normals are flat until the next generate.
+     *
+     * @param resolution The new size, at least 2.
+     * @return void
+     **/
+    void setResolution(unsigned int resolution);
+
+    /**
+     * Set the jobs used to generate and save the normal map. Without a job system everything runs on the calling thread.
+     *
+     * @param jobSystem The job system, which must outlive the normal map.
+     * @return void
+     **/
+    void setJobSystem(JobSystem *jobSystem);
+
+    /**
+     * Regenerate every normal.
+     *
+     * @param heights The height array, heightFieldSize * heightFieldSize values.
+     * @param heightFieldSize The size of one side of the height array.
+     * @param terrainScale The scale of the terrain, the normals are for the terrain in world units.
+     * @return void
+     **/
+    void generate(const float *heights, unsigned int heightFieldSize, const Vector3 &terrainScale);
+
+    /**
+     * Regenerate the normals of the texels covering some cells of the height field, after they have been edited.
+     *
+     * @param heights The height array, heightFieldSize * heightFieldSize values.
+     * @param heightFieldSize The size of one side of the height array.
+     * @param terrainScale The scale of the terrain.
+     * @param cells The cells of the height field that changed.
+     * @return void
+     **/
+    void generate(const float *heights, unsigned int heightFieldSize, const Vector3 &terrainScale, const DirtyRect &cells);
+
+    /**
+     * Write the normal map to normal.png in a directory, if it has changed since the last save. The file
+     * from the last save is deleted when a new one is written.
+     *
+     * @param directory An existing directory.
+     * @return bool
+     **/
+    bool save(const char *directory);
+
+    /**
+     * Write a copy of the normal map to a png file, leaving the path from the last save alone.
+     *
+     * @param path The path of the file.
+     * @return bool
+     **/
+    bool exportTexture(const std::string &path) const;
+
+    /**
+     * Get the path of the file from the last save.
+     *
+     * @return const char* NULL if the normal map has not been saved.
+     **/
+    const char* getPath() const;
+
+private:
+    /**
+     * Where one texel column samples the height field - the two cells to blend and how far between them.
+     **/
+    struct ColumnSamples
+    {
+        std::vector<unsigned int> first;
+        std::vector<unsigned int> second;
+        std::vector<float> fraction;
+    };
+
+    /**
+     * Regenerate a rectangle of texels.
+     *
+     * @param heights The height array.
+     * @param heightFieldSize The size of one side of the height array.
+     * @param terrainScale The scale of the terrain.
+     * @param texels The texels to generate.
+     * @return void
+     **/
+    void generateTexels(const float *heights, unsigned int heightFieldSize, const Vector3 &terrainScale, const DirtyRect &texels);
+
+    /**
+     * Resample the height field along one row of texels, with one texel of padding on each side.
+     *
+     * @param heights The height array.
+     * @param heightFieldSize The size of one side of the height array.
+     * @param gridz The row of the height field to sample, in cells.
+     * @param columns Where each texel column samples, for texel columns -1 to the resolution.
+     * @param minX The first texel column, the padding sample is one before it.
+     * @param maxX The last texel column.
+     * @param output Filled with maxX - minX + 3 heights.
+     * @return void
+     **/
+    void sampleRow(const float *heights, unsigned int heightFieldSize, float gridz, const ColumnSamples &columns,
+                   int minX, int maxX, float *output) const;
+
+    /**
+     * Run the Sobel filter along a row of texels and pack the normals.
+     *
+     * @param above The padded heights of the row above.
+     * @param middle The padded heights of the row.
+     * @param below The padded heights of the row below.
+     * @param count The number of texels, the rows hold count + 2 heights.
+     * @param slopeScaleX Turns the horizontal filter sum into a slope in world units.
+     * @param slopeScaleZ Turns the vertical filter sum into a slope in world units.
+     * @param sums Scratch space for count + 2 values.
+     * @param differences Scratch space for count + 2 values.
+     * @param output The RGB texels to write.
+     * @return void
+     **/
+    static void filterRow(const float *above, const float *middle, const float *below, unsigned int count,
+                          float slopeScaleX, float slopeScaleZ, float *sums, float *differences, unsigned char *output);
+
+    /**
+     * The size of one side of the normal map.
+     **/
+    unsigned int _resolution;
+
+    /**
+     * The packed normals, RGB.
+     **/
+    std::vector<unsigned char> _pixels;
+
+    /**
+     * The file path from the last save.
+     **/
+    std::string _path;
+
+    /**
+     * Whether the normals changed since the last save.
+     **/
+    bool _changed;
+
+    /**
+     * The job system to work on, or NULL.
+     **/
+    JobSystem *_jobSystem;
+};
+
+#endif // NORMALMAP_H
@@ -0,0 +1,73 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "ObjWriter.h"
+
+/**
+ * The size of the write buffer.
+ **/
+static const unsigned int BUFFER_SIZE = 1 << 20;
+
+ObjWriter::ObjWriter() :
+_file(NULL)
+{
+}
+
+ObjWriter::~ObjWriter()
+{
+    if (_file) {
+        fclose(_file);
+    }
+}
+
+bool ObjWriter::open(const std::string &path, unsigned int vertexCount, unsigned int triangleCount)
+{
+    _file = fopen(path.c_str(), "wb");
+    if (!_file) {
+        return false;
+    }
+    _buffer.resize(BUFFER_SIZE);
+    setvbuf(_file, &_buffer[0], _IOFBF, _buffer.size());
+
+    fprintf(_file, "# TerrainTool export, %u vertices and %u triangles\n", vertexCount, triangleCount);
+    return true;
+}
+
+void ObjWriter::writeVertex(float x, float y, float z)
+{
+    fprintf(_file, "v %.3f %.3f %.3f\n", x, y, z);
+}
+
+void ObjWriter::writeTriangle(unsigned int a, unsigned int b, unsigned int c)
+{
+    // OBJ counts vertices from 1.
+    fprintf(_file, "f %u %u %u\n", a + 1, b + 1, c + 1);
+}
+
+bool ObjWriter::close()
+{
+    if (!_file) {
+        return false;
+    }
+    bool written = !ferror(_file);
+    written = fclose(_file) == 0 && written;
+    _file = NULL;
+    return written;
+}
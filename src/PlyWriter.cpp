@@ -0,0 +1,121 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "PlyWriter.h"
+#include "gameplay.h"
+#include <string.h>
+
+/**
+ * The size of the write buffer.
+ **/
+static const unsigned int BUFFER_SIZE = 1 << 20;
+
+PlyWriter::PlyWriter() :
+_file(NULL),
+_vertexCount(0),
+_triangleCount(0),
+_verticesWritten(0),
+_trianglesWritten(0)
+{
+}
+
+PlyWriter::~PlyWriter()
+{
+    if (_file) {
+        fclose(_file);
+    }
+}
+
+bool PlyWriter::open(const std::string &path, unsigned int vertexCount, unsigned int triangleCount)
+{
+    _file = fopen(path.c_str(), "wb");
+    if (!_file) {
+        return false;
+    }
+    _buffer.resize(BUFFER_SIZE);
+    setvbuf(_file, &_buffer[0], _IOFBF, _buffer.size());
+
+    _vertexCount = vertexCount;
+    _triangleCount = triangleCount;
+    _verticesWritten = 0;
+    _trianglesWritten = 0;
+    fprintf(_file, "ply\n"
+                   "format binary_little_endian 1.0\n"
+                   "comment TerrainTool export\n"
+                   "element vertex %u\n"
+                   "property float x\n"
+                   "property float y\n"
+                   "property float z\n"
+                   "element face %u\n"
+                   "property list uchar int vertex_indices\n"
+                   "end_header\n", vertexCount, triangleCount);
+    return true;
+}
+
+void PlyWriter::storeLittleEndian(unsigned int value, unsigned char *output)
+{
+    output[0] = value & 0xff;
+    output[1] = (value >> 8) & 0xff;
+    output[2] = (value >> 16) & 0xff;
+    output[3] = (value >> 24) & 0xff;
+}
+
+void PlyWriter::writeVertex(float x, float y, float z)
+{
+    unsigned char vertex[12];
+    float position[3] = { x, y, z };
+    unsigned int i, bits;
+
+    for (i = 0; i < 3; i++) {
+        memcpy(&bits, &position[i], sizeof(bits));
+        storeLittleEndian(bits, vertex + i * 4);
+    }
+    fwrite(vertex, sizeof(vertex), 1, _file);
+    _verticesWritten++;
+}
+
+void PlyWriter::writeTriangle(unsigned int a, unsigned int b, unsigned int c)
+{
+    unsigned char triangle[13];
+
+    triangle[0] = 3;
+    storeLittleEndian(a, triangle + 1);
+    storeLittleEndian(b, triangle + 5);
+    storeLittleEndian(c, triangle + 9);
+    fwrite(triangle, sizeof(triangle), 1, _file);
+    _trianglesWritten++;
+}
+
+bool PlyWriter::close()
+{
+    if (!_file) {
+        return false;
+    }
+    bool written = !ferror(_file);
+    written = fclose(_file) == 0 && written;
+    _file = NULL;
+
+    if (_verticesWritten != _vertexCount || _trianglesWritten != _triangleCount) {
+        GP_WARN("PLY export wrote %u vertices and %u triangles, but the header says %u and %u.",
+                _verticesWritten, _trianglesWritten, _vertexCount, _triangleCount);
+        return false;
+    }
+    return written;
+}
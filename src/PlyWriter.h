@@ -0,0 +1,113 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef PLYWRITER_H
+#define PLYWRITER_H
+
+#include "IMeshWriter.h"
+#include <stdio.h>
+#include <vector>
+
+/**
+ * Writes a mesh as a binary little endian PLY file, through a large buffer. PLY needs the number of
+ * vertices and triangles in the header, so exactly as many as were given to open must be written.
+ **/
+class PlyWriter : public IMeshWriter
+{
+    public:
+        /**
+         * Constructor
+         **/
+        PlyWriter();
+
+        /**
+         * Destructor - closes the file if it is still open.
+         **/
+        virtual ~PlyWriter();
+
+        /**
+         * Create the file and write the header.
+         *
+         * @param path The path of the file.
+         * @param vertexCount The number of vertices that will be written.
+         * @param triangleCount The number of triangles that will be written.
+         * @return bool false if the file could not be created.
+         **/
+        virtual bool open(const std::string &path, unsigned int vertexCount, unsigned int triangleCount);
+
+        /**
+         * Write the next vertex.
+         *
+         * @param x The x coordinate
+         * @param y The y coordinate
+         * @param z The z coordinate
+         * @return void
+         **/
+        virtual void writeVertex(float x, float y, float z);
+
+        /**
+         * Write the next triangle.
+         *
+         * @param a The index of the first corner, counting vertices from 0.
+         * @param b The index of the second corner.
+         * @param c The index of the third corner.
+         * @return void
+         **/
+        virtual void writeTriangle(unsigned int a, unsigned int b, unsigned int c);
+
+        /**
+         * Finish and close the file.
+         *
+         * @return bool false if anything could not be written, or the counts did not match the header.
+         **/
+        virtual bool close();
+
+    private:
+        /**
+         * Store a 32 bit value little endian, whatever the byte order of the machine.
+         *
+         * @param value The value.
+         * @param output Filled with 4 bytes.
+         * @return void
+         **/
+        static void storeLittleEndian(unsigned int value, unsigned char *output);
+
+        /**
+         * The open file, or NULL.
+         **/
+        FILE *_file;
+
+        /**
+         * Buffers the writes to the file.
+         **/
+        std::vector<char> _buffer;
+
+        /**
+         * The counts promised in the header.
+         **/
+        unsigned int _vertexCount, _triangleCount;
+
+        /**
+         * The counts written so far.
+         **/
+        unsigned int _verticesWritten, _trianglesWritten;
+};
+
+#endif // PLYWRITER_H
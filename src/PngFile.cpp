@@ -0,0 +1,65 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "PngFile.h"
+#include "gameplay.h"
+
+/**
+ * Used by the png encoder to deflate the stripes of an image on the job system.
+ **/
+static void deflateStripesInParallel(void (*task)(void*, unsigned), void* data, unsigned count, const void* context)
+{
+    JobSystem *jobSystem = (JobSystem *)context;
+
+    jobSystem->parallelFor(0, count, 1, [task, data](unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; i++) {
+            task(data, i);
+        }
+    });
+}
+
+bool PngFile::save(const std::string &path, const std::vector<unsigned char> &pixels, unsigned int width, unsigned int height,
+                   LodePNGColorType colorType, JobSystem *jobSystem)
+{
+    lodepng::State state;
+    std::vector<unsigned char> png;
+
+    // Our maps are smooth and get rewritten often, so favour speed over file size.
+    lodepng_encoder_settings_preset(&state.encoder, LEP_FAST);
+    state.info_raw.colortype = colorType;
+    state.info_raw.bitdepth = 8;
+    state.info_png.color.colortype = colorType;
+    state.info_png.color.bitdepth = 8;
+    if (jobSystem) {
+        state.encoder.stripes = jobSystem->getThreadCount();
+        state.encoder.custom_parallel = deflateStripesInParallel;
+        state.encoder.parallel_context = jobSystem;
+    }
+
+    unsigned error = lodepng::encode(png, pixels, width, height, state);
+    if (!error) {
+        error = lodepng_save_file(&png[0], png.size(), path.c_str());
+    }
+    if (error) {
+        GP_WARN("Could not write %s: %s", path.c_str(), lodepng_error_text(error));
+        return false;
+    }
+    return true;
+}
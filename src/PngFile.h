@@ -0,0 +1,51 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef PNGFILE_H
+#define PNGFILE_H
+
+#include "JobSystem.h"
+#include "LodePNG.h"
+#include <string>
+#include <vector>
+
+/**
+ * Writes 8 bit images to png files. With a job system the image is cut into stripes that are
+ * deflated at the same time, which is where nearly all the time goes for the large maps we write.
+ **/
+class PngFile
+{
+public:
+    /**
+     * Encode an image and write it to a file.
+     *
+     * @param path The file to write.
+     * @param pixels The pixels, a row at a time with no padding.
+     * @param width The width in pixels.
+     * @param height The height in pixels.
+     * @param colorType The channels in the pixels - LCT_GREY, LCT_RGB or LCT_RGBA.
+     * @param jobSystem The jobs to deflate on, or NULL.
+     * @return bool
+     **/
+    static bool save(const std::string &path, const std::vector<unsigned char> &pixels, unsigned int width, unsigned int height,
+                     LodePNGColorType colorType, JobSystem *jobSystem);
+};
+
+#endif // PNGFILE_H
@@ -19,6 +19,7 @@
 
 #include "SelectionRing.h"
 #include <math.h>
+#include <vector>
 
 SelectionRing::SelectionRing(Scene* scene)
 :_ringCount(16)
@@ -76,27 +77,32 @@ SelectionRing::~SelectionRing()
     SAFE_RELEASE(_scene);
 }
 
-void SelectionRing::setPosition(float x, float z, Terrain *terrain)
+void SelectionRing::setPosition(float x, float z, const HeightSampler &sampler)
 {
     _x = x;
     _z = z;
     
-    this->setRingNodeHeights(terrain);
+    this->setRingNodeHeights(sampler);
 }
 
-void SelectionRing::setRingNodeHeights(Terrain *terrain)
+void SelectionRing::setRingNodeHeights(const HeightSampler &sampler)
 {
-    Node *ring = _node->getFirstChild();
+    std::vector<float> xs(_ringCount), zs(_ringCount), heights(_ringCount);
     int i = 0;
 
+    // Look up the heights of the terrain under the whole ring at once.
+    for (i = 0; i < _ringCount; i++) {
+        xs[i] = sin((float)i/_ringCount * MATH_PIX2) * _scale + _x;
+        zs[i] = cos((float)i/_ringCount * MATH_PIX2) * _scale + _z;
+    }
+    sampler.getHeights(&xs[0], &zs[0], _ringCount, &heights[0]);
+
     // Adjust the height of each node in the ring so it sits just above the terrain.
-    while(ring) {
-        float offsetx = sin((float)i/_ringCount * MATH_PIX2) * _scale;
-        float offsetz = cos((float)i/_ringCount * MATH_PIX2) * _scale;
-        // adjust the height seperately for each node in the ring.
-        float height = terrain->getHeight(offsetx + _x, offsetz + _z) + 100;
+    Node *ring = _node->getFirstChild();
+    i = 0;
+    while(ring && i < _ringCount) {
         ring->setScale(_scale / 8.0f);
-        ring->setTranslation(offsetx + _x, height, offsetz + _z);
+        ring->setTranslation(xs[i], heights[i] + 100, zs[i]);
         ring = ring->getNextSibling();
         i++;
     }
@@ -104,11 +110,11 @@ void SelectionRing::setRingNodeHeights(Terrain *terrain)
 }
 
 
-void SelectionRing::setScale(float scale, Terrain *terrain)
+void SelectionRing::setScale(float scale, const HeightSampler &sampler)
 {
     _scale = scale;
     
-    this->setRingNodeHeights(terrain);
+    this->setRingNodeHeights(sampler);
 }
 
 
@@ -21,6 +21,7 @@
 #define SELECTIONRING_H
 
 #include "gameplay.h"
+#include "HeightSampler.h"
 
 using namespace gameplay;
 
@@ -64,9 +65,10 @@ private:
     /**
      * Position the nodes in the ring so each sits just above the terrain.
      *
+     * @param sampler Used to get the heights of the terrain around the circle.
      * @return void
      **/
-    void setRingNodeHeights(Terrain *terrain);
+    void setRingNodeHeights(const HeightSampler &sampler);
 public:
     /**
      * Getter for the x position
@@ -100,20 +102,20 @@ public:
      * Set the scale of the selection
      *
      * @param scale The new scale value
-     * @param terrain Used to get the heights of the renderable objects around the circle.
+     * @param sampler Used to get the heights of the renderable objects around the circle.
      * @return void
      **/
-    void setScale(float scale, Terrain *terrain);
+    void setScale(float scale, const HeightSampler &sampler);
     
     /**
      * Set the x and z coordinates of the center of the selection.
      *
      * @param x x coordinate
      * @param z z coordinate
-     * @param terrain Used to get the heights of the renderable objects around the circle.
+     * @param sampler Used to get the heights of the renderable objects around the circle.
      * @return void
      **/
-    void setPosition(float x, float z, Terrain *terrain);
+    void setPosition(float x, float z, const HeightSampler &sampler);
     
     /**
      * Destructor
@@ -46,6 +46,47 @@ const Vector3  SimplexNoise::v3[12] = {
 };
 unsigned char SimplexNoise::perm[512] = {0};
 unsigned char SimplexNoise::permMod12[512] = {0};
+float SimplexNoise::permGradX[512] = {0};
+float SimplexNoise::permGradZ[512] = {0};
+const bool SimplexNoise::tablesReady = SimplexNoise::initTables();
+
+/**
+ * The number of points noiseSkewedBlock works on at once.
+ **/
+static const unsigned int ROW_BLOCK = 64;
+
+// Float copies of F2 and G2.
+static const float F2F = 0.366025403784f;
+static const float G2F = 0.211324865405f;
+
+/**
+ * Floor without the library call - casting rounds towards zero, so step down for negative values.
+ **/
+static inline int fastFloor(float value)
+{
+    int i = static_cast<int>(value);
+    return i - (value < i);
+}
+
+/**
+ * Twice max(value, 0), without a branch. Compilers turn the obvious version into a jump, which is
+ * mispredicted half the time because the simplex corners are in range about half the time.
+ **/
+static inline float twicePositive(float value)
+{
+    return value + fabsf(value);
+}
+
+// The corner weights are raised to the fourth power, so twicePositive makes them 16 times too big.
+static const float CORNER_SCALE = 70.0f / 16.0f;
+
+/**
+ * Wrap a skewed coordinate into the 256 cell period of the permutation table.
+ **/
+static inline double wrapPeriod(double value)
+{
+    return value - floor(value * (1.0 / 256.0)) * 256.0;
+}
 
 double SimplexNoise::dot(const Vector3 & g, double x, double z)
 {
@@ -61,19 +102,119 @@ void SimplexNoise::init(double maxx, double maxz, double rangemin, double rangem
     if (maxz > maxx) {
         _worldScale = maxz;
     }
+    // The octaves noiseDouble sums, from one feature across the world down to one per cell.
+    _octaves = 0;
+    for (double amplitude = 1.0 / _worldScale; amplitude < _worldScale; amplitude *= 4) {
+        _octaves++;
+    }
+}
+
+bool SimplexNoise::initTables()
+{
     for ( unsigned int i = 0; i < 512; ++i ) {
         perm[i] = p[i & 255];
         permMod12[i] = static_cast<unsigned char>(perm[i] % 12);
+        permGradX[i] = v3[permMod12[i]].x;
+        permGradZ[i] = v3[permMod12[i]].z;
     }
-    
+    return true;
+}
+
+SimplexNoise::SimplexNoise() : _min(0), _max(0), _octaves(0), _doublePrecision(false)
+{
+
 }
 
-SimplexNoise::SimplexNoise() : _min(0), _max(0)
+void SimplexNoise::setDoublePrecision(bool enabled)
 {
+    _doublePrecision = enabled;
+}
 
+bool SimplexNoise::isTileable() const
+{
+    return true;
 }
 
 double SimplexNoise::noise(double x, double z)
+{
+    if (_doublePrecision) {
+        return this->noiseDouble(x, z);
+    }
+    float sum;
+    this->noiseRow(x, z, 1, &sum);
+    return (sum + 1.0) * (_max - _min) + _min;
+}
+
+void SimplexNoise::noiseTile(double x, double z, unsigned int width, unsigned int height, float *output)
+{
+    if (_doublePrecision) {
+        INoiseAlgorithm::noiseTile(x, z, width, height, output);
+        return;
+    }
+    
+    float scale = _max - _min;
+    float offset = _min + scale;
+    unsigned int i, j;
+    for (j = 0; j < height; j++) {
+        float *heights = output + (j * width);
+        this->noiseRow(x, z + j, width, heights);
+        for (i = 0; i < width; i++) {
+            heights[i] = heights[i] * scale + offset;
+        }
+    }
+}
+
+void SimplexNoise::noiseRow(double x, double z, unsigned int width, float *sums) const
+{
+    // Same octaves as noiseDouble - each is 4 times the frequency and a quarter the weight of the last.
+    const double gain = 4;
+    double amplitude = 1.0 / _worldScale;
+    float weight = 1.0f;
+    unsigned int octave, i;
+
+    x += _seed;
+    z += _seed;
+    
+    // Skewing is linear, so skew the start of the row once and scale the skewed coordinates for each
+    // octave. They are kept wrapped to the period of the noise in double precision and only the small
+    // wrapped values go to float, so the fine octaves keep the precision of the original.
+    double s = (x + z) * F2 * amplitude;
+    double u = wrapPeriod(x * amplitude + s);
+    double v = wrapPeriod(z * amplitude + s);
+    
+    // One column along the row moves the skewed coordinates the same distance everywhere, so the
+    // points of the row are a multiply and add from its start, with none of the double work per point.
+    double stepU = amplitude * (1.0 + F2);
+    double stepV = amplitude * F2;
+    
+    for (i = 0; i < width; i++) {
+        sums[i] = 0.0f;
+    }
+    for (octave = 0; octave < _octaves; octave++) {
+        float startU = static_cast<float>(u);
+        float startV = static_cast<float>(v);
+        // The noise repeats every 256, so whole periods can be dropped from the steps too.
+        float columnU = static_cast<float>(stepU - floor(stepU * (1.0 / 256.0)) * 256.0);
+        float columnV = static_cast<float>(stepV - floor(stepV * (1.0 / 256.0)) * 256.0);
+        for (i = 0; i + ROW_BLOCK <= width; i += ROW_BLOCK) {
+            noiseSkewedBlock(startU + i * columnU, startV + i * columnV, columnU, columnV, weight, sums + i);
+        }
+        // The points past the last whole block, and single points from noise().
+        for (; i < width; i++) {
+            sums[i] += noiseSkewed(startU + i * columnU, startV + i * columnV) * weight;
+        }
+        // Still positive after scaling, so the cast floors.
+        u *= gain;
+        v *= gain;
+        u -= static_cast<int>(u * (1.0 / 256.0)) * 256.0;
+        v -= static_cast<int>(v * (1.0 / 256.0)) * 256.0;
+        stepU *= gain;
+        stepV *= gain;
+        weight *= 0.25f;
+    }
+}
+
+double SimplexNoise::noiseDouble(double x, double z)
 {
     const double lacunarity = 0.1;
     const double gain = 4;
@@ -147,6 +288,123 @@ double SimplexNoise::noiseSingle(double xin, double zin)
     return 70.0 * (n0 + n1 + n2);
 }
 
+float SimplexNoise::noiseSingleFloat(float x, float z)
+{
+    float s = (x + z) * F2F;
+    return noiseSkewed(x + s, z + s);
+}
+
+float SimplexNoise::noiseSkewed(float u, float v)
+{
+    int i = fastFloor(u);
+    int j = fastFloor(v);
+    // The offsets from the cell corner, unskewed. The same as noiseSingle, but working from the
+    // fractions keeps the numbers small.
+    float fu = u - i;
+    float fv = v - j;
+    float t = (fu + fv) * G2F;
+    float x0 = fu - t;
+    float z0 = fv - t;
+    // No branches from here on, random sample positions make them hard to predict.
+    int i1 = x0 > z0;
+    float middle = static_cast<float>(i1);
+    float x1 = x0 - middle + G2F;
+    float z1 = z0 + middle + (G2F - 1.0f);
+    float x2 = x0 - 1.0f + 2.0f * G2F;
+    float z2 = z0 - 1.0f + 2.0f * G2F;
+    int ii = i & 255;
+    int jj = j & 255;
+    // The middle corner shares its row of the permutation table with one of the others.
+    int p0 = perm[jj];
+    int p1 = perm[jj + 1];
+    int g0 = ii + p0;
+    int g1 = ii + p1 + i1 * (1 + p0 - p1);
+    int g2 = ii + 1 + p1;
+    float t0 = twicePositive(0.5f - x0 * x0 - z0 * z0);
+    float t1 = twicePositive(0.5f - x1 * x1 - z1 * z1);
+    float t2 = twicePositive(0.5f - x2 * x2 - z2 * z2);
+    t0 *= t0;
+    t1 *= t1;
+    t2 *= t2;
+    float n = t0 * t0 * (permGradX[g0] * x0 + permGradZ[g0] * z0);
+    n += t1 * t1 * (permGradX[g1] * x1 + permGradZ[g1] * z1);
+    n += t2 * t2 * (permGradX[g2] * x2 + permGradZ[g2] * z2);
+    return CORNER_SCALE * n;
+}
+
+void SimplexNoise::noiseSkewedBlock(float u, float v, float stepU, float stepV, float weight, float *sums)
+{
+    // The same sums as noiseSkewed, split into passes so only the table lookups are done a point at a
+    // time. The other two passes have no lookups, and the compiler can work on several points at once.
+    float x0[ROW_BLOCK], z0[ROW_BLOCK];
+    int corner[ROW_BLOCK], middle[ROW_BLOCK];
+    float gradients[6][ROW_BLOCK];
+    unsigned int n;
+    
+    for (n = 0; n < ROW_BLOCK; n++) {
+        float pointU = u + n * stepU;
+        float pointV = v + n * stepV;
+        int i = fastFloor(pointU);
+        int j = fastFloor(pointV);
+        float fu = pointU - i;
+        float fv = pointV - j;
+        float t = (fu + fv) * G2F;
+        x0[n] = fu - t;
+        z0[n] = fv - t;
+        corner[n] = (i & 255) | ((j & 255) << 8);
+        middle[n] = x0[n] > z0[n];
+    }
+    
+    // The coarse octaves have many points in each cell, only look the corners up again when the cell changes.
+    int last = -1;
+    float cornerX[4] = {0}, cornerZ[4] = {0};
+    for (n = 0; n < ROW_BLOCK; n++) {
+        if (corner[n] != last) {
+            last = corner[n];
+            int ii = last & 255;
+            int jj = last >> 8;
+            int g0 = ii + perm[jj];
+            int g1 = ii + perm[jj + 1];
+            int g2 = ii + 1 + perm[jj];
+            int g3 = ii + 1 + perm[jj + 1];
+            cornerX[0] = permGradX[g0];
+            cornerZ[0] = permGradZ[g0];
+            cornerX[1] = permGradX[g1];
+            cornerZ[1] = permGradZ[g1];
+            cornerX[2] = permGradX[g2];
+            cornerZ[2] = permGradZ[g2];
+            cornerX[3] = permGradX[g3];
+            cornerZ[3] = permGradZ[g3];
+        }
+        // The middle corner is (0, 1) or (1, 0).
+        int i1 = middle[n];
+        gradients[0][n] = cornerX[0];
+        gradients[1][n] = cornerZ[0];
+        gradients[2][n] = cornerX[1 + i1];
+        gradients[3][n] = cornerZ[1 + i1];
+        gradients[4][n] = cornerX[3];
+        gradients[5][n] = cornerZ[3];
+    }
+    
+    for (n = 0; n < ROW_BLOCK; n++) {
+        float i1 = static_cast<float>(middle[n]);
+        float x1 = x0[n] - i1 + G2F;
+        float z1 = z0[n] + i1 + (G2F - 1.0f);
+        float x2 = x0[n] - 1.0f + 2.0f * G2F;
+        float z2 = z0[n] - 1.0f + 2.0f * G2F;
+        float t0 = twicePositive(0.5f - x0[n] * x0[n] - z0[n] * z0[n]);
+        float t1 = twicePositive(0.5f - x1 * x1 - z1 * z1);
+        float t2 = twicePositive(0.5f - x2 * x2 - z2 * z2);
+        t0 *= t0;
+        t1 *= t1;
+        t2 *= t2;
+        float sum = t0 * t0 * (gradients[0][n] * x0[n] + gradients[1][n] * z0[n]);
+        sum += t1 * t1 * (gradients[2][n] * x1 + gradients[3][n] * z1);
+        sum += t2 * t2 * (gradients[4][n] * x2 + gradients[5][n] * z2);
+        sums[n] += CORNER_SCALE * sum * weight;
+    }
+}
+
 SimplexNoise::~SimplexNoise()
 {
     // Nothing to clean up because our heights are computed on demand.
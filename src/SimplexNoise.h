@@ -29,6 +29,11 @@ using namespace gameplay;
 /**
  * Noise generation algotirm based on simplex noise.
  * This C++ version is based on the java version at: http://webstaff.itn.liu.se/~stegu/simplexnoise/SimplexNoise.java by Stefan Gustavson.
+ *
+ * There are two versions of the noise. The double precision one is the original and is kept as a reference.
+ * The float one is used by default - it floors with integer casts, reads the gradients for each permutation
+ * entry straight from a table, and keeps the coordinates small by wrapping them to the 256 cell period
+ * of the permutation, so float precision is plenty.
  **/
 class SimplexNoise : public INoiseAlgorithm
 {
@@ -58,12 +63,39 @@ class SimplexNoise : public INoiseAlgorithm
          **/
         virtual double noise(double x, double z);
         
+        /**
+         * Choose the double precision reference version of the noise instead of the faster float version.
+         *
+         * @param enabled True for double precision.
+         * @return void
+         **/
+        void setDoublePrecision(bool enabled);
+        
+        /**
+         * Get the heights for a tile of coordinates.
+         *
+         * @param x The x coordinate of the first column
+         * @param z The z coordinate of the first row
+         * @param width The number of columns
+         * @param height The number of rows
+         * @param output Filled with width * height heights
+         * @return void
+         **/
+        virtual void noiseTile(double x, double z, unsigned int width, unsigned int height, float *output);
+        
+        /**
+         * Simplex noise can be sampled anywhere.
+         *
+         * @return bool
+         **/
+        virtual bool isTileable() const;
+        
         /**
          * Destructor...
          *
          **/
         virtual ~SimplexNoise();
-    private:
+        
         /**
          * Get a raw noise value, for a single scale of simplex noise. Simplex noise is designed to generate smooth random values
          * over a given scale. The way to get a fractal looking terrain out of this, is to call this noise function several
@@ -72,9 +104,32 @@ class SimplexNoise : public INoiseAlgorithm
          *
          * @param x X coordinate
          * @param z Z coordinate
-         * @return double
+         * @return double From -1 to 1.
+         **/
+        static double noiseSingle(double x, double z);
+        
+        /**
+         * Float version of noiseSingle. The coordinates should be small (up to a few thousand) for float
+         * precision to be enough - the noise repeats, so larger coordinates can be wrapped by the caller.
+         *
+         * @param x X coordinate
+         * @param z Z coordinate
+         * @return float From -1 to 1.
+         **/
+        static float noiseSingleFloat(float x, float z);
+    private:
+        /**
+         * Set up the permutation tables shared by all the simplex noise generators.
+         *
+         * @return bool Always true.
+         **/
+        static bool initTables();
+        
+        /**
+         * Set from initTables when the program starts, so the tables are filled once before any noise is
+         * generated and are never written while other threads read them.
          **/
-        double noiseSingle(double x, double z);
+        static const bool tablesReady;
         
         /**
          * Dot product of just the x and z vectors
@@ -84,7 +139,49 @@ class SimplexNoise : public INoiseAlgorithm
          * @param z z scale
          * @return double
          **/
-        double dot( const Vector3 & v, double x, double z );
+        static double dot( const Vector3 & v, double x, double z );
+        
+        /**
+         * The float noise, for coordinates that have already been skewed onto the simplex grid.
+         *
+         * @param u Skewed X coordinate
+         * @param v Skewed Z coordinate
+         * @return float From -1 to 1.
+         **/
+        static float noiseSkewed(float u, float v);
+        
+        /**
+         * Add the float noise for ROW_BLOCK evenly spaced skewed points to a list of sums.
+         *
+         * @param u Skewed X coordinate of the first point
+         * @param v Skewed Z coordinate of the first point
+         * @param stepU The step in u from one point to the next
+         * @param stepV The step in v from one point to the next
+         * @param weight Multiplies the noise before it is added
+         * @param sums The ROW_BLOCK sums to add to
+         * @return void
+         **/
+        static void noiseSkewedBlock(float u, float v, float stepU, float stepV, float weight, float *sums);
+        
+        /**
+         * The double precision reference version of noise.
+         *
+         * @param x X coordinate
+         * @param z Z coordinate
+         * @return double
+         **/
+        double noiseDouble(double x, double z);
+        
+        /**
+         * Sum the octaves of the float noise along a row of points, one octave at a time.
+         *
+         * @param x X coordinate of the first point
+         * @param z Z coordinate of the row
+         * @param width The number of points, one apart along x
+         * @param sums Filled with width sums, each from about -1 to 1.
+         * @return void
+         **/
+        void noiseRow(double x, double z, unsigned int width, float *sums) const;
         
         /**
          * Constant used in noise generation.
@@ -116,6 +213,16 @@ class SimplexNoise : public INoiseAlgorithm
          **/
         static unsigned char permMod12[512];
         
+        /**
+         * The x of the gradient picked by each permMod12 entry, so one lookup finds the gradient.
+         **/
+        static float permGradX[512];
+        
+        /**
+         * The z of the gradient picked by each permMod12 entry.
+         **/
+        static float permGradZ[512];
+        
         /**
          * The minumum allowed height value.
          **/
@@ -135,6 +242,16 @@ class SimplexNoise : public INoiseAlgorithm
          * The range is used to determine how many iterations to make of the noise function.
          **/
         double _worldScale;
+        
+        /**
+         * The number of octaves summed by the float noise.
+         **/
+        unsigned int _octaves;
+        
+        /**
+         * Use the double precision reference noise.
+         **/
+        bool _doublePrecision;
 };
 
 #endif // SIMPLEXNOISE_H
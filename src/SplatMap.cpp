@@ -0,0 +1,477 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "SplatMap.h"
+#include "PngFile.h"
+#include <math.h>
+#include <stdio.h>
+
+/**
+ * Resample one row of the height array at a fractional row, between two columns.
+ **/
+static void resampleRow(const float *heights, unsigned int size, float z, unsigned int first, unsigned int last, float *output)
+{
+    float max = (float)(size - 1);
+    z = z < 0 ? 0 : (z > max ? max : z);
+
+    unsigned int z0 = (unsigned int)z;
+    unsigned int z1 = z0 + 1 < size ? z0 + 1 : z0;
+    float fz = z - z0;
+    const float *row0 = heights + z0 * size;
+    const float *row1 = heights + z1 * size;
+
+    for (unsigned int x = first; x <= last; x++) {
+        output[x] = row0[x] + (row1[x] - row0[x]) * fz;
+    }
+}
+
+SplatRule::SplatRule() :
+minHeight(0.0f),
+maxHeight(1.0f),
+heightFalloff(0.0f),
+minSlope(0.0f),
+maxSlope(1000000.0f),
+slopeFalloff(0.0f),
+strength(1.0f)
+{
+}
+
+SplatMap::SplatMap(unsigned int resolution) :
+_resolution(resolution),
+_jobSystem(NULL),
+_heightMin(0.0f),
+_heightRange(0.0f)
+{
+}
+
+SplatMap::~SplatMap()
+{
+    // The files are left behind for the terrain that is still using them.
+}
+
+unsigned int SplatMap::addLayer(const char* texturePath, const Vector2& repeat, const SplatRule& rule)
+{
+    Layer layer;
+    layer.texturePath = texturePath;
+    layer.repeat = repeat;
+    layer.rule = rule;
+    _layers.push_back(layer);
+
+    this->resizeWeights();
+    return _layers.size() - 1;
+}
+
+unsigned int SplatMap::getLayerCount() const
+{
+    return _layers.size();
+}
+
+unsigned int SplatMap::getTextureCount() const
+{
+    if (_layers.size() < 2) {
+        return 0;
+    }
+    return (_layers.size() - 1 + 3) / 4;
+}
+
+unsigned int SplatMap::getResolution() const
+{
+    return _resolution;
+}
+
+void SplatMap::setResolution(unsigned int resolution)
+{
+    _resolution = resolution;
+    _generated.clear();
+    _weights.clear();
+    _painted.clear();
+    this->resizeWeights();
+}
+
+void SplatMap::resizeWeights()
+{
+    unsigned int size = _resolution * _resolution * 4;
+
+    _generated.resize(this->getTextureCount());
+    _weights.resize(this->getTextureCount());
+    for (unsigned int i = 0; i < _generated.size(); i++) {
+        _generated[i].resize(size, 0);
+        _weights[i].resize(size, 0);
+    }
+    if (!_painted.empty()) {
+        _painted.resize(this->getTextureCount());
+        for (unsigned int i = 0; i < _painted.size(); i++) {
+            _painted[i].resize(size, 0);
+        }
+    }
+}
+
+void SplatMap::setJobSystem(JobSystem *jobSystem)
+{
+    _jobSystem = jobSystem;
+}
+
+void SplatMap::applyRule(const SplatRule& rule, const float* heights, const float* slopes, unsigned int count, unsigned char* output)
+{
+    // A falloff of 0 is a hard edge, anything past the range scales to a weight below 0.
+    float heightScale = rule.heightFalloff > 0 ? 1.0f / rule.heightFalloff : 1.0e30f;
+    float slopeScale = rule.slopeFalloff > 0 ? 1.0f / rule.slopeFalloff : 1.0e30f;
+
+    // No branches, so this loop vectorizes.
+    for (unsigned int i = 0; i < count; i++) {
+        float height = heights[i], slope = slopes[i];
+        float heightDistance = rule.minHeight - height > height - rule.maxHeight ? rule.minHeight - height : height - rule.maxHeight;
+        float slopeDistance = rule.minSlope - slope > slope - rule.maxSlope ? rule.minSlope - slope : slope - rule.maxSlope;
+        heightDistance = heightDistance > 0 ? heightDistance : 0;
+        slopeDistance = slopeDistance > 0 ? slopeDistance : 0;
+
+        float heightWeight = 1.0f - heightDistance * heightScale;
+        float slopeWeight = 1.0f - slopeDistance * slopeScale;
+        heightWeight = heightWeight > 0 ? heightWeight : 0;
+        slopeWeight = slopeWeight > 0 ? slopeWeight : 0;
+
+        float weight = heightWeight * slopeWeight * rule.strength;
+        weight = weight < 1.0f ? weight : 1.0f;
+        output[i * 4] = (unsigned char)(weight * 255);
+    }
+}
+
+void SplatMap::sampleColumns(unsigned int heightFieldSize, float gridScale, float offset, ColumnSamples& samples) const
+{
+    float max = (float)(heightFieldSize - 1);
+
+    samples.first.resize(_resolution);
+    samples.second.resize(_resolution);
+    samples.fraction.resize(_resolution);
+    for (unsigned int x = 0; x < _resolution; x++) {
+        float gridx = x * gridScale + offset;
+        gridx = gridx < 0 ? 0 : (gridx > max ? max : gridx);
+
+        samples.first[x] = (unsigned int)gridx;
+        samples.second[x] = samples.first[x] + 1 < heightFieldSize ? samples.first[x] + 1 : samples.first[x];
+        samples.fraction[x] = gridx - samples.first[x];
+    }
+}
+
+void SplatMap::generate(const float* heights, unsigned int heightFieldSize, const Vector3& terrainScale)
+{
+    unsigned int i;
+    unsigned int count = heightFieldSize * heightFieldSize;
+
+    if (_layers.size() < 2 || heightFieldSize < 2) {
+        return;
+    }
+
+    // Find the height range, so the rules can work on relative heights.
+    float terrainMinHeight = heights[0], terrainMaxHeight = heights[0];
+    for (i = 1; i < count; i++) {
+        terrainMinHeight = heights[i] < terrainMinHeight ? heights[i] : terrainMinHeight;
+        terrainMaxHeight = heights[i] > terrainMaxHeight ? heights[i] : terrainMaxHeight;
+    }
+    _heightMin = terrainMinHeight;
+    _heightRange = terrainMaxHeight - terrainMinHeight;
+    if (_heightRange <= 0) {
+        _heightRange = 1.0f;
+    }
+
+    this->generateTexels(heights, heightFieldSize, terrainScale, DirtyRect(0, 0, _resolution - 1, _resolution - 1));
+}
+
+void SplatMap::generate(const float* heights, unsigned int heightFieldSize, const Vector3& terrainScale, const DirtyRect& cells)
+{
+    if (_layers.size() < 2 || heightFieldSize < 2 || cells.isEmpty()) {
+        return;
+    }
+    if (_heightRange <= 0) {
+        // Nothing to measure the heights against yet.
+        this->generate(heights, heightFieldSize, terrainScale);
+        return;
+    }
+
+    // Each texel blends the cells around it, and its slope reaches another cell further out.
+    float gridScale = (float)(heightFieldSize - 1) / (float)(_resolution > 1 ? _resolution - 1 : 1);
+    DirtyRect texels((int)floorf((cells.minX - 2) / gridScale), (int)floorf((cells.minZ - 2) / gridScale),
+                     (int)ceilf((cells.maxX + 2) / gridScale), (int)ceilf((cells.maxZ + 2) / gridScale));
+    texels.clip(_resolution, _resolution);
+
+    this->generateTexels(heights, heightFieldSize, terrainScale, texels);
+}
+
+void SplatMap::generateTexels(const float* heights, unsigned int heightFieldSize, const Vector3& terrainScale, const DirtyRect& texels)
+{
+    ColumnSamples centre, left, right;
+
+    if (texels.isEmpty()) {
+        return;
+    }
+
+    // Texels to height field cells, and the slope of one height unit over two cells in world units.
+    float gridScale = (float)(heightFieldSize - 1) / (float)(_resolution > 1 ? _resolution - 1 : 1);
+    float slopeScaleX = terrainScale.y / (2.0f * terrainScale.x);
+    float slopeScaleZ = terrainScale.y / (2.0f * terrainScale.z);
+    float heightScale = 1.0f / _heightRange;
+
+    this->sampleColumns(heightFieldSize, gridScale, 0.0f, centre);
+    this->sampleColumns(heightFieldSize, gridScale, -1.0f, left);
+    this->sampleColumns(heightFieldSize, gridScale, 1.0f, right);
+
+    unsigned int minX = texels.minX;
+    unsigned int width = texels.maxX - texels.minX + 1;
+    unsigned int firstCell = left.first[texels.minX];
+    unsigned int lastCell = right.second[texels.maxX];
+
+    JobSystem::RangeTask band = [&](unsigned int begin, unsigned int end) {
+        std::vector<float> above(heightFieldSize), middle(heightFieldSize), below(heightFieldSize);
+        std::vector<float> height(width), slope(width);
+        unsigned int i, x, z, layer;
+
+        for (z = begin; z < end; z++) {
+            float gridz = z * gridScale;
+
+            // Resample the three rows of the height field this row of texels needs.
+            resampleRow(heights, heightFieldSize, gridz - 1, firstCell, lastCell, &above[0]);
+            resampleRow(heights, heightFieldSize, gridz, firstCell, lastCell, &middle[0]);
+            resampleRow(heights, heightFieldSize, gridz + 1, firstCell, lastCell, &below[0]);
+
+            for (i = 0; i < width; i++) {
+                x = minX + i;
+                float h = middle[centre.first[x]] + (middle[centre.second[x]] - middle[centre.first[x]]) * centre.fraction[x];
+                float hleft = middle[left.first[x]] + (middle[left.second[x]] - middle[left.first[x]]) * left.fraction[x];
+                float hright = middle[right.first[x]] + (middle[right.second[x]] - middle[right.first[x]]) * right.fraction[x];
+                float habove = above[centre.first[x]] + (above[centre.second[x]] - above[centre.first[x]]) * centre.fraction[x];
+                float hbelow = below[centre.first[x]] + (below[centre.second[x]] - below[centre.first[x]]) * centre.fraction[x];
+                float dx = (hright - hleft) * slopeScaleX;
+                float dz = (hbelow - habove) * slopeScaleZ;
+
+                height[i] = (h - _heightMin) * heightScale;
+                slope[i] = sqrtf(dx * dx + dz * dz);
+            }
+
+            unsigned int texel = minX + z * _resolution;
+            for (layer = 1; layer < _layers.size(); layer++) {
+                unsigned char *output = &_generated[(layer - 1) / 4][texel * 4 + (layer - 1) % 4];
+                applyRule(_layers[layer].rule, &height[0], &slope[0], width, output);
+            }
+            this->composeTexels(texel, width);
+        }
+    };
+
+    if (_jobSystem) {
+        _jobSystem->parallelFor(texels.minZ, texels.maxZ + 1, 8, band);
+    } else {
+        band(texels.minZ, texels.maxZ + 1);
+    }
+}
+
+void SplatMap::composeTexels(unsigned int texel, unsigned int count)
+{
+    unsigned int i, j;
+    unsigned int first = texel * 4, last = (texel + count) * 4;
+
+    for (i = 0; i < _weights.size(); i++) {
+        const unsigned char *generated = &_generated[i][0];
+        unsigned char *weights = &_weights[i][0];
+
+        if (_painted.empty()) {
+            for (j = first; j < last; j++) {
+                weights[j] = generated[j];
+            }
+        } else {
+            const short *painted = &_painted[i][0];
+            for (j = first; j < last; j++) {
+                int weight = generated[j] + painted[j];
+                weight = weight < 0 ? 0 : weight;
+                weights[j] = (unsigned char)(weight > 255 ? 255 : weight);
+            }
+        }
+    }
+}
+
+void SplatMap::paint(unsigned int layer, float x, float z, float radius, float strength)
+{
+    int minx = (int)floorf(x - radius), maxx = (int)ceilf(x + radius);
+    int minz = (int)floorf(z - radius), maxz = (int)ceilf(z + radius);
+    int i, j;
+    unsigned int other;
+
+    if (layer >= _layers.size() || radius <= 0 || _weights.empty()) {
+        return;
+    }
+    if (_painted.empty()) {
+        _painted.resize(this->getTextureCount());
+        for (unsigned int t = 0; t < _painted.size(); t++) {
+            _painted[t].resize(_resolution * _resolution * 4, 0);
+        }
+    }
+
+    // Clip the circle to the map.
+    minx = minx < 0 ? 0 : minx;
+    minz = minz < 0 ? 0 : minz;
+    maxx = maxx >= (int)_resolution ? _resolution - 1 : maxx;
+    maxz = maxz >= (int)_resolution ? _resolution - 1 : maxz;
+    if (minx > maxx || minz > maxz) {
+        return;
+    }
+
+    for (j = minz; j <= maxz; j++) {
+        for (i = minx; i <= maxx; i++) {
+            float dist = sqrtf((i - x) * (i - x) + (j - z) * (j - z));
+            if (dist >= radius) {
+                continue;
+            }
+            int amount = (int)(strength * (1.0f - dist / radius) * 255);
+            unsigned int texel = i + j * _resolution;
+
+            if (layer > 0) {
+                short &painted = _painted[(layer - 1) / 4][texel * 4 + (layer - 1) % 4];
+                int value = painted + amount;
+                painted = (short)(value < -255 ? -255 : (value > 255 ? 255 : value));
+            }
+            // Uncover the new layer by taking away the layers drawn on top of it.
+            if (amount > 0) {
+                for (other = layer + 1; other < _layers.size(); other++) {
+                    short &painted = _painted[(other - 1) / 4][texel * 4 + (other - 1) % 4];
+                    int value = painted - amount;
+                    painted = (short)(value < -255 ? -255 : value);
+                }
+            }
+        }
+        this->composeTexels(minx + j * _resolution, maxx - minx + 1);
+    }
+}
+
+void SplatMap::clearPaint()
+{
+    if (_painted.empty()) {
+        return;
+    }
+    _painted.clear();
+    this->composeTexels(0, _resolution * _resolution);
+}
+
+bool SplatMap::save(const char* directory)
+{
+    char path[2048];
+    unsigned int i;
+
+    // Delete the files from the last save.
+    for (i = 0; i < _texturePaths.size(); i++) {
+        remove(_texturePaths[i].c_str());
+    }
+    _texturePaths.clear();
+
+    for (i = 0; i < _weights.size(); i++) {
+        sprintf(path, "%s/splat%u.png", directory, i);
+        _texturePaths.push_back(path);
+    }
+    return this->saveTextures(_texturePaths);
+}
+
+bool SplatMap::exportTextures(const char *prefix, std::vector<std::string> &paths) const
+{
+    char path[2048];
+    unsigned int i;
+
+    paths.clear();
+    for (i = 0; i < _weights.size(); i++) {
+        sprintf(path, "%ssplat%u.png", prefix, i);
+        paths.push_back(path);
+    }
+    return this->saveTextures(paths);
+}
+
+bool SplatMap::saveTextures(const std::vector<std::string> &paths) const
+{
+    unsigned int i;
+    bool success = true;
+
+    // Each texture is encoded and written by its own job.
+    if (_jobSystem) {
+        std::vector<JobSystem::JobHandle> jobs;
+        std::vector<char> results(_weights.size(), 0);
+
+        for (i = 0; i < _weights.size(); i++) {
+            jobs.push_back(_jobSystem->submit([this, &results, &paths, i]() {
+                results[i] = this->saveTexture(i, paths[i]);
+            }));
+        }
+        for (i = 0; i < jobs.size(); i++) {
+            _jobSystem->wait(jobs[i]);
+            success = success && results[i];
+        }
+    } else {
+        for (i = 0; i < _weights.size(); i++) {
+            success = this->saveTexture(i, paths[i]) && success;
+        }
+    }
+    return success;
+}
+
+bool SplatMap::saveTexture(unsigned int texture, const std::string &path) const
+{
+    return PngFile::save(path, _weights[texture], _resolution, _resolution, LCT_RGBA, _jobSystem);
+}
+
+void SplatMap::apply(Terrain* terrain) const
+{
+    unsigned int layer;
+
+    for (layer = 0; layer < _layers.size(); layer++) {
+        if (layer == 0) {
+            terrain->setLayer(layer, _layers[layer].texturePath.c_str(), _layers[layer].repeat);
+        } else {
+            terrain->setLayer(layer, _layers[layer].texturePath.c_str(), _layers[layer].repeat,
+                              this->getTexturePath(layer), this->getTextureChannel(layer));
+        }
+    }
+}
+
+void SplatMap::applyBaseLayer(Terrain* terrain) const
+{
+    if (!_layers.empty()) {
+        terrain->setLayer(0, _layers[0].texturePath.c_str(), _layers[0].repeat);
+    }
+}
+
+const char* SplatMap::getTexturePath(unsigned int layer) const
+{
+    unsigned int texture = (layer - 1) / 4;
+
+    if (layer == 0 || texture >= _texturePaths.size()) {
+        return NULL;
+    }
+    return _texturePaths[texture].c_str();
+}
+
+int SplatMap::getTextureChannel(unsigned int layer) const
+{
+    return (layer - 1) % 4;
+}
+
+const char* SplatMap::getLayerTexturePath(unsigned int layer) const
+{
+    GP_ASSERT(layer < _layers.size());
+    return _layers[layer].texturePath.c_str();
+}
+
+const Vector2& SplatMap::getLayerRepeat(unsigned int layer) const
+{
+    GP_ASSERT(layer < _layers.size());
+    return _layers[layer].repeat;
+}
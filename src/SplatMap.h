@@ -0,0 +1,396 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SPLATMAP_H
+#define SPLATMAP_H
+
+#include "gameplay.h"
+#include "DirtyRect.h"
+#include "JobSystem.h"
+
+using namespace gameplay;
+
+/**
+ * Rule used to generate the weight of a texture layer from the shape of the terrain.
+ * The weight is 1 while the value is inside [min, max] and falls off linearly to 0 over
+ * the falloff distance outside of it. The height and slope weights are multiplied.
+ **/
+struct SplatRule
+{
+    /**
+     * Constructor - a rule that covers everything.
+     **/
+    SplatRule();
+
+    /**
+     * Lowest full strength height, 0 is the lowest point of the terrain and 1 the highest.
+     **/
+    float minHeight;
+
+    /**
+     * Highest full strength height.
+     **/
+    float maxHeight;
+
+    /**
+     * Distance outside of the height range over which the weight falls to 0.
+     **/
+    float heightFalloff;
+
+    /**
+     * Lowest full strength slope (rise over run in world units).
+     **/
+    float minSlope;
+
+    /**
+     * Highest full strength slope.
+     **/
+    float maxSlope;
+
+    /**
+     * Distance outside of the slope range over which the weight falls to 0.
+     **/
+    float slopeFalloff;
+
+    /**
+     * Scales the resulting weight.
+     **/
+    float strength;
+};
+
+/**
+ * Splat maps hold the blend weights for all the texture layers of the terrain. Layer 0 is the
+ * base layer and has no weight. The weights for the other layers are packed 4 to a texel in
+ * as many RGBA textures as needed, so adding layers doesn't add files or samplers until every
+ * channel is used.
+ *
+ * The weights come from the rules of each layer, plus whatever has been painted on top. The
+ * painted changes are kept separately so they survive the rules being regenerated after the
+ * terrain is sculpted.
+ *
+ * Generation runs a row at a time in bands on the job system. Each row is first resampled from
+ * the height field into flat arrays of heights and slopes, then every rule runs as a straight
+ * loop over those arrays, so the compiler can vectorize it.
+ **/
+class SplatMap
+{
+public:
+    /**
+     * Constructor
+     *
+     * @param resolution The size of one side of the (square) splat textures.
+     **/
+    SplatMap(unsigned int resolution);
+
+    /**
+     * Destructor
+     **/
+    ~SplatMap();
+
+    /**
+     * Add a texture layer. The first layer added is the base layer.
+     *
+     * @param texturePath The texture to draw for this layer.
+     * @param repeat How many times the texture repeats across the terrain.
+     * @param rule How the weights for the layer are generated (ignored for the base layer).
+     * @return unsigned int The index of the new layer.
+     **/
+    unsigned int addLayer(const char *texturePath, const Vector2 &repeat, const SplatRule &rule);
+
+    /**
+     * Get the number of texture layers, including the base layer.
+     *
+     * @return unsigned int
+     **/
+    unsigned int getLayerCount() const;
+
+    /**
+     * Get the number of splat textures needed to hold the weights of all the layers.
+     *
+     * @return unsigned int
+     **/
+    unsigned int getTextureCount() const;
+
+    /**
+     * Get the size of one side of the splat textures.
+     *
+     * @return unsigned int
+     **/
+    unsigned int getResolution() const;
+
+    /**
+     * Change the size of the splat textures. Clears the weights and anything painted.
+     *
+     * @param resolution The new size.
+     * @return void
+     **/
+    void setResolution(unsigned int resolution);
+
+    /**
+     * Set the jobs used to generate and save the splat map. Without a job system everything runs on the calling thread.
+     *
+     * @param jobSystem The job system, which must outlive the splat map.
+     * @return void
+     **/
+    void setJobSystem(JobSystem *jobSystem);
+
+    /**
+     * Regenerate the weights of every layer from the layer rules.
+     *
+     * @param heights The height array, heightFieldSize * heightFieldSize values.
+     * @param heightFieldSize The size of one side of the height array.
+     * @param terrainScale The scale of the terrain, used to measure slopes in world units.
+     * @return void
+     **/
+    void generate(const float *heights, unsigned int heightFieldSize, const Vector3 &terrainScale);
+
+    /**
+     * Regenerate the weights of the texels covering some cells of the height field, after they have been edited.
+     * The heights are measured against the height range found by the last full generate, so the rest of
+     * the map stays valid.
+     *
+     * @param heights The height array, heightFieldSize * heightFieldSize values.
+     * @param heightFieldSize The size of one side of the height array.
+     * @param terrainScale The scale of the terrain, used to measure slopes in world units.
+     * @param cells The cells of the height field that changed.
+     * @return void
+     **/
+    void generate(const float *heights, unsigned int heightFieldSize, const Vector3 &terrainScale, const DirtyRect &cells);
+
+    /**
+     * Paint a layer into a circle of the splat map. Painting a layer also removes the layers
+     * above it, because those are drawn over the top. Painting the base layer removes all others.
+     *
+     * @param layer The layer to paint.
+     * @param x The x texel coordinate for the center of the circle.
+     * @param z The z texel coordinate for the center of the circle.
+     * @param radius The radius of the circle in texels.
+     * @param strength How much weight to add in the middle of the circle, from 0 to 1. Negative values erase the layer.
+     * @return void
+     **/
+    void paint(unsigned int layer, float x, float z, float radius, float strength);
+
+    /**
+     * Forget everything that has been painted.
+     *
+     * @return void
+     **/
+    void clearPaint();
+
+    /**
+     * Write the splat textures to png files in a directory. The files are named splat0.png, splat1.png...
+     *
+     * @param directory An existing directory.
+     * @return bool
+     **/
+    bool save(const char *directory);
+
+    /**
+     * Write copies of the splat textures to png files, leaving the paths from the last save alone.
+     * The files are named with the prefix followed by splat0.png, splat1.png...
+     *
+     * @param prefix The start of each path, such as "export/terrain_".
+     * @param paths Filled with the path of each texture.
+     * @return bool
+     **/
+    bool exportTextures(const char *prefix, std::vector<std::string> &paths) const;
+
+    /**
+     * Set all the layers on a terrain, using the files from the last save.
+     *
+     * @param terrain The terrain to texture.
+     * @return void
+     **/
+    void apply(Terrain *terrain) const;
+
+    /**
+     * Set only the base layer on a terrain, for quick previews that have no blend maps.
+     *
+     * @param terrain The terrain to texture.
+     * @return void
+     **/
+    void applyBaseLayer(Terrain *terrain) const;
+
+    /**
+     * Get the path of the splat texture holding the weight of a layer, from the last save.
+     *
+     * @param layer A layer other than the base layer.
+     * @return const char*
+     **/
+    const char* getTexturePath(unsigned int layer) const;
+
+    /**
+     * Get the channel of the splat texture holding the weight of a layer.
+     *
+     * @param layer A layer other than the base layer.
+     * @return int
+     **/
+    int getTextureChannel(unsigned int layer) const;
+
+    /**
+     * Get the path of the image drawn by a layer.
+     *
+     * @param layer The layer.
+     * @return const char*
+     **/
+    const char* getLayerTexturePath(unsigned int layer) const;
+
+    /**
+     * Get how many times the image of a layer repeats across the terrain.
+     *
+     * @param layer The layer.
+     * @return const Vector2&
+     **/
+    const Vector2& getLayerRepeat(unsigned int layer) const;
+
+private:
+    /**
+     * A texture layer.
+     **/
+    struct Layer
+    {
+        std::string texturePath;
+        Vector2 repeat;
+        SplatRule rule;
+    };
+
+    /**
+     * Where one column of texels samples the height field - the two cells to blend and how far between them.
+     **/
+    struct ColumnSamples
+    {
+        std::vector<unsigned int> first;
+        std::vector<unsigned int> second;
+        std::vector<float> fraction;
+    };
+
+    /**
+     * Regenerate a rectangle of texels.
+     *
+     * @param heights The height array.
+     * @param heightFieldSize The size of one side of the height array.
+     * @param terrainScale The scale of the terrain.
+     * @param texels The texels to generate.
+     * @return void
+     **/
+    void generateTexels(const float *heights, unsigned int heightFieldSize, const Vector3 &terrainScale, const DirtyRect &texels);
+
+    /**
+     * Work out where each texel column samples the height field, offset by a number of cells.
+     *
+     * @param heightFieldSize The size of one side of the height array.
+     * @param gridScale Height field cells per texel.
+     * @param offset Cells to add to each sample position.
+     * @param samples Filled with one entry per texel column.
+     * @return void
+     **/
+    void sampleColumns(unsigned int heightFieldSize, float gridScale, float offset, ColumnSamples &samples) const;
+
+    /**
+     * Encode every splat texture and write them out, each on its own job.
+     *
+     * @param paths The path to write each texture to.
+     * @return bool
+     **/
+    bool saveTextures(const std::vector<std::string> &paths) const;
+
+    /**
+     * Encode one splat texture and write it to a file.
+     *
+     * @param texture The index of the texture.
+     * @param path The file to write.
+     * @return bool
+     **/
+    bool saveTexture(unsigned int texture, const std::string &path) const;
+
+    /**
+     * Allocate the weights for all the splat textures.
+     *
+     * @return void
+     **/
+    void resizeWeights();
+
+    /**
+     * Combine the generated and painted weights for a run of texels into the splat textures.
+     *
+     * @param texel The index of the first texel.
+     * @param count The number of texels.
+     * @return void
+     **/
+    void composeTexels(unsigned int texel, unsigned int count);
+
+    /**
+     * Apply a rule to a row of heights and slopes, writing one channel of an RGBA row.
+     *
+     * @param rule The rule
+     * @param heights The heights, 0 to 1.
+     * @param slopes The slopes (rise over run).
+     * @param count The number of texels.
+     * @param output The first channel to write, every 4th byte is written.
+     * @return void
+     **/
+    static void applyRule(const SplatRule &rule, const float *heights, const float *slopes, unsigned int count, unsigned char *output);
+
+    /**
+     * The texture layers.
+     **/
+    std::vector<Layer> _layers;
+
+    /**
+     * The size of one side of the splat textures.
+     **/
+    unsigned int _resolution;
+
+    /**
+     * The weights generated by the rules, one RGBA buffer for each splat texture.
+     **/
+    std::vector< std::vector<unsigned char> > _generated;
+
+    /**
+     * Painted changes to the generated weights, same layout as _generated. Empty until something is painted.
+     **/
+    std::vector< std::vector<short> > _painted;
+
+    /**
+     * The final weights, one RGBA buffer for each splat texture.
+     **/
+    std::vector< std::vector<unsigned char> > _weights;
+
+    /**
+     * The file paths from the last save.
+     **/
+    std::vector<std::string> _texturePaths;
+
+    /**
+     * The job system to work on, or NULL.
+     **/
+    JobSystem *_jobSystem;
+
+    /**
+     * The lowest height found by the last full generate.
+     **/
+    float _heightMin;
+
+    /**
+     * The height range found by the last full generate.
+     **/
+    float _heightRange;
+};
+
+#endif // SPLATMAP_H
@@ -0,0 +1,219 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "TerrainExporter.h"
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+
+/**
+ * Rows of the height field in each band of work.
+ **/
+static const unsigned int ROWS_PER_BAND = 64;
+
+TerrainExporter::TerrainExporter() :
+_jobSystem(NULL),
+_patchSize(32),
+_detailLevels(3),
+_skirtScale(1.0f),
+_heights(NULL),
+_size(0),
+_scale(Vector3::one()),
+_lowest(0.0f),
+_highest(0.0f)
+{
+}
+
+TerrainExporter::~TerrainExporter()
+{
+}
+
+void TerrainExporter::setJobSystem(JobSystem *jobSystem)
+{
+    _jobSystem = jobSystem;
+}
+
+void TerrainExporter::setLevelOfDetail(unsigned int patchSize, unsigned int detailLevels, float skirtScale)
+{
+    _patchSize = patchSize;
+    _detailLevels = detailLevels;
+    _skirtScale = skirtScale;
+}
+
+bool TerrainExporter::save(const std::string &path, const float *heights, unsigned int size, const Vector3 &scale,
+                           const SplatMap &splatMap, const NormalMap &normalMap, const LightMap &lightMap)
+{
+    GP_ASSERT(heights && size > 0);
+    unsigned int i;
+
+    _heights = heights;
+    _size = size;
+    _scale = scale;
+    _lowest = _highest = heights[0];
+    for (i = 1; i < size * size; i++) {
+        _lowest = std::min(_lowest, heights[i]);
+        _highest = std::max(_highest, heights[i]);
+    }
+
+    // Everything else is named after the .terrain file.
+    std::string base = path;
+    size_t extension = base.rfind('.');
+    if (extension != std::string::npos && base.find_first_of("/\\", extension) == std::string::npos) {
+        base.erase(extension);
+    }
+    std::string heightmapPath = base + ".r16";
+    std::string normalMapPath = base + "_normal.png";
+    std::string lightMapPath = base + "_light.png";
+    std::string splatPrefix = base + "_";
+    std::vector<std::string> splatPaths;
+    bool heightmapSaved = false, normalMapSaved = false, lightMapSaved = false, splatsSaved = false;
+
+    if (_jobSystem) {
+        JobSystem::JobHandle jobs[4];
+        jobs[0] = _jobSystem->submit([this, &heightmapPath, &heightmapSaved]() {
+            heightmapSaved = this->saveHeightmap(heightmapPath);
+        });
+        jobs[1] = _jobSystem->submit([&normalMap, &normalMapPath, &normalMapSaved]() {
+            normalMapSaved = normalMap.exportTexture(normalMapPath);
+        });
+        jobs[2] = _jobSystem->submit([&lightMap, &lightMapPath, &lightMapSaved]() {
+            lightMapSaved = lightMap.exportTexture(lightMapPath);
+        });
+        jobs[3] = _jobSystem->submit([&splatMap, &splatPrefix, &splatPaths, &splatsSaved]() {
+            splatsSaved = splatMap.exportTextures(splatPrefix.c_str(), splatPaths);
+        });
+        for (i = 0; i < 4; i++) {
+            _jobSystem->wait(jobs[i]);
+        }
+    } else {
+        heightmapSaved = this->saveHeightmap(heightmapPath);
+        normalMapSaved = normalMap.exportTexture(normalMapPath);
+        lightMapSaved = lightMap.exportTexture(lightMapPath);
+        splatsSaved = splatMap.exportTextures(splatPrefix.c_str(), splatPaths);
+    }
+
+    _heights = NULL;
+    if (!heightmapSaved || !normalMapSaved || !lightMapSaved || !splatsSaved) {
+        return false;
+    }
+    return this->saveDescriptor(path, heightmapPath, normalMapPath, splatMap, splatPaths);
+}
+
+bool TerrainExporter::saveHeightmap(const std::string &path) const
+{
+    std::vector<unsigned char> bytes(_size * _size * 2);
+    float range = _highest - _lowest;
+    float toSample = range > 0 ? 65535.0f / range : 0.0f;
+
+    auto encodeRows = [this, &bytes, toSample](unsigned int begin, unsigned int end) {
+        unsigned int i;
+        for (i = begin * _size; i < end * _size; i++) {
+            unsigned int sample = (unsigned int)((_heights[i] - _lowest) * toSample + 0.5f);
+            sample = std::min(sample, 65535u);
+            bytes[i * 2] = (unsigned char)(sample & 0xff);
+            bytes[i * 2 + 1] = (unsigned char)(sample >> 8);
+        }
+    };
+    if (_jobSystem) {
+        _jobSystem->parallelFor(0, _size, ROWS_PER_BAND, encodeRows);
+    } else {
+        encodeRows(0, _size);
+    }
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) {
+        GP_WARN("Could not open %s for writing.", path.c_str());
+        return false;
+    }
+    bool written = fwrite(&bytes[0], 1, bytes.size(), file) == bytes.size();
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        GP_WARN("Could not write %s.", path.c_str());
+    }
+    return written;
+}
+
+bool TerrainExporter::saveDescriptor(const std::string &path, const std::string &heightmapPath, const std::string &normalMapPath,
+                                     const SplatMap &splatMap, const std::vector<std::string> &splatPaths) const
+{
+    FILE *file = fopen(path.c_str(), "w");
+    unsigned int layer;
+
+    if (!file) {
+        GP_WARN("Could not open %s for writing.", path.c_str());
+        return false;
+    }
+
+    // The heightmap is stretched over its full range, so the height of the terrain is the range of the heights.
+    float range = _highest - _lowest;
+    fprintf(file, "terrain\n{\n");
+    fprintf(file, "    heightmap\n    {\n        path = %s\n        size = %u, %u\n    }\n\n", heightmapPath.c_str(), _size, _size);
+    fprintf(file, "    size = %g, %g, %g\n", (_size - 1) * _scale.x, (range > 0 ? range : 1.0f) * _scale.y, (_size - 1) * _scale.z);
+    fprintf(file, "    patchSize = %u\n", _patchSize);
+    fprintf(file, "    detailLevels = %u\n", _detailLevels);
+    fprintf(file, "    skirtScale = %g\n\n", _skirtScale);
+    fprintf(file, "    normalMap = %s\n", normalMapPath.c_str());
+
+    // The base layer covers everything, the others blend over it from a channel of a splat texture.
+    for (layer = 0; layer < splatMap.getLayerCount(); layer++) {
+        const Vector2 &repeat = splatMap.getLayerRepeat(layer);
+        fprintf(file, "\n    layer %s\n    {\n", getLayerName(splatMap.getLayerTexturePath(layer), layer).c_str());
+        fprintf(file, "        texture\n        {\n            path = %s\n            repeat = %g, %g\n        }\n",
+                splatMap.getLayerTexturePath(layer), repeat.x, repeat.y);
+        unsigned int texture = (layer - 1) / 4;
+        if (layer > 0 && texture < splatPaths.size()) {
+            fprintf(file, "\n        blend\n        {\n            path = %s\n            channel = %d\n        }\n",
+                    splatPaths[texture].c_str(), splatMap.getTextureChannel(layer));
+        }
+        fprintf(file, "    }\n");
+    }
+    fprintf(file, "}\n");
+
+    bool written = !ferror(file);
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        GP_WARN("Could not write %s.", path.c_str());
+    }
+    return written;
+}
+
+std::string TerrainExporter::getLayerName(const std::string &texturePath, unsigned int layer)
+{
+    size_t start = texturePath.find_last_of("/\\");
+    start = start == std::string::npos ? 0 : start + 1;
+    size_t end = texturePath.rfind('.');
+    if (end == std::string::npos || end < start) {
+        end = texturePath.size();
+    }
+
+    std::string name = texturePath.substr(start, end - start);
+    size_t i;
+    for (i = 0; i < name.size(); i++) {
+        if (!isalnum((unsigned char)name[i])) {
+            name[i] = '_';
+        }
+    }
+    if (name.empty()) {
+        char fallback[32];
+        sprintf(fallback, "layer%u", layer);
+        name = fallback;
+    }
+    return name;
+}
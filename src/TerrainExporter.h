@@ -0,0 +1,168 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef TERRAINEXPORTER_H
+#define TERRAINEXPORTER_H
+
+#include "SplatMap.h"
+#include "NormalMap.h"
+#include "LightMap.h"
+#include "JobSystem.h"
+
+#include "gameplay.h"
+#include <string>
+#include <vector>
+
+using namespace gameplay;
+
+/**
+ * Writes a terrain as a bundle the engine can load by itself - a .terrain file describing the terrain,
+ * with the heightmap as 16 bit raw (.r16), the splat textures, and a normal map, all next to it. The baked
+ * light map is written beside them too, for materials that use it - a .terrain file has nowhere to name it.
+ *
+ * The heightmap and the textures do not depend on each other, so with a job system
+ * each is written by its own job, and the pngs are also deflated in stripes. The .terrain file is written
+ * last, once the paths of everything it points at are known.
+ **/
+class TerrainExporter
+{
+public:
+    /**
+     * Constructor
+     **/
+    TerrainExporter();
+
+    /**
+     * Destructor
+     **/
+    ~TerrainExporter();
+
+    /**
+     * Set the jobs to work on. Without a job system everything runs on the calling thread.
+     *
+     * @param jobSystem The job system, or NULL.
+     * @return void
+     **/
+    void setJobSystem(JobSystem *jobSystem);
+
+    /**
+     * Set the level of detail settings written to the .terrain file.
+     *
+     * @param patchSize The size of a patch, in height field cells.
+     * @param detailLevels The number of levels of detail.
+     * @param skirtScale The height of the skirts around the patches.
+     * @return void
+     **/
+    void setLevelOfDetail(unsigned int patchSize, unsigned int detailLevels, float skirtScale);
+
+    /**
+     * Export a terrain. The other files are named after the .terrain file - for "out/hills.terrain" they
+     * are out/hills.r16, out/hills_normal.png, out/hills_light.png and out/hills_splat0.png, out/hills_splat1.png...
+     *
+     * @param path The path of the .terrain file, in an existing directory.
+     * @param heights The height array.
+     * @param size The size of one side of the height field.
+     * @param scale The spacing of the cells in x and z, and the scale of the heights in y.
+     * @param splatMap The texture layers and their blend weights.
+     * @param normalMap The normal map.
+     * @param lightMap The baked light map.
+     * @return bool false if any of the files could not be written.
+     **/
+    bool save(const std::string &path, const float *heights, unsigned int size, const Vector3 &scale,
+              const SplatMap &splatMap, const NormalMap &normalMap, const LightMap &lightMap);
+
+private:
+    /**
+     * Write the heights as 16 bit little endian values, stretched from the lowest height to the highest.
+     *
+     * @param path The path of the file.
+     * @return bool
+     **/
+    bool saveHeightmap(const std::string &path) const;
+
+    /**
+     * Write the .terrain file.
+     *
+     * @param path The path of the file.
+     * @param heightmapPath The path of the heightmap.
+     * @param normalMapPath The path of the normal map.
+     * @param splatMap The texture layers.
+     * @param splatPaths The path of each splat texture.
+     * @return bool
+     **/
+    bool saveDescriptor(const std::string &path, const std::string &heightmapPath, const std::string &normalMapPath,
+                        const SplatMap &splatMap, const std::vector<std::string> &splatPaths) const;
+
+    /**
+     * Make a name for a layer from the file name of its image, with anything but letters and digits replaced.
+     *
+     * @param texturePath The path of the image.
+     * @param layer The layer index, used when the file name gives nothing.
+     * @return std::string
+     **/
+    static std::string getLayerName(const std::string &texturePath, unsigned int layer);
+
+    /**
+     * The job system to work on, or NULL.
+     **/
+    JobSystem *_jobSystem;
+
+    /**
+     * The size of a patch, in height field cells.
+     **/
+    unsigned int _patchSize;
+
+    /**
+     * The number of levels of detail.
+     **/
+    unsigned int _detailLevels;
+
+    /**
+     * The height of the skirts around the patches.
+     **/
+    float _skirtScale;
+
+    /**
+     * The height array being exported.
+     **/
+    const float *_heights;
+
+    /**
+     * The size of one side of the height field being exported.
+     **/
+    unsigned int _size;
+
+    /**
+     * The scale of the terrain being exported.
+     **/
+    Vector3 _scale;
+
+    /**
+     * The lowest height in the height field.
+     **/
+    float _lowest;
+
+    /**
+     * The highest height in the height field.
+     **/
+    float _highest;
+};
+
+#endif // TERRAINEXPORTER_H
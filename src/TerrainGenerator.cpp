@@ -19,7 +19,14 @@
 #include "TerrainGenerator.h"
 #include "DiamondSquareNoise.h"
 #include "SimplexNoise.h"
-#include "LodePNG.h"
+#include "NoiseGraph.h"
+#include "DomainWarpNoise.h"
+#include "WorleyNoise.h"
+#include "HydraulicErosion.h"
+#include "ThermalErosion.h"
+#include "DropletErosion.h"
+#include "MeshExporter.h"
+#include "TerrainExporter.h"
 
 #if WIN32
 #include <time.h>
@@ -31,20 +38,129 @@
 #include <stdlib.h>
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+/**
+ * The steepest slope (in degrees) left alone by thermal erosion.
+ **/
+static const float TALUS_ANGLE = 35.0f;
+
+/**
+ * The largest and smallest sizes of the quick terrain previews.
+ **/
+static const unsigned int MAX_PREVIEW_SIZE = 128;
+static const unsigned int MIN_PREVIEW_SIZE = 64;
+
+/**
+ * Previews slower than this (in milliseconds) drop to a lower resolution.
+ **/
+static const double PREVIEW_BUDGET = 60.0;
+
+/**
+ * The number of rows in each background job refining a preview. Small enough that one job is a
+ * short slice of a frame when the jobs have to run on the main thread.
+ **/
+static const unsigned int REFINE_BAND_ROWS = 16;
+
+/**
+ * Height fields at least this size are shown coarse to fine when they are built.
+ **/
+static const unsigned int COARSE_TO_FINE_SIZE = 512;
+
+/**
+ * Add a rect to a list of rects that do not overlap, merging it with any it overlaps.
+ **/
+static void addDirtyRect(std::vector<DirtyRect> &rects, DirtyRect rect)
+{
+    unsigned int i = 0;
+    
+    if (rect.isEmpty()) {
+        return;
+    }
+    while (i < rects.size()) {
+        if (rects[i].overlaps(rect)) {
+            // The merged rect is bigger, so it has to be checked against the whole list again.
+            rect.merge(rects[i]);
+            rects.erase(rects.begin() + i);
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    rects.push_back(rect);
+}
+
+/**
+ * Build the noise graph for the fractal noise type - rolling hills, with warped ridged
+ * mountains blended in wherever a large scale mask is high.
+ **/
+static INoiseAlgorithm* createFractalNoise()
+{
+    NoiseGraph *graph = new NoiseGraph();
+
+    int hills = graph->addFractal(NoiseGraph::FBM, 3.0f, 6, 2.0f, 0.5f, 1);
+    int lowlands = graph->addScaleBias(hills, 0.35f, -0.45f);
+
+    int ridges = graph->addFractal(NoiseGraph::RIDGED, 2.5f, 8, 2.1f, 0.5f, 2);
+    int warpX = graph->addFractal(NoiseGraph::FBM, 4.0f, 3, 2.0f, 0.5f, 3);
+    int warpZ = graph->addFractal(NoiseGraph::FBM, 4.0f, 3, 2.0f, 0.5f, 4);
+    int mountains = graph->addWarp(ridges, warpX, warpZ, 0.04f);
+
+    std::vector<Vector2> maskCurve;
+    maskCurve.push_back(Vector2(-0.1f, 0.0f));
+    maskCurve.push_back(Vector2(0.15f, 0.6f));
+    maskCurve.push_back(Vector2(0.35f, 1.0f));
+    int mask = graph->addCurve(graph->addFractal(NoiseGraph::FBM, 1.0f, 3, 2.0f, 0.5f, 5), maskCurve);
+
+    graph->setOutput(graph->addBlend(NoiseGraph::LERP, lowlands, mountains, mask));
+    return graph;
+}
 
 TerrainGenerator::TerrainGenerator() :
 _terrain(NULL), 
+_heightField(NULL),
 _heightFieldSize(256),
 _patchSize(32),
 _detailLevels(3),
 _seed(0),
+_worldTile(false),
+_worldTileX(0),
+_worldTileZ(0),
 _terrainScale(Vector3(2000, 300, 2000)),
 _skirtScale(3.0f),
 _minHeight(0.0f),
 _maxHeight(150.0f),
 _isDirty(true),
 _blendResolution(1024),
-_noiseType(Simplex)
+_noiseType(Simplex),
+_erosionIterations(0),
+_thermalIterations(0),
+_erosionDroplets(0),
+_samplerVersion((unsigned int) -1),
+_jobSystem(NULL),
+_splatMap(_blendResolution),
+_normalMap(1024),
+_lightMap(1024),
+_stroking(false),
+_strokeType(RaiseBrush),
+_strokeSpacing(0.25f),
+_strokeRadius(0),
+_strokeStep(1),
+_strokeDistance(0),
+_strokeX(0),
+_strokeZ(0),
+_strokeTarget(0),
+_stampMode(HeightStamp::ADD),
+_stampRotation(0),
+_stampHeight(40.0f),
+_symmetry(NoSymmetry),
+_symmetryWays(2),
+_coarseHeightField(NULL),
+_terrainVersion(0),
+_showingPreview(false),
+_previewSize(MAX_PREVIEW_SIZE),
+_refinedWorldTile(false)
 {
 
 #ifdef WIN32
@@ -57,90 +173,81 @@ _noiseType(Simplex)
     gettimeofday(&time, NULL);
 #endif
     
-    // The file name changes each time they are generated to prevent caching.
-    _layer1BlendFile[0] = '\0';
-    _layer2BlendFile[0] = '\0';
+    SplatRule dirt, rock;
     
+    // Dirt fades in with height.
+    dirt.minHeight = 1.0f;
+    dirt.heightFalloff = 1.0f;
+    // Rock fades in on slopes up to 45 degrees.
+    rock.minSlope = 1.0f;
+    rock.slopeFalloff = 1.0f;
+    
+    _splatMap.addLayer("res/common/terrain/grass.dds", Vector2(50, 50), SplatRule());
+    _splatMap.addLayer("res/common/terrain/dirt.dds", Vector2(50, 50), dirt);
+    _splatMap.addLayer("res/common/terrain/rock.dds", Vector2(50, 50), rock);
 }
 
 void TerrainGenerator::createTransparentBlendImages()
 {
-    std::vector<unsigned char> blend1, blend2;
-    unsigned int x, z, k, k1, k2, k3, k4;
-    float worldx, worldz, worldy, intensity;
-    float worldminx = _terrain->getBoundingBox().min.x;
-    float worldminz = _terrain->getBoundingBox().min.z;
-    float worldmaxx = _terrain->getBoundingBox().max.x;
-    float worldmaxz = _terrain->getBoundingBox().max.z;
-    float terrainminheight = 0.0f, terrainmaxheight = 0.0f;
-    blend1.resize(_blendResolution * _blendResolution * 4);
-    blend2.resize(_blendResolution * _blendResolution * 4);
-    
-     for (x = 0; x < _blendResolution; x++) {
-        for (z = 0; z < _blendResolution; z++) {
-            k = 4 * x + (z * _blendResolution * 4);
-           
-            worldx = ((float)x / (float)_blendResolution) * (worldmaxx - worldminx) + worldminx;
-            worldz = ((float)z / (float)_blendResolution) * (worldmaxz - worldminz) + worldminz;
-            worldy = _terrain->getHeight(worldx, worldz);
-            
-            // In the first pass we determine the min and max for the entire terrain.
-            if (worldy < terrainminheight || (x == 0 && z == 0)) {
-                terrainminheight = worldy;
-            }
+    // The splat map works straight from the height array.
+    _splatMap.generate(_heightField->getArray(), _heightFieldSize, _terrainScale);
+    
+    this->saveTextures();
+}
 
-            if (worldy > terrainmaxheight || (x == 0 && z == 0)) {
-                terrainmaxheight = worldy;
-            }
-            
-            // And work out the value for the purely slope based map.
-            worldy = _terrain->getHeight(worldx, worldz);
-            intensity = abs(_terrain->getHeight(worldx-100, worldz) - worldy);
-            intensity += abs(_terrain->getHeight(worldx+100, worldz) - worldy);
-            intensity += abs(_terrain->getHeight(worldx, worldz-100) - worldy);
-            intensity += abs(_terrain->getHeight(worldx, worldz+100) - worldy);
-            intensity /= 400.0f;
-            if (intensity > 1.0f) {
-                intensity = 1.0f;
-            }
-            intensity *= 254;
-            blend2[k] = intensity;
-            blend2[k+1] = intensity;
-            blend2[k+2] = intensity;
-            blend2[k+3] = intensity;
-        }
-     }
+void TerrainGenerator::createTransparentBlendImages(const std::vector<DirtyRect> &cells)
+{
+    unsigned int i;
     
-    // Layer 1 is determined purely by the height.
-    for (x = 0; x < _blendResolution; x++) {
-        for (z = 0; z < _blendResolution; z++) {
-            k = 4 * x + (z * _blendResolution * 4);
-            
-            // Purely height based.
-            worldx = ((float)x / (float)_blendResolution) * (worldmaxx - worldminx) + worldminx;
-            worldz = ((float)z / (float)_blendResolution) * (worldmaxz - worldminz) + worldminz;
-            worldy = _terrain->getHeight(worldx, worldz);
-            worldy -= terrainminheight;
-            worldy /= (float)(terrainmaxheight - terrainminheight);
-            intensity = 254 * worldy;
-            
-            blend1[k] = intensity;
-            blend1[k+1] = intensity;
-            blend1[k+2] = intensity;
-            blend1[k+3] = intensity;
-            
-            // Average the slope blends (a bit smoother).
-            k1 = 4 * ((x-1) % _blendResolution) + (z * _blendResolution * 4);
-            k2 = 4 * ((x+1) % _blendResolution) + (z * _blendResolution * 4);
-            k3 = 4 * (x) + (((z-1) % _blendResolution) * _blendResolution * 4);
-            k4 = 4 * (x) + (((z+1) % _blendResolution) * _blendResolution * 4);
-            blend2[k] = (blend2[k] + blend2[k1] + blend2[k2] + blend2[k3] + blend2[k4]) / 5.0f;
-            blend2[k+1] = blend2[k+2] = blend2[k+3] = blend2[k];
-            
-        }
+    for (i = 0; i < cells.size(); i++) {
+        _splatMap.generate(_heightField->getArray(), _heightFieldSize, _terrainScale, cells[i]);
+    }
+    
+    this->saveTextures();
+}
+
+void TerrainGenerator::setJobSystem(JobSystem *jobSystem)
+{
+    _jobSystem = jobSystem;
+    _splatMap.setJobSystem(jobSystem);
+    _normalMap.setJobSystem(jobSystem);
+    _lightMap.setJobSystem(jobSystem);
+}
+
+void TerrainGenerator::parallelRows(unsigned int begin, unsigned int end, const JobSystem::RangeTask &task)
+{
+    if (_jobSystem) {
+        _jobSystem->parallelFor(begin, end, 4, task);
+    } else {
+        task(begin, end);
     }
+}
 
+void TerrainGenerator::parallelTiles(const DirtyRect &cells, const JobSystem::TileTask &task)
+{
+    if (_jobSystem) {
+        _jobSystem->parallelFor2D(cells, 64, task);
+    } else if (!cells.isEmpty()) {
+        task(cells);
+    }
+}
+
+void TerrainGenerator::getBrushCircle(float x, float z, float scale, float &localx, float &localz, float &localscale) const
+{
+    GP_ASSERT(_heightField->getColumnCount() > 0);
+    GP_ASSERT(_heightField->getRowCount() > 0);
+
+    // Since the specified coordinates are in world space, they are mapped back
+    // into local heightfield coordinates for indexing into the height array.
+    const HeightSampler &sampler = this->getHeightSampler();
+    sampler.toGrid(x, z, localx, localz);
+    localscale = sampler.toGridDistance(scale);
+}
+
+void TerrainGenerator::saveTextures()
+{
     // Generate a new tmp folder for the blend images.
+    // The file name changes each time they are generated to prevent caching.
 #if WIN32
 	char tmpdir[] = "res/tmp/fileXXXXXX";
 	//_mktemp_s(tmpdir,sizeof(tmpdir));
@@ -153,281 +260,908 @@ void TerrainGenerator::createTransparentBlendImages()
 
 #endif
     
-    if (_layer1BlendFile[0] != '\0') {
-        // Delete old blend files
-        remove(_layer1BlendFile);
-        remove(_layer2BlendFile);
-    }
+    // Generate the pngs (this deletes the old ones).
+    _splatMap.save(tmpdir);
+    _normalMap.save(tmpdir);
+}
 
-    sprintf(_layer1BlendFile, "%s/blend1.png", tmpdir);
-    sprintf(_layer2BlendFile, "%s/blend2.png", tmpdir);
+BrushStamp& TerrainGenerator::getBrush()
+{
+    return _brush;
+}
 
-    // Generate the pngs.
-    lodepng::encode(_layer1BlendFile, blend1, _blendResolution, _blendResolution);
+void TerrainGenerator::paint(float x, float z, float scale, TextureLayer layer, float strength)
+{
+    float cols = _heightField->getColumnCount();
+ 
+    GP_ASSERT(cols > 0);
+    GP_ASSERT(_heightField->getRowCount() > 0);
+
+    // Since the specified coordinates are in world space, they are mapped back
+    // into local heightfield coordinates, and then scaled to splat map texels.
+    const HeightSampler &sampler = this->getHeightSampler();
+    float localx, localz;
+    sampler.toGrid(x, z, localx, localz);
+    float texelScale = (float)(_splatMap.getResolution() - 1) / (cols - 1);
+    
+    std::vector<Vector2> sites;
+    this->getSymmetricSites(localx, localz, sites);
+    float localscale = sampler.toGridDistance(scale) * texelScale;
+    
+    unsigned int i;
+    for (i = 0; i < sites.size(); i++) {
+        _splatMap.paint(layer, sites[i].x * texelScale, sites[i].y * texelScale, localscale, strength);
+    }
     
-    lodepng::encode(_layer2BlendFile, blend2, _blendResolution, _blendResolution);
+    // The terrain mesh hasn't changed, only the textures.
+    this->saveTextures();
+    _splatMap.apply(_terrain);
 }
 
 
-const Matrix& TerrainGenerator::getInverseWorldMatrix() const
+bool TerrainGenerator::exportMesh(const std::string &path, float maxError, unsigned int targetTriangles)
 {
-    _inverseWorldMatrix.set(_terrain->getNode()->getWorldMatrix());
+    MeshExporter exporter;
     
-    // Apply local scale and invert
-    _inverseWorldMatrix.scale(_terrainScale);
-    _inverseWorldMatrix.invert();
+    // Nothing from the current stroke is left out.
+    this->flushStroke();
     
-    return _inverseWorldMatrix;
+    exporter.setMaxError(maxError);
+    exporter.setTargetTriangles(targetTriangles);
+    if (!exporter.save(path, _heightField->getArray(), _heightFieldSize, _terrainScale)) {
+        GP_WARN("Could not export the terrain mesh to %s.", path.c_str());
+        return false;
+    }
+    return true;
 }
 
-void TerrainGenerator::flatten(float x, float z, float scale)
+bool TerrainGenerator::exportTerrain(const std::string &path)
 {
-    float cols = _heightField->getColumnCount();
-    float rows = _heightField->getRowCount();
-    float *usedHeights = _heightField->getArray();
-    unsigned int i, j, repeats;
- 
-    GP_ASSERT(cols > 0);
-    GP_ASSERT(rows > 0);
-
-    // Since the specified coordinates are in world space, we need to use the 
-    // inverse of our world matrix to transform the world x,z coords back into
-    // local heightfield coordinates for indexing into the height array.
-    Vector3 v = getInverseWorldMatrix() * Vector3(x, 0.0f, z);
-    Vector3 s = getInverseWorldMatrix() * Vector3(scale, 0.0f, 0.0f);
-    float average = this->average(x, z, scale);
-   
-    float localx = v.x + (cols - 1) * 0.5f;
-    float localz = v.z + (rows - 1) * 0.5f;
-    float localscale = s.x;
-  
-    for (i = 0; i < _heightFieldSize; i++) {
-        for (j = 0; j < _heightFieldSize; j++) {
-            float dist = this->distanceFromCenter((float)i, (float)j, localx, localz);
-            
-            float strength = (localscale*0.9f) - dist;
-            
-            if (strength > 0) {
-                usedHeights[i + (j * _heightFieldSize)] = average;
-            }
-        }
+    TerrainExporter exporter;
+    
+    // Nothing from the current stroke is left out.
+    this->flushStroke();
+    
+    if (!_lightMap.isBaked()) {
+        _lightMap.bake(_heightField->getArray(), _heightFieldSize, _terrainScale);
+    }
+    
+    exporter.setJobSystem(_jobSystem);
+    exporter.setLevelOfDetail(_patchSize, _detailLevels, _skirtScale);
+    if (!exporter.save(path, _heightField->getArray(), _heightFieldSize, _terrainScale, _splatMap, _normalMap, _lightMap)) {
+        GP_WARN("Could not export the terrain to %s.", path.c_str());
+        return false;
     }
+    return true;
+}
 
+void TerrainGenerator::bakeLightMap()
+{
+    this->flushStroke();
+    _lightMap.bake(_heightField->getArray(), _heightFieldSize, _terrainScale);
+}
 
-    this->smooth(x, z, scale);
+bool TerrainGenerator::saveLightMap(const std::string &path)
+{
+    this->flushStroke();
+    if (!_lightMap.isBaked()) {
+        _lightMap.bake(_heightField->getArray(), _heightFieldSize, _terrainScale);
+    }
+    if (!_lightMap.exportTexture(path)) {
+        GP_WARN("Could not save the light map to %s.", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+void TerrainGenerator::setSun(float azimuth, float elevation)
+{
+    _lightMap.setSun(MATH_DEG_TO_RAD(azimuth), MATH_DEG_TO_RAD(elevation));
+}
+
+const HeightSampler& TerrainGenerator::getHeightSampler() const
+{
+    Node *node = _terrain ? _terrain->getNode() : NULL;
+    const Matrix &worldMatrix = node ? node->getWorldMatrix() : Matrix::identity();
     
+    // The full height field is sampled even while a coarse one is shown, it covers the same area.
+    if (_samplerVersion != _terrainVersion || memcmp(worldMatrix.m, _samplerWorldMatrix.m, sizeof(worldMatrix.m)) != 0) {
+        _samplerWorldMatrix.set(worldMatrix);
+        _samplerVersion = _terrainVersion;
+        _heightSampler.set(_heightField ? _heightField->getArray() : NULL, _heightFieldSize, _terrainScale, worldMatrix);
+    }
+    return _heightSampler;
+}
+
+void TerrainGenerator::flatten(float x, float z, float scale)
+{
+    this->beginStroke(FlattenBrush, x, z, scale);
+    this->endStroke();
 }
 
 float TerrainGenerator::average(float x, float z, float scale)
 {
-    float cols = _heightField->getColumnCount();
-    float rows = _heightField->getRowCount();
-    float *usedHeights = _heightField->getArray();
-    unsigned int i, j, repeats;
- 
-    GP_ASSERT(cols > 0);
-    GP_ASSERT(rows > 0);
-
-    // Since the specified coordinates are in world space, we need to use the 
-    // inverse of our world matrix to transform the world x,z coords back into
-    // local heightfield coordinates for indexing into the height array.
-    Vector3 v = getInverseWorldMatrix() * Vector3(x, 0.0f, z);
-    Vector3 s = getInverseWorldMatrix() * Vector3(scale, 0.0f, 0.0f);
-    
-    float localx = v.x + (cols - 1) * 0.5f;
-    float localz = v.z + (rows - 1) * 0.5f;
-    float localscale = s.x;
-  
-    float average = 0.0f;
-    unsigned int count = 0;
-
-    for (i = 0; i < _heightFieldSize; i++) {
-        for (j = 0; j < _heightFieldSize; j++) {
-            float dist = this->distanceFromCenter((float)i, (float)j, localx, localz);
-            
-            float strength = localscale - dist;
-            
-            if (strength > 0) {
-                average += usedHeights[i + (j * _heightFieldSize)];
-                count++;
-            }
-        }
-    }
+    float localx, localz, localscale;
+    
+    this->getBrushCircle(x, z, scale, localx, localz, localscale);
+    
+    // Weighted by the brush, so the middle counts the most.
+    return _brush.average(_heightField->getArray(), _heightFieldSize, localx, localz, localscale);
+}
 
-    if (count == 0) {
-        count = 1;
+void TerrainGenerator::updateTerrain()
+{
+    _normalMap.generate(_heightField->getArray(), _heightFieldSize, _terrainScale);
+    if (_lightMap.isBaked()) {
+        _lightMap.bake(_heightField->getArray(), _heightFieldSize, _terrainScale);
     }
-    return average / count;
+    this->createTransparentBlendImages();
+    this->replaceTerrain();
 }
 
+void TerrainGenerator::updateTerrain(const DirtyRect &cells)
+{
+    this->updateTerrain(std::vector<DirtyRect>(1, cells));
+}
 
-void TerrainGenerator::updateTerrain()
+void TerrainGenerator::updateTerrain(const std::vector<DirtyRect> &cells)
+{
+    unsigned int i;
+    
+    for (i = 0; i < cells.size(); i++) {
+        _normalMap.generate(_heightField->getArray(), _heightFieldSize, _terrainScale, cells[i]);
+        if (_lightMap.isBaked()) {
+            _lightMap.bake(_heightField->getArray(), _heightFieldSize, _terrainScale, cells[i]);
+        }
+    }
+    this->createTransparentBlendImages(cells);
+    this->replaceTerrain();
+}
+
+void TerrainGenerator::replaceTerrain()
 {
     Node *node = NULL;
+    Terrain *oldTerrain = _terrain;
     
     if (_terrain) {
         node = _terrain->getNode();
     }
    
-    // SAFE_RELEASE(_terrain);
     _terrain = Terrain::create(_heightField, 
                                _terrainScale, 
                                _patchSize,
                                _detailLevels, 
                                _skirtScale, 
-                               NULL,
+                               _normalMap.getPath(),
                                NULL);
     
-    this->createTransparentBlendImages();
-    
-    _terrain->setLayer(0, "res/common/terrain/grass.dds", Vector2(50, 50));
-    _terrain->setLayer(1, "res/common/terrain/dirt.dds", Vector2(50, 50), _layer1BlendFile, 3);
-    _terrain->setLayer(2, "res/common/terrain/rock.dds", Vector2(50, 50), _layer2BlendFile, 3);
+    // The layers pack their blend weights into the channels of shared splat textures.
+    _splatMap.apply(_terrain);
     
     if (node) {
         node->setTerrain(_terrain);
     }
+    // The node has let go of the old terrain, so this frees it.
+    SAFE_RELEASE(oldTerrain);
+    
+    _terrainVersion++;
+    SAFE_RELEASE(_coarseHeightField);
 }
 
 
 void TerrainGenerator::smooth(float x, float z, float scale)
 {
-    float cols = _heightField->getColumnCount();
-    float rows = _heightField->getRowCount();
+    this->beginStroke(SmoothBrush, x, z, scale);
+    this->endStroke();
+}
+
+void TerrainGenerator::lower(float x, float z, float scale)
+{
+    this->beginStroke(LowerBrush, x, z, scale);
+    this->endStroke();
+}
+
+void TerrainGenerator::raise(float x, float z, float scale)
+{
+    this->beginStroke(RaiseBrush, x, z, scale);
+    this->endStroke();
+}
+
+void TerrainGenerator::erode(float x, float z, float scale)
+{
+    this->beginStroke(ErodeBrush, x, z, scale);
+    this->endStroke();
+}
+
+void TerrainGenerator::thermalErode(float x, float z, float scale)
+{
+    this->beginStroke(CrumbleBrush, x, z, scale);
+    this->endStroke();
+}
+
+void TerrainGenerator::terrace(float x, float z, float scale)
+{
+    this->beginStroke(TerraceBrush, x, z, scale);
+    this->endStroke();
+}
+
+void TerrainGenerator::roughen(float x, float z, float scale)
+{
+    this->beginStroke(NoiseBrush, x, z, scale);
+    this->endStroke();
+}
+
+void TerrainGenerator::sharpen(float x, float z, float scale)
+{
+    this->beginStroke(SharpenBrush, x, z, scale);
+    this->endStroke();
+}
+
+void TerrainGenerator::limitSlope(float x, float z, float scale)
+{
+    this->beginStroke(SlopeBrush, x, z, scale);
+    this->endStroke();
+}
+
+void TerrainGenerator::copyCells(const DirtyRect &cells, std::vector<float> &copy) const
+{
+    const float *usedHeights = _heightField->getArray();
+    unsigned int j;
+    
+    copy.clear();
+    for (j = cells.minZ; j <= (unsigned int)cells.maxZ; j++) {
+        copy.insert(copy.end(), usedHeights + cells.minX + j * _heightFieldSize, usedHeights + cells.maxX + 1 + j * _heightFieldSize);
+    }
+}
+
+void TerrainGenerator::pasteCells(const DirtyRect &cells, const std::vector<float> &copy)
+{
     float *usedHeights = _heightField->getArray();
-    unsigned int i, j, repeats;
-    unsigned int iminus, iplus, jminus, jplus;
- 
-    GP_ASSERT(cols > 0);
-    GP_ASSERT(rows > 0);
-
-    // Since the specified coordinates are in world space, we need to use the 
-    // inverse of our world matrix to transform the world x,z coords back into
-    // local heightfield coordinates for indexing into the height array.
-    Vector3 v = getInverseWorldMatrix() * Vector3(x, 0.0f, z);
-    Vector3 s = getInverseWorldMatrix() * Vector3(scale, 0.0f, 0.0f);
-    
-    float localx = v.x + (cols - 1) * 0.5f;
-    float localz = v.z + (rows - 1) * 0.5f;
-    float localscale = s.x;
-  
-    for (repeats = 0; repeats < 2; repeats++) {
-        for (i = 0; i < _heightFieldSize; i++) {
-            for (j = 0; j < _heightFieldSize; j++) {
-                float dist = this->distanceFromCenter((float)i, (float)j, localx, localz);
-                
-                float strength = localscale - dist;
-                
-                if (strength > 0) {
-                    iminus = i - 1;
-                    iplus = i + 1;
-                    jminus = j - 1;
-                    jplus = j + 1;
-                    if (iminus >= _heightFieldSize) {
-                        iminus = 0;
-                    }
-                    if (jminus >= _heightFieldSize) {
-                        jminus = 0;
-                    }                    
-                    if (iplus >= _heightFieldSize) {
-                        iplus = _heightFieldSize - 1;
-                    }
-                    if (jplus > _heightFieldSize) {
-                        jplus = _heightFieldSize - 1;
-                    }                    
-                    
-                    usedHeights[i + (j * _heightFieldSize)] = (usedHeights[iminus + (jminus * _heightFieldSize)] +
-                                                            usedHeights[i + (jminus * _heightFieldSize)] +
-                                                            usedHeights[iplus + (jminus * _heightFieldSize)] +
-                                                            usedHeights[iminus + (j * _heightFieldSize)] +
-                                                            usedHeights[i + (j * _heightFieldSize)] +
-                                                            usedHeights[iplus + (j * _heightFieldSize)] +
-                                                            usedHeights[iminus + (jplus * _heightFieldSize)] +
-                                                            usedHeights[i + (jplus * _heightFieldSize)] +
-                                                            usedHeights[iplus + (jplus * _heightFieldSize)]) / 9.0f;
+    unsigned int j;
+    unsigned int width = cells.maxX - cells.minX + 1;
+    
+    for (j = cells.minZ; j <= (unsigned int)cells.maxZ; j++) {
+        memcpy(usedHeights + cells.minX + (j * _heightFieldSize), &copy[(j - cells.minZ) * width], width * sizeof(float));
+    }
+}
+
+float TerrainGenerator::getTalusSlope() const
+{
+    // The talus angle is in world space, the slope is in height units per cell.
+    float slope = tanf(MATH_DEG_TO_RAD(TALUS_ANGLE)) * _terrainScale.x;
+    
+    return _terrainScale.y > 0 ? slope / _terrainScale.y : slope;
+}
+
+void TerrainGenerator::setStrokeSpacing(float spacing)
+{
+    _strokeSpacing = spacing;
+}
+
+float TerrainGenerator::getStrokeSpacing()
+{
+    return _strokeSpacing;
+}
+
+void TerrainGenerator::beginStroke(BrushType type, float x, float z, float scale)
+{
+    float localx, localz, localscale;
+    
+    this->flushStroke();
+    this->getBrushCircle(x, z, scale, localx, localz, localscale);
+    
+    _stroking = true;
+    _strokeType = type;
+    _strokeRadius = localscale;
+    _strokeX = localx;
+    _strokeZ = localz;
+    _strokeStamps.push_back(Vector2(localx, localz));
+    
+    // A brush smaller than a cell still moves a cell at a time.
+    _strokeStep = std::max(localscale * _strokeSpacing, 0.5f);
+    _strokeDistance = _strokeStep;
+    
+    // The whole stroke flattens to the height where it started.
+    if (type == FlattenBrush) {
+        _strokeTarget = _brush.average(_heightField->getArray(), _heightFieldSize, localx, localz, localscale);
+    }
+}
+
+void TerrainGenerator::continueStroke(float x, float z)
+{
+    float localx, localz, localscale;
+    
+    if (!_stroking) {
+        return;
+    }
+    this->getBrushCircle(x, z, 0.0f, localx, localz, localscale);
+    
+    // Stamps go down every step along the path, carrying what is left of a step over to the next segment.
+    float dx = localx - _strokeX, dz = localz - _strokeZ;
+    float length = sqrtf(dx * dx + dz * dz);
+    while (_strokeDistance <= length) {
+        float along = _strokeDistance / length;
+        _strokeStamps.push_back(Vector2(_strokeX + dx * along, _strokeZ + dz * along));
+        _strokeDistance += _strokeStep;
+    }
+    _strokeDistance -= length;
+    _strokeX = localx;
+    _strokeZ = localz;
+}
+
+void TerrainGenerator::endStroke()
+{
+    this->flushStroke();
+    _stroking = false;
+}
+
+void TerrainGenerator::flushStroke()
+{
+    unsigned int i, j;
+    
+    if (_strokeStamps.empty()) {
+        return;
+    }
+    if (_strokeRadius <= 0) {
+        _strokeStamps.clear();
+        return;
+    }
+    
+    // Every stamp is repeated at its symmetric sites. Sites whose cells overlap are applied together,
+    // apart ones (like the mirrored copies) keep separate rects, so the space between them is not touched.
+    std::vector<Vector2> sites;
+    for (i = 0; i < _strokeStamps.size(); i++) {
+        this->getSymmetricSites(_strokeStamps[i].x, _strokeStamps[i].y, sites);
+    }
+    std::vector<DirtyRect> siteCells(sites.size());
+    std::vector<DirtyRect> rects;
+    for (i = 0; i < sites.size(); i++) {
+        siteCells[i] = _brush.getCells(sites[i].x, sites[i].y, _strokeRadius, _heightFieldSize);
+        addDirtyRect(rects, siteCells[i]);
+    }
+    
+    std::vector<Vector2> stamps;
+    for (j = 0; j < rects.size(); j++) {
+        stamps.clear();
+        for (i = 0; i < sites.size(); i++) {
+            if (rects[j].overlaps(siteCells[i])) {
+                stamps.push_back(sites[i]);
+            }
+        }
+        this->applyStamps(rects[j], stamps);
+    }
+    
+    // One rebuild of the terrain for all the sites.
+    _strokeStamps.clear();
+    if (!rects.empty()) {
+        this->updateTerrain(rects);
+    }
+}
+
+void TerrainGenerator::applyStamps(const DirtyRect &cells, const std::vector<Vector2> &stamps)
+{
+    unsigned int i;
+    
+    // All the stamps go into one buffer over the cells they cover, then the heights are changed in a single pass.
+    float *usedHeights = _heightField->getArray();
+    unsigned int width = cells.maxX - cells.minX + 1;
+    unsigned int height = cells.maxZ - cells.minZ + 1;
+    std::vector<float> weights(width * height, 0.0f);
+    
+    if (_strokeType == RaiseBrush || _strokeType == LowerBrush) {
+        float amount = _strokeType == RaiseBrush ? _brush.getStrength() : -_brush.getStrength();
+        for (i = 0; i < stamps.size(); i++) {
+            _brush.accumulate(&weights[0], cells, stamps[i].x, stamps[i].y, _strokeRadius, amount);
+        }
+        this->parallelRows(cells.minZ, cells.maxZ + 1, [&](unsigned int begin, unsigned int end) {
+            unsigned int i, j;
+            for (j = begin; j < end; j++) {
+                const float *changes = &weights[(j - cells.minZ) * width];
+                float *output = usedHeights + cells.minX + (j * _heightFieldSize);
+                for (i = 0; i < width; i++) {
+                    output[i] += changes[i];
                 }
             }
+        });
+    } else {
+        for (i = 0; i < stamps.size(); i++) {
+            _brush.accumulateMax(&weights[0], cells, stamps[i].x, stamps[i].y, _strokeRadius);
+        }
+        
+        // Smoothing twice a stamp softens much more than once, without making the brush slow.
+        std::vector<float> targets;
+        unsigned int passes = _strokeType == SmoothBrush ? 2 : 1;
+        for (i = 0; i < passes; i++) {
+            this->getBrushTargets(_strokeType, cells, targets);
+            BrushStamp::blend(usedHeights, _heightFieldSize, cells, &weights[0], &targets[0]);
         }
     }
+}
+
+void TerrainGenerator::setSymmetry(SymmetryMode mode, unsigned int ways)
+{
+    GP_ASSERT(ways >= 2);
+    _symmetry = mode;
+    _symmetryWays = ways;
+}
+
+TerrainGenerator::SymmetryMode TerrainGenerator::getSymmetry()
+{
+    return _symmetry;
+}
+
+unsigned int TerrainGenerator::getSymmetryWays()
+{
+    return _symmetryWays;
+}
+
+void TerrainGenerator::getSymmetryTransforms(std::vector<SymmetryTransform> &transforms) const
+{
+    SymmetryTransform transform = { 1.0f, 0.0f, 0.0f, 1.0f };
+    unsigned int i;
     
-    this->updateTerrain();
+    transforms.clear();
+    transforms.push_back(transform);
+    
+    if (_symmetry == MirrorX || _symmetry == MirrorXZ) {
+        transform.xx = -1.0f;
+        transforms.push_back(transform);
+    }
+    if (_symmetry == MirrorZ || _symmetry == MirrorXZ) {
+        transform.xx = 1.0f;
+        transform.zz = -1.0f;
+        transforms.push_back(transform);
+    }
+    if (_symmetry == MirrorXZ) {
+        transform.xx = -1.0f;
+        transforms.push_back(transform);
+    }
+    if (_symmetry == RotateSymmetry) {
+        for (i = 1; i < _symmetryWays; i++) {
+            float angle = MATH_PIX2 * i / _symmetryWays;
+            transform.xx = cosf(angle);
+            transform.xz = -sinf(angle);
+            transform.zx = sinf(angle);
+            transform.zz = cosf(angle);
+            transforms.push_back(transform);
+        }
+    }
 }
 
-float TerrainGenerator::distanceFromCenter(float x, float z, float centerx, float centerz) {
-    return sqrtf(powf(x - centerx, 2.0f) + powf(z - centerz, 2.0f));
+void TerrainGenerator::getSymmetricSites(float x, float z, std::vector<Vector2> &sites) const
+{
+    std::vector<SymmetryTransform> transforms;
+    unsigned int i, j;
+    unsigned int first = sites.size();
+    float center = (_heightFieldSize - 1) * 0.5f;
+    float dx = x - center, dz = z - center;
     
+    this->getSymmetryTransforms(transforms);
+    for (i = 0; i < transforms.size(); i++) {
+        const SymmetryTransform &transform = transforms[i];
+        Vector2 site(center + transform.xx * dx + transform.xz * dz, center + transform.zx * dx + transform.zz * dz);
+        
+        // Near the center or on a mirror line the copies land on top of each other, and would add up.
+        for (j = first; j < sites.size(); j++) {
+            if (fabsf(sites[j].x - site.x) < 0.5f && fabsf(sites[j].y - site.y) < 0.5f) {
+                break;
+            }
+        }
+        if (j == sites.size()) {
+            sites.push_back(site);
+        }
+    }
 }
 
-void TerrainGenerator::lower(float x, float z, float scale)
+
+void TerrainGenerator::setStampMode(HeightStamp::Mode mode)
 {
-    float cols = _heightField->getColumnCount();
-    float rows = _heightField->getRowCount();
+    _stampMode = mode;
+}
+
+HeightStamp::Mode TerrainGenerator::getStampMode()
+{
+    return _stampMode;
+}
+
+void TerrainGenerator::setStampRotation(float degrees)
+{
+    _stampRotation = degrees;
+}
+
+float TerrainGenerator::getStampRotation()
+{
+    return _stampRotation;
+}
+
+void TerrainGenerator::setStampHeight(float height)
+{
+    _stampHeight = height;
+}
+
+float TerrainGenerator::getStampHeight()
+{
+    return _stampHeight;
+}
+
+HeightStamp* TerrainGenerator::getHeightStamp(const std::string &path)
+{
+    std::map<std::string, HeightStamp*>::iterator found = _heightStamps.find(path);
+    if (found != _heightStamps.end()) {
+        return found->second;
+    }
+    
+    // Failures are not kept, so a missing file can be fixed and tried again.
+    HeightStamp *heightStamp = new HeightStamp();
+    if (!heightStamp->load(path)) {
+        delete heightStamp;
+        return NULL;
+    }
+    _heightStamps[path] = heightStamp;
+    return heightStamp;
+}
+
+void TerrainGenerator::stamp(const std::string &path, float x, float z, float scale)
+{
+    float localx, localz, localscale;
+    
+    HeightStamp *heightStamp = this->getHeightStamp(path);
+    if (!heightStamp) {
+        return;
+    }
+    this->flushStroke();
+    this->getBrushCircle(x, z, scale, localx, localz, localscale);
+    if (localscale <= 0) {
+        return;
+    }
+    
+    // Each symmetric copy is turned and mirrored along with its position.
+    std::vector<SymmetryTransform> transforms;
+    std::vector<DirtyRect> rects;
+    float center = (_heightFieldSize - 1) * 0.5f;
+    float dx = localx - center, dz = localz - center;
+    unsigned int i;
+    
+    this->getSymmetryTransforms(transforms);
+    for (i = 0; i < transforms.size(); i++) {
+        const SymmetryTransform &transform = transforms[i];
+        float sitex = center + transform.xx * dx + transform.xz * dz;
+        float sitez = center + transform.zx * dx + transform.zz * dz;
+        addDirtyRect(rects, this->stampSite(*heightStamp, sitex, sitez, localscale, transform));
+    }
+    
+    if (!rects.empty()) {
+        this->updateTerrain(rects);
+    }
+}
+
+DirtyRect TerrainGenerator::stampSite(const HeightStamp &heightStamp, float localx, float localz, float localscale, const SymmetryTransform &transform)
+{
+    // The cells under the turned square.
+    float angle = MATH_DEG_TO_RAD(_stampRotation);
+    float c = cosf(angle), s = sinf(angle);
+    float reach = localscale * (fabsf(c) + fabsf(s));
+    DirtyRect cells((int)floorf(localx - reach), (int)floorf(localz - reach), (int)ceilf(localx + reach), (int)ceilf(localz + reach));
+    cells.clip(_heightFieldSize, _heightFieldSize);
+    if (cells.isEmpty()) {
+        return cells;
+    }
+    
     float *usedHeights = _heightField->getArray();
-    unsigned int i, j, repeats;
- 
-    GP_ASSERT(cols > 0);
-    GP_ASSERT(rows > 0);
-
-    // Since the specified coordinates are in world space, we need to use the 
-    // inverse of our world matrix to transform the world x,z coords back into
-    // local heightfield coordinates for indexing into the height array.
-    Vector3 v = getInverseWorldMatrix() * Vector3(x, 0.0f, z);
-    Vector3 s = getInverseWorldMatrix() * Vector3(scale, 0.0f, 0.0f);
-    
-    float localx = v.x + (cols - 1) * 0.5f;
-    float localz = v.z + (rows - 1) * 0.5f;
-    float localscale = s.x;
-  
-    for (i = 0; i < _heightFieldSize; i++) {
-        for (j = 0; j < _heightFieldSize; j++) {
-            float dist = this->distanceFromCenter((float)i, (float)j, localx, localz);
-            
-            float strength = localscale - dist;
-            
-            if (strength > 0) {
-                usedHeights[i + (j * _heightFieldSize)] -= strength;
+    unsigned int width = cells.maxX - cells.minX + 1;
+    float opacity = _brush.getOpacity();
+    float invSide = 0.5f / localscale;
+    float footprint = heightStamp.getSize() * invSide;
+    HeightStamp::Mode mode = _stampMode;
+    float stampHeight = _stampHeight;
+    
+    // Max and replace put the stamp on the ground under the circle, and replace fades out with the brush.
+    float ground = 0.0f;
+    std::vector<float> weights;
+    if (mode != HeightStamp::ADD) {
+        ground = _brush.average(usedHeights, _heightFieldSize, localx, localz, localscale);
+    }
+    if (mode == HeightStamp::REPLACE) {
+        weights.resize(width * (cells.maxZ - cells.minZ + 1), 0.0f);
+        _brush.accumulateMax(&weights[0], cells, localx, localz, localscale);
+    }
+    
+    this->parallelRows(cells.minZ, cells.maxZ + 1, [&](unsigned int begin, unsigned int end) {
+        unsigned int i, j;
+        for (j = begin; j < end; j++) {
+            float *output = usedHeights + (j * _heightFieldSize);
+            float offsetz = j - localz;
+            for (i = cells.minX; i <= (unsigned int)cells.maxX; i++) {
+                // Undo the symmetry, then turn the cell back into the square of the stamp.
+                float offsetx = i - localx;
+                float dx = transform.xx * offsetx + transform.zx * offsetz;
+                float dz = transform.xz * offsetx + transform.zz * offsetz;
+                float u = (dx * c + dz * s) * invSide + 0.5f;
+                float v = (dz * c - dx * s) * invSide + 0.5f;
+                if (u < 0.0f || u > 1.0f || v < 0.0f || v > 1.0f) {
+                    continue;
+                }
+                float value = heightStamp.sample(u, v, footprint) * stampHeight;
+                
+                if (mode == HeightStamp::ADD) {
+                    output[i] += value * opacity;
+                } else if (mode == HeightStamp::MAX) {
+                    output[i] += std::max(ground + value - output[i], 0.0f) * opacity;
+                } else {
+                    output[i] += (ground + value - output[i]) * weights[(i - cells.minX) + (j - cells.minZ) * width];
+                }
             }
         }
-    }
+    });
+    
+    return cells;
+}
 
-    //this->smooth(x, z, scale);
-    this->updateTerrain();
+void TerrainGenerator::getBrushTargets(BrushType type, const DirtyRect &cells, std::vector<float> &targets)
+{
+    switch (type) {
+        case FlattenBrush:
+            // The whole stroke flattens to the height where it started.
+            targets.assign((cells.maxX - cells.minX + 1) * (cells.maxZ - cells.minZ + 1), _strokeTarget);
+            break;
+        case SmoothBrush:
+            this->smoothCells(cells, targets);
+            break;
+        case ErodeBrush:
+        case CrumbleBrush:
+            this->erodeCells(type, cells, targets);
+            break;
+        case TerraceBrush:
+            this->terraceCells(cells, targets);
+            break;
+        case NoiseBrush:
+            this->noiseCells(cells, targets);
+            break;
+        case SharpenBrush:
+            this->sharpenCells(cells, targets);
+            break;
+        case SlopeBrush:
+            this->limitSlopeCells(cells, targets);
+            break;
+        default:
+            this->copyCells(cells, targets);
+            break;
+    }
 }
 
-void TerrainGenerator::raise(float x, float z, float scale)
+void TerrainGenerator::erodeCells(BrushType type, const DirtyRect &cells, std::vector<float> &eroded)
 {
-    float cols = _heightField->getColumnCount();
-    float rows = _heightField->getRowCount();
     float *usedHeights = _heightField->getArray();
-    unsigned int i, j, repeats;
- 
-    GP_ASSERT(cols > 0);
-    GP_ASSERT(rows > 0);
-
-    // Since the specified coordinates are in world space, we need to use the 
-    // inverse of our world matrix to transform the world x,z coords back into
-    // local heightfield coordinates for indexing into the height array.
-    Vector3 v = getInverseWorldMatrix() * Vector3(x, 0.0f, z);
-    Vector3 s = getInverseWorldMatrix() * Vector3(scale, 0.0f, 0.0f);
-    
-    float localx = v.x + (cols - 1) * 0.5f;
-    float localz = v.z + (rows - 1) * 0.5f;
-    float localscale = s.x;
-  
-    for (i = 0; i < _heightFieldSize; i++) {
-        for (j = 0; j < _heightFieldSize; j++) {
-            float dist = this->distanceFromCenter((float)i, (float)j, localx, localz);
+    std::vector<float> original;
+    
+    // The erosion works in place, so erode the heights and put them back after.
+    this->copyCells(cells, original);
+    if (type == ErodeBrush) {
+        // A short run, so the brush stays interactive.
+        HydraulicErosionSettings settings;
+        settings.iterations = 50;
+        HydraulicErosion erosion(settings);
+        erosion.setJobSystem(_jobSystem);
+        erosion.erode(usedHeights, _heightFieldSize, cells);
+    } else {
+        ThermalErosionSettings settings;
+        settings.talusSlope = this->getTalusSlope();
+        ThermalErosion erosion(settings);
+        erosion.setJobSystem(_jobSystem);
+        erosion.erode(usedHeights, _heightFieldSize, cells);
+    }
+    this->copyCells(cells, eroded);
+    this->pasteCells(cells, original);
+}
+
+void TerrainGenerator::terraceCells(const DirtyRect &cells, std::vector<float> &terraced)
+{
+    const float *usedHeights = _heightField->getArray();
+    unsigned int size = _heightFieldSize;
+    unsigned int width = cells.maxX - cells.minX + 1;
+    float step = std::max(_brush.getStrength(), 0.01f);
+    
+    terraced.resize(width * (cells.maxZ - cells.minZ + 1));
+    
+    this->parallelTiles(cells, [&](const DirtyRect &tile) {
+        unsigned int i, j;
+        
+        for (j = tile.minZ; j <= (unsigned int)tile.maxZ; j++) {
+            const float *input = usedHeights + j * size;
+            float *output = &terraced[(j - cells.minZ) * width];
             
-            float strength = localscale - dist;
+            for (i = tile.minX; i <= (unsigned int)tile.maxX; i++) {
+                // Raising the part of each step above the floor to a power leaves a wide flat
+                // shelf with a steep rise at the back.
+                float base = floorf(input[i] / step) * step;
+                float rise = (input[i] - base) / step;
+                rise *= rise;
+                output[i - cells.minX] = base + rise * rise * step;
+            }
+        }
+    });
+}
+
+void TerrainGenerator::noiseCells(const DirtyRect &cells, std::vector<float> &noisy)
+{
+    const float *usedHeights = _heightField->getArray();
+    unsigned int size = _heightFieldSize;
+    unsigned int width = cells.maxX - cells.minX + 1;
+    float strength = _brush.getStrength();
+    
+    noisy.resize(width * (cells.maxZ - cells.minZ + 1));
+    
+    // About four features across the brush. The noise is a function of the cell position alone, so
+    // every stamp of a stroke adds to the same pattern.
+    NoiseGraph graph;
+    float frequency = size / std::max(_strokeRadius * 0.5f, 1.0f);
+    graph.addFractal(NoiseGraph::FBM, frequency, 5, 2.0f, 0.5f, 0);
+    graph.init(size, size, -strength, strength, _seed);
+    
+    // Whole tiles of noise at a time through the bulk noise API, then added row by row.
+    this->parallelTiles(cells, [&](const DirtyRect &tile) {
+        unsigned int tileWidth = tile.maxX - tile.minX + 1;
+        unsigned int tileHeight = tile.maxZ - tile.minZ + 1;
+        std::vector<float> noise(tileWidth * tileHeight);
+        unsigned int i, j;
+        
+        graph.noiseTile(tile.minX, tile.minZ, tileWidth, tileHeight, &noise[0]);
+        for (j = 0; j < tileHeight; j++) {
+            const float *input = usedHeights + tile.minX + (tile.minZ + j) * size;
+            const float *offsets = &noise[j * tileWidth];
+            float *output = &noisy[(tile.minZ + j - cells.minZ) * width + (tile.minX - cells.minX)];
+            
+            for (i = 0; i < tileWidth; i++) {
+                output[i] = input[i] + offsets[i];
+            }
+        }
+    });
+}
+
+void TerrainGenerator::sharpenCells(const DirtyRect &cells, std::vector<float> &sharpened)
+{
+    const float *usedHeights = _heightField->getArray();
+    unsigned int size = _heightFieldSize;
+    unsigned int width = cells.maxX - cells.minX + 1;
+    
+    // An unsharp mask - the difference from the smoothed heights is the detail, add it again.
+    this->smoothCells(cells, sharpened);
+    this->parallelTiles(cells, [&](const DirtyRect &tile) {
+        unsigned int i, j;
+        
+        for (j = tile.minZ; j <= (unsigned int)tile.maxZ; j++) {
+            const float *input = usedHeights + j * size;
+            float *output = &sharpened[(j - cells.minZ) * width];
             
-            if (strength > 0) {
-                usedHeights[i + (j * _heightFieldSize)] += strength;
+            for (i = tile.minX; i <= (unsigned int)tile.maxX; i++) {
+                output[i - cells.minX] = input[i] * 2.0f - output[i - cells.minX];
             }
         }
+    });
+}
+
+void TerrainGenerator::limitSlopeCells(const DirtyRect &cells, std::vector<float> &limited)
+{
+    const float *usedHeights = _heightField->getArray();
+    int size = _heightFieldSize;
+    int width = cells.maxX - cells.minX + 1;
+    float slope = this->getTalusSlope();
+    float diagonal = slope * 1.41421356f;
+    int i, j;
+    
+    this->copyCells(cells, limited);
+    
+    // Cells outside the rect are not changed, read them straight from the heightmap.
+    auto height = [&](int column, int row) -> float {
+        if (column >= cells.minX && column <= cells.maxX && row >= cells.minZ && row <= cells.maxZ) {
+            return limited[(column - cells.minX) + (row - cells.minZ) * width];
+        }
+        return usedHeights[column + row * size];
+    };
+    
+    // Like a distance transform - no cell may be more than a slope above any neighbour, and two sweeps
+    // in opposite directions carry that over any distance. Each sweep only looks back at cells it has done.
+    for (j = cells.minZ; j <= cells.maxZ; j++) {
+        float *output = &limited[(j - cells.minZ) * width];
+        for (i = cells.minX; i <= cells.maxX; i++) {
+            float lowest = output[i - cells.minX];
+            if (i > 0) {
+                lowest = std::min(lowest, height(i - 1, j) + slope);
+            }
+            if (j > 0) {
+                lowest = std::min(lowest, height(i, j - 1) + slope);
+                if (i > 0) {
+                    lowest = std::min(lowest, height(i - 1, j - 1) + diagonal);
+                }
+                if (i + 1 < size) {
+                    lowest = std::min(lowest, height(i + 1, j - 1) + diagonal);
+                }
+            }
+            output[i - cells.minX] = lowest;
+        }
     }
+    for (j = cells.maxZ; j >= cells.minZ; j--) {
+        float *output = &limited[(j - cells.minZ) * width];
+        for (i = cells.maxX; i >= cells.minX; i--) {
+            float lowest = output[i - cells.minX];
+            if (i + 1 < size) {
+                lowest = std::min(lowest, height(i + 1, j) + slope);
+            }
+            if (j + 1 < size) {
+                lowest = std::min(lowest, height(i, j + 1) + slope);
+                if (i + 1 < size) {
+                    lowest = std::min(lowest, height(i + 1, j + 1) + diagonal);
+                }
+                if (i > 0) {
+                    lowest = std::min(lowest, height(i - 1, j + 1) + diagonal);
+                }
+            }
+            output[i - cells.minX] = lowest;
+        }
+    }
+}
 
-    //this->smooth(x, z, scale);
-    this->updateTerrain();
+void TerrainGenerator::smoothCells(const DirtyRect &cells, std::vector<float> &smoothed)
+{
+    const float *usedHeights = _heightField->getArray();
+    unsigned int size = _heightFieldSize;
+    unsigned int width = cells.maxX - cells.minX + 1;
+    
+    smoothed.resize(width * (cells.maxZ - cells.minZ + 1));
+    
+    // Reads from the heights and writes to a separate buffer, so the tiles can be smoothed in any order.
+    this->parallelTiles(cells, [&](const DirtyRect &tile) {
+        unsigned int i, j;
+        
+        for (j = tile.minZ; j <= (unsigned int)tile.maxZ; j++) {
+            const float *above = usedHeights + (j > 0 ? j - 1 : 0) * size;
+            const float *middle = usedHeights + j * size;
+            const float *below = usedHeights + (j + 1 < size ? j + 1 : size - 1) * size;
+            float *output = &smoothed[(j - cells.minZ) * width];
+            
+            for (i = tile.minX; i <= (unsigned int)tile.maxX; i++) {
+                unsigned int iminus = i > 0 ? i - 1 : 0;
+                unsigned int iplus = i + 1 < size ? i + 1 : size - 1;
+                
+                output[i - cells.minX] = (above[iminus] + above[i] + above[iplus] +
+                                          middle[iminus] + middle[i] + middle[iplus] +
+                             below[iminus] + below[i] + below[iplus]) / 9.0f;
+            }
+        }
+    });
+}
+
+void TerrainGenerator::setErosionDroplets(unsigned int droplets)
+{
+    _erosionDroplets = droplets;
+    _isDirty = true;
+}
+
+unsigned int TerrainGenerator::getErosionDroplets()
+{
+    return _erosionDroplets;
+}
+
+void TerrainGenerator::setThermalIterations(unsigned int iterations)
+{
+    _thermalIterations = iterations;
+    _isDirty = true;
+}
+
+unsigned int TerrainGenerator::getThermalIterations()
+{
+    return _thermalIterations;
+}
+
+void TerrainGenerator::setErosionIterations(unsigned int iterations)
+{
+    _erosionIterations = iterations;
+    _isDirty = true;
+}
+
+unsigned int TerrainGenerator::getErosionIterations()
+{
+    return _erosionIterations;
 }
 
 void TerrainGenerator::setNoiseType(TerrainGenerator::NoiseType type)
@@ -436,40 +1170,369 @@ void TerrainGenerator::setNoiseType(TerrainGenerator::NoiseType type)
 }
 
 
+bool TerrainGenerator::NoiseSettings::operator==(const NoiseSettings &other) const
+{
+    return noiseType == other.noiseType && size == other.size &&
+           minHeight == other.minHeight && maxHeight == other.maxHeight && seed == other.seed &&
+           worldTile == other.worldTile && (!worldTile || (worldTileX == other.worldTileX && worldTileZ == other.worldTileZ));
+}
+
+TerrainGenerator::NoiseSettings TerrainGenerator::getNoiseSettings() const
+{
+    NoiseSettings settings;
+    
+    settings.noiseType = _noiseType;
+    settings.size = _heightFieldSize;
+    settings.minHeight = _minHeight;
+    settings.maxHeight = _maxHeight;
+    settings.seed = _seed;
+    settings.worldTile = _worldTile;
+    settings.worldTileX = _worldTileX;
+    settings.worldTileZ = _worldTileZ;
+    return settings;
+}
+
+INoiseAlgorithm* TerrainGenerator::createNoise(NoiseType type)
+{
+    INoiseAlgorithm * noise = NULL;
+    if (type == DiamondSquare) {
+        noise = new DiamondSquareNoise();
+    } else if (type == Fractal) {
+        noise = createFractalNoise();
+    } else if (type == DomainWarp) {
+        noise = new DomainWarpNoise();
+    } else if (type == Cellular || type == CellularCraters || type == CellularRidges) {
+        WorleyNoise *worley = new WorleyNoise();
+        if (type == CellularCraters) {
+            worley->setMode(WorleyNoise::CRATER);
+        } else if (type == CellularRidges) {
+            worley->setMode(WorleyNoise::RIDGE);
+        }
+        noise = worley;
+    } else {
+        noise = new SimplexNoise();
+    }
+    return noise;
+}
+
+void TerrainGenerator::getNoiseOrigin(const NoiseSettings &settings, bool worldTile, double &originX, double &originZ)
+{
+    // Neighbouring tiles share an edge, so each tile starts one cell before the end of the last one.
+    // The coordinates are whole numbers, so every tile computes exactly the same values along the edges.
+    originX = 0;
+    originZ = 0;
+    if (worldTile) {
+        originX = (double) settings.worldTileX * (settings.size - 1);
+        originZ = (double) settings.worldTileZ * (settings.size - 1);
+    }
+}
+
 void TerrainGenerator::buildTerrain()
 {
     
+    // The preview is about to be replaced.
+    this->stopRefining();
+    _showingPreview = false;
     
     if (_heightField) {
         SAFE_RELEASE(_heightField);
     }
     
     _heightField = HeightField::create(_heightFieldSize, _heightFieldSize);
+    _samplerVersion = (unsigned int) -1;
     
-    INoiseAlgorithm * noise = NULL;
-    if (_noiseType == DiamondSquare) {
-        noise = new DiamondSquareNoise();
+    NoiseSettings settings = this->getNoiseSettings();
+    float *usedHeights = _heightField->getArray();
+    bool worldTile;
+    
+    if (!_refinedHeights.empty() && _refinedSettings == settings) {
+        // The preview has already generated this noise.
+        memcpy(usedHeights, &_refinedHeights[0], sizeof(float) * _refinedHeights.size());
+        worldTile = _refinedWorldTile;
     } else {
-        noise = new SimplexNoise();
+        INoiseAlgorithm * noise = createNoise(_noiseType);
+        noise->init(_heightFieldSize, _heightFieldSize, _minHeight, _maxHeight, _seed);
+        
+        worldTile = _worldTile;
+        if (worldTile && !noise->isTileable()) {
+            GP_WARN("This noise type can't be tiled, generating a standalone terrain.");
+            worldTile = false;
+        }
+        
+        double originX, originZ;
+        getNoiseOrigin(settings, worldTile, originX, originZ);
+        
+        // The noise generators only read their state once initialised, so rows can be filled in parallel.
+        this->parallelRows(0, _heightFieldSize, [&](unsigned int begin, unsigned int end) {
+            noise->noiseTile(originX, originZ + begin, _heightFieldSize, end - begin, usedHeights + (begin * _heightFieldSize));
+        });
+        
+        delete noise;
     }
     
-    noise->init(_heightFieldSize, _heightFieldSize, _minHeight, _maxHeight, _seed);
-            
-    float *usedHeights = _heightField->getArray();
+    // Erosion moves material across tile edges, so a tile can't be eroded without its neighbours.
+    if (!worldTile) {
+        this->erodeNewTerrain(usedHeights);
+    } else if (_erosionIterations > 0 || _erosionDroplets > 0 || _thermalIterations > 0) {
+        GP_WARN("Erosion is skipped for world tiles.");
+    }
+    
+    // Painting belongs to the old terrain.
+    _splatMap.clearPaint();
+    _normalMap.generate(usedHeights, _heightFieldSize, _terrainScale);
+    if (_lightMap.isBaked()) {
+        _lightMap.bake(usedHeights, _heightFieldSize, _terrainScale);
+    }
+    this->createTransparentBlendImages();
+    this->replaceTerrainCoarseToFine();
+    
+    _isDirty = false;
     
-    unsigned int i, j, k;
-    for (i = 0; i < _heightFieldSize; i++) {
-        for (j = 0; j < _heightFieldSize; j++) {
-            usedHeights[i + (j * _heightFieldSize)] = noise->noise(i, j);
+}
+
+void TerrainGenerator::buildPreview(const NoiseSettings &settings, const Vector3 &terrainScale)
+{
+    if (settings.size < 2) {
+        return;
+    }
+    this->stopRefining();
+    
+    double start = Game::getAbsoluteTime();
+    
+    // Shared with the refinement jobs, which may outlive this call.
+    std::shared_ptr<INoiseAlgorithm> noise(createNoise(settings.noiseType));
+    bool tileable = noise->isTileable();
+    bool worldTile = settings.worldTile && tileable;
+    double originX, originZ;
+    getNoiseOrigin(settings, worldTile, originX, originZ);
+    
+    unsigned int size = std::min(_previewSize, settings.size);
+    std::vector<float> heights(size * size);
+    if (tileable) {
+        // The noise is a function of position, so sampling the full size noise on a coarse grid
+        // gives a preview with the same shape as the result.
+        noise->init(settings.size, settings.size, settings.minHeight, settings.maxHeight, settings.seed);
+        double spacing = (double)(settings.size - 1) / (size - 1);
+        this->parallelRows(0, size, [&](unsigned int begin, unsigned int end) {
+            unsigned int i, j;
+            for (j = begin; j < end; j++) {
+                for (i = 0; i < size; i++) {
+                    heights[i + (j * size)] = (float) noise->noise(originX + i * spacing, originZ + j * spacing);
+                }
+            }
+        });
+    } else {
+        // Noise built over the whole grid (diamond square) takes as long to set up as to generate,
+        // so it is previewed at the preview size, which only gives the same kind of terrain.
+        noise->init(size, size, settings.minHeight, settings.maxHeight, settings.seed);
+        noise->noiseTile(0, 0, size, size, &heights[0]);
+    }
+    this->showPreview(&heights[0], size, settings.size, terrainScale);
+    
+    // Keep the feedback quick on slow noise types and slow machines.
+    double elapsed = Game::getAbsoluteTime() - start;
+    if (elapsed > PREVIEW_BUDGET && _previewSize > MIN_PREVIEW_SIZE) {
+        _previewSize /= 2;
+    } else if (elapsed < PREVIEW_BUDGET / 8 && _previewSize < MAX_PREVIEW_SIZE) {
+        _previewSize *= 2;
+    }
+    
+    if (size == settings.size) {
+        // Already at full resolution.
+        _refinedSettings = settings;
+        _refinedWorldTile = worldTile;
+        _refinedHeights.swap(heights);
+        return;
+    }
+    if (!tileable || !_jobSystem) {
+        return;
+    }
+    
+    // Each band is its own job, and the jobs only hold shared state, so a cancelled refinement
+    // just skips the bands that have not started yet and the generator can go away at any time.
+    std::shared_ptr<std::atomic<bool> > cancelled(new std::atomic<bool>(false));
+    std::shared_ptr<std::vector<float> > refined(new std::vector<float>(settings.size * settings.size));
+    std::vector<JobSystem::JobHandle> bands;
+    unsigned int fullSize = settings.size;
+    unsigned int begin;
+    
+    for (begin = 0; begin < fullSize; begin += REFINE_BAND_ROWS) {
+        unsigned int end = std::min(begin + REFINE_BAND_ROWS, fullSize);
+        bands.push_back(_jobSystem->submit([=]() {
+            if (!*cancelled) {
+                noise->noiseTile(originX, originZ + begin, fullSize, end - begin, &(*refined)[begin * fullSize]);
+            }
+        }));
+    }
+    
+    JobSystem::JobHandle finished = _jobSystem->submit([]() {}, bands);
+    _jobSystem->then(finished, [=]() {
+        if (*cancelled) {
+            return;
         }
+        _refineCancelled.reset();
+        _refinedSettings = settings;
+        _refinedWorldTile = worldTile;
+        _refinedHeights.swap(*refined);
+        this->showPreview(&_refinedHeights[0], fullSize, fullSize, terrainScale);
+    });
+    _refineCancelled = cancelled;
+}
+
+void TerrainGenerator::showPreview(const float *heights, unsigned int size, unsigned int fullSize, const Vector3 &terrainScale)
+{
+    HeightField *heightField = HeightField::create(size, size);
+    memcpy(heightField->getArray(), heights, sizeof(float) * size * size);
+    
+    // Generating blend maps would take longer than the preview itself.
+    this->showCoarseTerrain(heightField, fullSize, terrainScale, false);
+    _showingPreview = true;
+}
+
+void TerrainGenerator::showCoarseTerrain(HeightField *heightField, unsigned int fullSize, const Vector3 &terrainScale, bool blendLayers)
+{
+    Node *node = NULL;
+    Terrain *oldTerrain = _terrain;
+    unsigned int size = heightField->getColumnCount();
+    
+    if (_terrain) {
+        node = _terrain->getNode();
     }
+    _terrainVersion++;
     
-    delete noise;
+    // Spread the coarse cells over the same area as the full height field.
+    float spacing = (float)(fullSize - 1) / (size - 1);
+    Vector3 scale(terrainScale.x * spacing, terrainScale.y, terrainScale.z * spacing);
     
-    this->updateTerrain();
+    _terrain = Terrain::create(heightField,
+                               scale,
+                               std::min(_patchSize, size - 1),
+                               _detailLevels,
+                               _skirtScale,
+                               blendLayers ? _normalMap.getPath() : NULL,
+                               NULL);
     
-    _isDirty = false;
+    // The blend and normal maps cover the whole terrain whatever its resolution.
+    if (blendLayers) {
+        _splatMap.apply(_terrain);
+    } else {
+        _splatMap.applyBaseLayer(_terrain);
+    }
+    
+    if (node) {
+        node->setTerrain(_terrain);
+    }
+    
+    // The old one is no longer on show. Releasing the old terrain lets go of its height field too.
+    SAFE_RELEASE(oldTerrain);
+    SAFE_RELEASE(_coarseHeightField);
+    _coarseHeightField = heightField;
+}
+
+HeightField* TerrainGenerator::createCoarseHeightField(unsigned int step) const
+{
+    unsigned int fullSize = _heightFieldSize;
+    unsigned int size = (fullSize - 1 + step - 1) / step + 1;
+    float spacing = (float)(fullSize - 1) / (size - 1);
+    const float *heights = _heightField->getArray();
+    HeightField *heightField = HeightField::create(size, size);
+    float *coarseHeights = heightField->getArray();
+    std::vector<unsigned int> columns(size);
+    unsigned int i, j;
+    
+    // The nearest cell to each coarse cell, the edges always land on the edges of the full height field.
+    for (i = 0; i < size; i++) {
+        columns[i] = std::min((unsigned int)(i * spacing + 0.5f), fullSize - 1);
+    }
+    for (j = 0; j < size; j++) {
+        const float *row = heights + (columns[j] * fullSize);
+        for (i = 0; i < size; i++) {
+            coarseHeights[i + (j * size)] = row[columns[i]];
+        }
+    }
+    return heightField;
+}
+
+void TerrainGenerator::replaceTerrainCoarseToFine()
+{
+    if (!_jobSystem || _heightFieldSize < COARSE_TO_FINE_SIZE || _detailLevels < 2) {
+        this->replaceTerrain();
+        return;
+    }
+    
+    // Start with the cell spacing of the coarsest detail level, it only takes a fraction of the time to
+    // build, then halve the spacing each frame until the full terrain is ready.
+    this->showCoarseTerrain(this->createCoarseHeightField(1 << (_detailLevels - 1)), _heightFieldSize, _terrainScale, true);
+    this->refineTerrain(_detailLevels - 2, _terrainVersion);
+}
+
+void TerrainGenerator::refineTerrain(unsigned int level, unsigned int version)
+{
+    _jobSystem->runOnMainThread([=]() {
+        // Anything else replacing the terrain in the meantime stops the refinement.
+        if (_terrainVersion != version) {
+            return;
+        }
+        if (level == 0) {
+            // Still one frame for the whole terrain, the GL buffers can only be made on this thread.
+            this->replaceTerrain();
+            return;
+        }
+        this->showCoarseTerrain(this->createCoarseHeightField(1 << level), _heightFieldSize, _terrainScale, true);
+        this->refineTerrain(level - 1, _terrainVersion);
+    });
+}
+
+void TerrainGenerator::stopRefining()
+{
+    if (_refineCancelled) {
+        *_refineCancelled = true;
+        _refineCancelled.reset();
+    }
+}
+
+void TerrainGenerator::cancelPreview()
+{
+    this->stopRefining();
+    
+    if (_showingPreview) {
+        _showingPreview = false;
+        this->replaceTerrain();
+    }
+}
+
+void TerrainGenerator::erodeNewTerrain(float *usedHeights)
+{
+    if (_erosionIterations > 0) {
+        HydraulicErosionSettings settings;
+        settings.iterations = _erosionIterations;
+        // Don't leave the tool hanging on large maps.
+        settings.maxSeconds = 10.0f;
+        
+        HydraulicErosion erosion(settings);
+        erosion.setJobSystem(_jobSystem);
+        erosion.erode(usedHeights, _heightFieldSize, DirtyRect(0, 0, _heightFieldSize - 1, _heightFieldSize - 1));
+    }
     
+    if (_erosionDroplets > 0) {
+        DropletErosionSettings settings;
+        settings.droplets = _erosionDroplets;
+        settings.seed = _seed;
+        
+        DropletErosion erosion(settings);
+        erosion.setJobSystem(_jobSystem);
+        erosion.erode(usedHeights, _heightFieldSize, DirtyRect(0, 0, _heightFieldSize - 1, _heightFieldSize - 1));
+    }
+    
+    if (_thermalIterations > 0) {
+        ThermalErosionSettings settings;
+        settings.iterations = _thermalIterations;
+        settings.talusSlope = this->getTalusSlope();
+        
+        ThermalErosion erosion(settings);
+        erosion.setJobSystem(_jobSystem);
+        erosion.erode(usedHeights, _heightFieldSize, DirtyRect(0, 0, _heightFieldSize - 1, _heightFieldSize - 1));
+    }
 }
 
 TerrainGenerator::NoiseType TerrainGenerator::getNoiseType()
@@ -508,6 +1571,25 @@ unsigned int TerrainGenerator::getSeed()
     return _seed;
 }
 
+void TerrainGenerator::setWorldTile(int tileX, int tileZ)
+{
+    _worldTile = true;
+    _worldTileX = tileX;
+    _worldTileZ = tileZ;
+}
+
+void TerrainGenerator::clearWorldTile()
+{
+    _worldTile = false;
+    _worldTileX = 0;
+    _worldTileZ = 0;
+}
+
+bool TerrainGenerator::isWorldTile() const
+{
+    return _worldTile;
+}
+
 float TerrainGenerator::getSkirtScale()
 {
     return _skirtScale;
@@ -518,6 +1600,19 @@ Vector3 TerrainGenerator::getTerrainScale()
     return _terrainScale;
 }
 
+void TerrainGenerator::setNormalMapResolution(unsigned int resolution)
+{
+    _normalMap.setResolution(resolution);
+    if (_heightField) {
+        _normalMap.generate(_heightField->getArray(), _heightFieldSize, _terrainScale);
+    }
+}
+
+unsigned int TerrainGenerator::getNormalMapResolution() const
+{
+    return _normalMap.getResolution();
+}
+
 void TerrainGenerator::setDetailLevels(unsigned int detailLevels)
 {
     _detailLevels = detailLevels;
@@ -577,6 +1672,14 @@ Terrain* TerrainGenerator::getTerrain()
 
 TerrainGenerator::~TerrainGenerator()
 {
+    this->stopRefining();
+    
+    std::map<std::string, HeightStamp*>::iterator stamp;
+    for (stamp = _heightStamps.begin(); stamp != _heightStamps.end(); stamp++) {
+        delete stamp->second;
+    }
+    
+    SAFE_RELEASE(_coarseHeightField);
     SAFE_RELEASE(_terrain);
     SAFE_RELEASE(_heightField);
 }
@@ -21,6 +21,16 @@
 #define TERRAINGENERATOR_H
 
 #include "gameplay.h"
+#include "SplatMap.h"
+#include "NormalMap.h"
+#include "LightMap.h"
+#include "DirtyRect.h"
+#include "JobSystem.h"
+#include "INoiseAlgorithm.h"
+#include "BrushStamp.h"
+#include "HeightStamp.h"
+#include "HeightSampler.h"
+#include <map>
 
 using namespace gameplay;
 
@@ -32,9 +42,83 @@ class TerrainGenerator
 public:
     
     /**
-     * All known noise generators.
+     * All known noise generators. Cellular, CellularCraters and CellularRidges are the plateau, crater and
+     * ridge shapes of the Worley noise.
      **/
-    enum NoiseType { Simplex, DiamondSquare };
+    enum NoiseType { Simplex, DiamondSquare, Fractal, DomainWarp, Cellular, CellularCraters, CellularRidges };
+    
+    /**
+     * The texture layers, in the order they are drawn.
+     **/
+    enum TextureLayer { Grass, Dirt, Rock };
+    
+    /**
+     * The sculpting brushes.
+     **/
+    enum BrushType { RaiseBrush, LowerBrush, FlattenBrush, SmoothBrush, ErodeBrush, CrumbleBrush,
+                     TerraceBrush, NoiseBrush, SharpenBrush, SlopeBrush };
+    
+    /**
+     * How edits are repeated around the center of the terrain, for symmetric maps.
+     *
+     * NoSymmetry - edits are only made where they are asked for.
+     * MirrorX - mirrored from left to right.
+     * MirrorZ - mirrored from front to back.
+     * MirrorXZ - mirrored both ways, four copies.
+     * RotateSymmetry - turned around the center, a number of copies evenly spaced.
+     **/
+    enum SymmetryMode { NoSymmetry, MirrorX, MirrorZ, MirrorXZ, RotateSymmetry };
+    
+    /**
+     * Everything that decides the noise heights of a new terrain, before erosion.
+     **/
+    struct NoiseSettings
+    {
+        /**
+         * Which noise generator to use.
+         **/
+        NoiseType noiseType;
+        
+        /**
+         * The size of one side of the height field.
+         **/
+        unsigned int size;
+        
+        /**
+         * Minimum bounds for height values.
+         **/
+        float minHeight;
+        
+        /**
+         * Maximum bounds for height values.
+         **/
+        float maxHeight;
+        
+        /**
+         * Random seed.
+         **/
+        unsigned int seed;
+        
+        /**
+         * Whether the terrain is a tile of a larger world.
+         **/
+        bool worldTile;
+        
+        /**
+         * The tile column.
+         **/
+        int worldTileX;
+        
+        /**
+         * The tile row.
+         **/
+        int worldTileZ;
+        
+        /**
+         * Do two sets of settings give the same heights?
+         **/
+        bool operator==(const NoiseSettings &other) const;
+    };
     
     /**
      * Constructor...
@@ -49,6 +133,34 @@ public:
      **/
     void buildTerrain();
     
+    /**
+     * Show a low resolution preview of a new terrain straight away, then generate the noise at full
+     * resolution in the background and show that once it is ready. Calling this again before then
+     * cancels the old refinement, so dragging a slider only ever waits on the latest values. Noise that
+     * is not a function of position (diamond square) is only previewed at the low resolution.
+     * The preview has no erosion and only the base texture layer. The settings of the generator are
+     * not changed - buildTerrain reuses the refined noise if it is later called with the same settings.
+     *
+     * @param settings The noise settings to preview.
+     * @param terrainScale The scale of the terrain to preview.
+     * @return void
+     **/
+    void buildPreview(const NoiseSettings &settings, const Vector3 &terrainScale);
+    
+    /**
+     * Stop refining the preview and show the current terrain again.
+     *
+     * @return void
+     **/
+    void cancelPreview();
+    
+    /**
+     * Get the current noise settings.
+     *
+     * @return NoiseSettings
+     **/
+    NoiseSettings getNoiseSettings() const;
+    
     /**
      * Called to update the terrain after the heightmap has been modified.
      *
@@ -56,6 +168,24 @@ public:
      **/
     void updateTerrain();
     
+    /**
+     * Called to update the terrain after part of the heightmap has been modified.
+     * Only the blend weights over the modified cells are regenerated.
+     *
+     * @param cells The cells of the heightmap that changed.
+     * @return void
+     **/
+    void updateTerrain(const DirtyRect &cells);
+    
+    /**
+     * Called to update the terrain after several parts of the heightmap have been modified. The blend weights
+     * over each part are regenerated, then the terrain is rebuilt once for all of them.
+     *
+     * @param cells The rects of the heightmap that changed.
+     * @return void
+     **/
+    void updateTerrain(const std::vector<DirtyRect> &cells);
+    
     /**
      * Used to get the current terrain object. Callers should not store a reference to this terrain
      * because it will be deleted and a new terrain generated when the heightmap is modified.
@@ -64,6 +194,23 @@ public:
      **/
     Terrain * getTerrain();
     
+    /**
+     * Get a sampler for height, normal and ray queries against the terrain in world space. It reads the height
+     * array directly and is only set up again when a new terrain is shown or the terrain node moves, so
+     * use it instead of Terrain::getHeight for anything done more than once.
+     *
+     * @return const HeightSampler&
+     **/
+    const HeightSampler& getHeightSampler() const;
+    
+    /**
+     * Set the job system used to generate the heights and blend maps. Without one everything runs on the calling thread.
+     *
+     * @param jobSystem The job system, which must outlive the generator.
+     * @return void
+     **/
+    void setJobSystem(JobSystem *jobSystem);
+    
     /**
      * Destructor
      *
@@ -129,6 +276,32 @@ public:
      **/
     unsigned int getSeed();
     
+    /**
+     * Generate the terrain as one tile of a larger world. Each tile is the size of the height field and shares
+     * its edge rows and columns with its neighbours, which come out exactly the same, so tiles can be generated
+     * separately (even on different machines) and put side by side. Erosion is skipped for tiles because it
+     * depends on the neighbouring tiles. Only noise types that can be sampled anywhere can be tiled.
+     *
+     * @param tileX The tile column, 0 is the tile at the world origin.
+     * @param tileZ The tile row.
+     * @return void
+     **/
+    void setWorldTile(int tileX, int tileZ);
+    
+    /**
+     * Go back to generating a standalone terrain.
+     *
+     * @return void
+     **/
+    void clearWorldTile();
+    
+    /**
+     * Whether the terrain is generated as a tile of a larger world.
+     *
+     * @return bool
+     **/
+    bool isWorldTile() const;
+    
     /**
      * Set the scale vector for the terrain. Will take effect when the terrain is rebuilt.
      *
@@ -144,6 +317,21 @@ public:
      **/
     Vector3 getTerrainScale();
     
+    /**
+     * Set the size of the normal map used to light the terrain. Will take effect when the terrain is rebuilt.
+     *
+     * @param resolution The size of one side of the normal map, at least 2.
+     * @return void
+     **/
+    void setNormalMapResolution(unsigned int resolution);
+    
+    /**
+     * Get the size of the normal map.
+     *
+     * @return unsigned int
+     **/
+    unsigned int getNormalMapResolution() const;
+    
     /**
      * Set the size of the vertical skirts that prevent gaps in the terrain. Will take effect when
      * the terrain is rebuilt.
@@ -206,7 +394,7 @@ public:
     float getMaxHeight();
     
     /**
-     * Flatten a circle of the terrain. The contents of the circle are all brought to the average - and some smoothing is done to the edges.
+     * Flatten a circle of the terrain. The contents of the circle are brought towards the average, following the falloff of the brush.
      *
      * @param x x coordinate for the center of the circle.
      * @param z z coordinate for the center of the circle.
@@ -216,7 +404,7 @@ public:
     void flatten(float x, float z, float scale);
     
     /**
-     * Raise a circle of the terrain. The shape created is something like an egg.
+     * Raise a circle of the terrain by the strength of the brush, following its falloff.
      *
      * @param x x coordinate for the center of the circle.
      * @param z z coordinate for the center of the circle.
@@ -226,7 +414,7 @@ public:
     void raise(float x, float z, float scale);
     
     /**
-     * Lower a circle of the terrain. The shape created is something like an egg (inverted).
+     * Lower a circle of the terrain by the strength of the brush, following its falloff.
      *
      * @param x x coordinate for the center of the circle.
      * @param z z coordinate for the center of the circle.
@@ -246,7 +434,117 @@ public:
     void smooth(float x, float z, float scale);
     
     /**
-     * Helper method to compute the average height for a circle in the terrain.
+     * Run hydraulic erosion over a circle of the terrain. Water is rained on the circle and carves
+     * channels as it runs downhill, with the effect fading out towards the edge.
+     *
+     * @param x x coordinate for the center of the circle.
+     * @param z z coordinate for the center of the circle.
+     * @param scale the radius of the circle
+     * @return void
+     **/
+    void erode(float x, float z, float scale);
+    
+    /**
+     * Crumble the slopes in a circle of the terrain that are steeper than the talus angle, with the
+     * effect fading out towards the edge.
+     *
+     * @param x x coordinate for the center of the circle.
+     * @param z z coordinate for the center of the circle.
+     * @param scale the radius of the circle
+     * @return void
+     **/
+    void thermalErode(float x, float z, float scale);
+    
+    /**
+     * Cut a circle of the terrain into flat steps as high as the strength of the brush, with the
+     * effect fading out towards the edge.
+     *
+     * @param x x coordinate for the center of the circle.
+     * @param z z coordinate for the center of the circle.
+     * @param scale the radius of the circle
+     * @return void
+     **/
+    void terrace(float x, float z, float scale);
+    
+    /**
+     * Add fractal noise as high as the strength of the brush to a circle of the terrain. The features
+     * are sized to the brush, and the noise is fixed in place so overlapping stamps line up.
+     *
+     * @param x x coordinate for the center of the circle.
+     * @param z z coordinate for the center of the circle.
+     * @param scale the radius of the circle
+     * @return void
+     **/
+    void roughen(float x, float z, float scale);
+    
+    /**
+     * Sharpen the contents of a circle on the terrain, the opposite of smooth.
+     *
+     * @param x x coordinate for the center of the circle.
+     * @param z z coordinate for the center of the circle.
+     * @param scale the radius of the circle
+     * @return void
+     **/
+    void sharpen(float x, float z, float scale);
+    
+    /**
+     * Cut back the slopes in a circle of the terrain that are steeper than the talus angle, by lowering the
+     * high side. Unlike crumble the limit is met in a single stamp.
+     *
+     * @param x x coordinate for the center of the circle.
+     * @param z z coordinate for the center of the circle.
+     * @param scale the radius of the circle
+     * @return void
+     **/
+    void limitSlope(float x, float z, float scale);
+    
+    /**
+     * Set the number of hydraulic erosion steps run on a newly generated terrain. 0 turns erosion off.
+     *
+     * @param iterations
+     * @return void
+     **/
+    void setErosionIterations(unsigned int iterations);
+    
+    /**
+     * Get the number of hydraulic erosion steps run on a newly generated terrain.
+     *
+     * @return unsigned int
+     **/
+    unsigned int getErosionIterations();
+    
+    /**
+     * Set the number of water droplets traced over a newly generated terrain to erode it. 0 turns it off.
+     *
+     * @param droplets
+     * @return void
+     **/
+    void setErosionDroplets(unsigned int droplets);
+    
+    /**
+     * Get the number of water droplets traced over a newly generated terrain.
+     *
+     * @return unsigned int
+     **/
+    unsigned int getErosionDroplets();
+    
+    /**
+     * Set the number of thermal erosion sweeps run on a newly generated terrain. 0 turns it off.
+     *
+     * @param iterations
+     * @return void
+     **/
+    void setThermalIterations(unsigned int iterations);
+    
+    /**
+     * Get the number of thermal erosion sweeps run on a newly generated terrain.
+     *
+     * @return unsigned int
+     **/
+    unsigned int getThermalIterations();
+    
+    /**
+     * Helper method to compute the average height for a circle in the terrain, weighted by the brush falloff.
      *
      * @param x x coordinate for the center of the circle.
      * @param z z coordinate for the center of the circle.
@@ -255,102 +553,747 @@ public:
      **/
     float average(float x, float z, float scale);
     
-
-private:
     /**
-     * The file path of the first texture blend map.
+     * Start a brush stroke. The first stamp goes down at the start of the stroke, then one every
+     * stroke spacing along the path given to continueStroke, however far apart the points are.
+     *
+     * @param type The brush.
+     * @param x x coordinate for the center of the circle.
+     * @param z z coordinate for the center of the circle.
+     * @param scale the radius of the circle
+     * @return void
      **/
-    char _layer1BlendFile[2048];
+    void beginStroke(BrushType type, float x, float z, float scale);
     
     /**
-     * The file path of the second texture blend map.
+     * Carry the stroke on to a new point. The stamps are only queued - flushStroke applies them.
+     *
+     * @param x x coordinate for the center of the circle.
+     * @param z z coordinate for the center of the circle.
+     * @return void
      **/
-    char _layer2BlendFile[2048];
+    void continueStroke(float x, float z);
     
     /**
-     * Calculate the real world distance between 2 points. (excluding the y axis)
+     * Apply the queued stamps and finish the stroke.
+     *
+     * @return void
      **/
-    float distanceFromCenter(float x, float z, float centerX, float centerZ);
+    void endStroke();
     
     /**
-     * Used to map from heightmap coordinates to real world coordinates.
+     * Apply the stamps queued since the last flush. Call once a frame while stroking. All the stamps are merged
+     * into one buffer over the rect they cover and the heights are changed in a single pass, then the terrain is
+     * updated once, so the cost depends on the area touched rather than on the number of stamps.
+     *
+     * @return void
      **/
-    const Matrix& getInverseWorldMatrix() const;
+    void flushStroke();
     
     /**
-     * Generate new blend images for the texture mapping. The blend maps are based on characteristics of the terrain like height or slope.
+     * Set the distance between the stamps of a stroke.
+     *
+     * @param spacing The distance as a fraction of the brush radius.
+     * @return void
      **/
-    void createTransparentBlendImages();
-     
+    void setStrokeSpacing(float spacing);
+    
     /**
-     * The current terrain object.
+     * Get the distance between the stamps of a stroke, as a fraction of the brush radius.
+     *
+     * @return float
      **/
-    Terrain *_terrain;
+    float getStrokeSpacing();
     
     /**
-     * The heightmap that generated the terrain.
+     * Repeat every brush stroke, stamp and paint around the center of the terrain.
+     *
+     * @param mode How the edits are repeated.
+     * @param ways The number of copies for RotateSymmetry, at least 2.
+     * @return void
      **/
-    HeightField *_heightField;
+    void setSymmetry(SymmetryMode mode, unsigned int ways = 2);
     
     /**
-     * The resolution of the texture blend maps (they are square)
+     * Get how edits are repeated around the center of the terrain.
+     *
+     * @return SymmetryMode
      **/
-    unsigned int _blendResolution;
+    SymmetryMode getSymmetry();
     
     /**
-     * The resolution of the height map.
+     * Get the number of copies made by RotateSymmetry.
+     *
+     * @return unsigned int
      **/
-    unsigned int _heightFieldSize;
+    unsigned int getSymmetryWays();
     
     /**
-     * The patch size for the generated terrain.
+     * Get the brush used by the sculpting tools, to change its falloff, strength and opacity.
+     *
+     * @return BrushStamp&
      **/
-    unsigned int _patchSize;
+    BrushStamp& getBrush();
     
     /**
-     * The number of detail levels to use in the terrain.
+     * Stamp a pre-made heightmap onto the terrain. The stamp is a square as wide as the circle, turned by the
+     * stamp rotation. Each image is decoded the first time it is stamped and kept for the next time.
+     *
+     * @param path The path to the heightmap image.
+     * @param x x coordinate for the center of the circle.
+     * @param z z coordinate for the center of the circle.
+     * @param scale the radius of the circle
+     * @return void
      **/
-    unsigned int _detailLevels;
+    void stamp(const std::string &path, float x, float z, float scale);
     
     /**
-     * Random seed that gets set before generating the random terrain.
+     * Set how stamps are combined with the terrain.
+     *
+     * @param mode The mode.
+     * @return void
      **/
-    unsigned int _seed;
+    void setStampMode(HeightStamp::Mode mode);
     
     /**
-     * Which noise generator to use.
+     * Get how stamps are combined with the terrain.
+     *
+     * @return HeightStamp::Mode
      **/
-    NoiseType _noiseType;
+    HeightStamp::Mode getStampMode();
     
     /**
-     * Scale of the terrain.
+     * Set the rotation of stamps around the vertical axis.
+     *
+     * @param degrees The rotation in degrees.
+     * @return void
      **/
-    Vector3 _terrainScale;
+    void setStampRotation(float degrees);
     
     /**
-     * Vertical skirt height.
+     * Get the rotation of stamps in degrees.
+     *
+     * @return float
      **/
-    float _skirtScale;
+    float getStampRotation();
     
     /**
-     * Minimum bounds for height values in the terrain.
+     * Set the height of the white parts of a stamp above the ground, in height field units.
+     *
+     * @param height The height.
+     * @return void
      **/
-    float _minHeight;
+    void setStampHeight(float height);
     
     /**
-     * Maximum bounds for height values in the terrain.
+     * Get the height of the white parts of a stamp.
+     *
+     * @return float
      **/
-    float _maxHeight;
+    float getStampHeight();
     
     /**
-     * Triggering isDirty causes the terrain to be regenerated.
+     * Paint a texture layer onto a circle of the terrain.
+     *
+     * @param x x coordinate for the center of the circle.
+     * @param z z coordinate for the center of the circle.
+     * @param scale the radius of the circle
+     * @param layer the texture layer to paint
+     * @param strength how much of the layer to add in the middle of the circle (0 to 1). Negative values erase the layer.
+     * @return void
      **/
-    bool _isDirty;
+    void paint(float x, float z, float scale, TextureLayer layer, float strength);
+    
+    /**
+     * Write the heightmap out as a triangle mesh, PLY if the path ends in .ply and OBJ otherwise.
+     *
+     * @param path The path of the file.
+     * @param maxError The largest height difference allowed between the mesh and the heightmap, in world
+     *                 units. With no target triangle count, 0 writes two triangles for every cell.
+     * @param targetTriangles Stop simplifying at about this many triangles, or 0 for no limit.
+     * @return bool false if the file could not be written.
+     **/
+    bool exportMesh(const std::string &path, float maxError, unsigned int targetTriangles);
+
+    /**
+     * Write the terrain out as a .terrain file the engine can load directly, with a 16 bit heightmap, a
+     * normal map, the splat textures and a baked light map saved next to it.
+     *
+     * @param path The path of the .terrain file, in an existing directory.
+     * @return bool false if any of the files could not be written.
+     **/
+    bool exportTerrain(const std::string &path);
+    
+    /**
+     * Bake the ambient occlusion and sun shadows of the terrain into the light map. Once baked, the light
+     * map is baked again around every edit.
+     *
+     * @return void
+     **/
+    void bakeLightMap();
+    
+    /**
+     * Write the light map to a png file, baking it first if it has not been baked.
+     *
+     * @param path The path of the file.
+     * @return bool false if the file could not be written.
+     **/
+    bool saveLightMap(const std::string &path);
+    
+    /**
+     * Move the sun used for the shadows in the light map.
+     *
+     * @param azimuth The direction of the sun around the y axis in degrees, 0 is along +x and 90 along +z.
+     * @param elevation The angle of the sun above the horizon in degrees.
+     * @return void
+     **/
+    void setSun(float azimuth, float elevation);
+    
+
+private:
+    /**
+     * Generate new blend images for the texture mapping. The blend maps are based on characteristics of the terrain like height or slope.
+     **/
+    void createTransparentBlendImages();
+    
+    /**
+     * Update the blend images over some rects of the heightmap.
+     *
+     * @param cells The rects of the heightmap that changed.
+     * @return void
+     **/
+    void createTransparentBlendImages(const std::vector<DirtyRect> &cells);
+    
+    /**
+     * Create a new terrain from the heightmap and put it in place of the old one.
+     *
+     * @return void
+     **/
+    void replaceTerrain();
+    
+    /**
+     * Map a brush circle from world space to height field cells.
+     *
+     * @param x x coordinate for the center of the circle.
+     * @param z z coordinate for the center of the circle.
+     * @param scale the radius of the circle
+     * @param localx Set to the column of the center.
+     * @param localz Set to the row of the center.
+     * @param localscale Set to the radius in cells.
+     * @return void
+     **/
+    void getBrushCircle(float x, float z, float scale, float &localx, float &localz, float &localscale) const;
+    
+    /**
+     * Run a loop over rows of the heightmap on the job system.
+     *
+     * @param begin The first row.
+     * @param end The row after the last.
+     * @param task Called with bands of rows.
+     * @return void
+     **/
+    void parallelRows(unsigned int begin, unsigned int end, const JobSystem::RangeTask &task);
+    
+    /**
+     * Run a loop over tiles of the heightmap on the job system.
+     *
+     * @param cells The cells to cover.
+     * @param task Called with each tile.
+     * @return void
+     **/
+    void parallelTiles(const DirtyRect &cells, const JobSystem::TileTask &task);
+    
+    /**
+     * Copy a rect of the heightmap.
+     *
+     * @param cells The cells to copy.
+     * @param copy Filled with the heights, a row at a time.
+     * @return void
+     **/
+    void copyCells(const DirtyRect &cells, std::vector<float> &copy) const;
+    
+    /**
+     * Write a copy made by copyCells back into the heightmap.
+     *
+     * @param cells The cells to write.
+     * @param copy The heights, a row at a time.
+     * @return void
+     **/
+    void pasteCells(const DirtyRect &cells, const std::vector<float> &copy);
+    
+    /**
+     * Work out the heights a brush moves a rect of the heightmap towards. Every brush except raise and
+     * lower is one of these - the stroke blends the heights to the targets by the brush, so each brush
+     * only has to fill in the targets over the cells the stroke touched.
+     *
+     * @param type The brush.
+     * @param cells The cells to cover.
+     * @param targets Filled with the target heights, a row at a time.
+     * @return void
+     **/
+    void getBrushTargets(BrushType type, const DirtyRect &cells, std::vector<float> &targets);
+    
+    /**
+     * Box filter a rect of the heightmap.
+     *
+     * @param cells The cells to filter.
+     * @param smoothed Filled with the filtered heights, a row at a time.
+     * @return void
+     **/
+    void smoothCells(const DirtyRect &cells, std::vector<float> &smoothed);
+    
+    /**
+     * Erode a rect of the heightmap, without changing it.
+     *
+     * @param type ErodeBrush for hydraulic erosion, or CrumbleBrush for thermal.
+     * @param cells The cells to erode.
+     * @param eroded Filled with the eroded heights, a row at a time.
+     * @return void
+     **/
+    void erodeCells(BrushType type, const DirtyRect &cells, std::vector<float> &eroded);
+    
+    /**
+     * Cut a rect of the heightmap into steps as high as the brush strength.
+     *
+     * @param cells The cells to cover.
+     * @param terraced Filled with the terraced heights, a row at a time.
+     * @return void
+     **/
+    void terraceCells(const DirtyRect &cells, std::vector<float> &terraced);
+    
+    /**
+     * Add fractal noise sized to the stroke to a rect of the heightmap.
+     *
+     * @param cells The cells to cover.
+     * @param noisy Filled with the heights plus the noise, a row at a time.
+     * @return void
+     **/
+    void noiseCells(const DirtyRect &cells, std::vector<float> &noisy);
+    
+    /**
+     * Push a rect of the heightmap away from its box filtered heights.
+     *
+     * @param cells The cells to cover.
+     * @param sharpened Filled with the sharpened heights, a row at a time.
+     * @return void
+     **/
+    void sharpenCells(const DirtyRect &cells, std::vector<float> &sharpened);
+    
+    /**
+     * Lower the cells of a rect until no slope is steeper than the talus angle.
+     *
+     * @param cells The cells to cover.
+     * @param limited Filled with the limited heights, a row at a time.
+     * @return void
+     **/
+    void limitSlopeCells(const DirtyRect &cells, std::vector<float> &limited);
+    
+    /**
+     * Maps the height field onto itself around its center, as x' = xx * x + xz * z and z' = zx * x + zz * z.
+     * It only turns and mirrors, so the transpose undoes it.
+     **/
+    struct SymmetryTransform
+    {
+        float xx, xz;
+        float zx, zz;
+    };
+    
+    /**
+     * Get the transforms of the symmetry mode, the first is always the identity.
+     *
+     * @param transforms Filled with the transforms.
+     * @return void
+     **/
+    void getSymmetryTransforms(std::vector<SymmetryTransform> &transforms) const;
+    
+    /**
+     * Add the copies of a point under the symmetry mode to a list. Copies landing on the
+     * same cell (like a point at the center) are only added once.
+     *
+     * @param x The column of the point.
+     * @param z The row of the point.
+     * @param sites The list to add to.
+     * @return void
+     **/
+    void getSymmetricSites(float x, float z, std::vector<Vector2> &sites) const;
+    
+    /**
+     * Apply stamps of the current stroke that all fall within a rect.
+     *
+     * @param cells The cells the stamps cover.
+     * @param stamps The centers of the stamps, in cells.
+     * @return void
+     **/
+    void applyStamps(const DirtyRect &cells, const std::vector<Vector2> &stamps);
+    
+    /**
+     * Write a height stamp into the heightmap at one site.
+     *
+     * @param heightStamp The stamp.
+     * @param localx The column of the center.
+     * @param localz The row of the center.
+     * @param localscale The radius in cells.
+     * @param transform Turns and mirrors the stamp, for a symmetric copy.
+     * @return DirtyRect The cells written.
+     **/
+    DirtyRect stampSite(const HeightStamp &heightStamp, float localx, float localz, float localscale, const SymmetryTransform &transform);
+    
+    /**
+     * Get a stamp from the cache, loading it the first time.
+     *
+     * @param path The path to the heightmap image.
+     * @return HeightStamp* NULL if it could not be loaded.
+     **/
+    HeightStamp* getHeightStamp(const std::string &path);
+    
+    /**
+     * Get the talus angle as a slope in height units per cell, for the current terrain scale.
+     *
+     * @return float
+     **/
+    float getTalusSlope() const;
+    
+    /**
+     * Run the erosion passes chosen for new terrains over the whole height field.
+     *
+     * @param usedHeights The height array.
+     * @return void
+     **/
+    void erodeNewTerrain(float *usedHeights);
+    
+    /**
+     * Write the splat map textures, and the normal map if it changed, to a new temporary folder.
+     **/
+    void saveTextures();
+    
+    /**
+     * Create a noise generator, ready to be initialised.
+     *
+     * @param type The type of noise.
+     * @return INoiseAlgorithm* Owned by the caller.
+     **/
+    static INoiseAlgorithm* createNoise(NoiseType type);
+    
+    /**
+     * Get the noise coordinates of the first cell of the height field.
+     *
+     * @param settings The noise settings.
+     * @param worldTile Whether the terrain really is generated as a tile.
+     * @param originX Set to the x coordinate.
+     * @param originZ Set to the z coordinate.
+     * @return void
+     **/
+    static void getNoiseOrigin(const NoiseSettings &settings, bool worldTile, double &originX, double &originZ);
+    
+    /**
+     * Put a preview terrain in place of the current one.
+     *
+     * @param heights The preview heights.
+     * @param size The size of one side of the preview.
+     * @param fullSize The size of the height field being previewed, the preview covers the same area.
+     * @param terrainScale The scale of the terrain being previewed.
+     * @return void
+     **/
+    void showPreview(const float *heights, unsigned int size, unsigned int fullSize, const Vector3 &terrainScale);
+    
+    /**
+     * Put a terrain built from a coarse height field in place of the current one.
+     *
+     * @param heightField The coarse heights, owned by the generator from now on.
+     * @param fullSize The size of the height field it stands in for, it covers the same area.
+     * @param terrainScale The scale of the full terrain.
+     * @param blendLayers Whether to use the blend maps, or only the base layer.
+     * @return void
+     **/
+    void showCoarseTerrain(HeightField *heightField, unsigned int fullSize, const Vector3 &terrainScale, bool blendLayers);
+    
+    /**
+     * Make a coarse copy of the height field, keeping every step'th cell.
+     *
+     * @param step The spacing of the kept cells.
+     * @return HeightField*
+     **/
+    HeightField* createCoarseHeightField(unsigned int step) const;
+    
+    /**
+     * Replace the terrain like replaceTerrain, but for big height fields show the cell spacing of each detail
+     * level in turn, coarsest first, one a frame. Building the full terrain takes a while, this way there is
+     * something to look at after a fraction of the time.
+     *
+     * Terrain::create builds the vertex buffers, so every level, the full one included, is still built in a
+     * single frame on the main thread. The last frame stalls as long as replaceTerrain would, and the coarse
+     * levels cost about a third more on top, spread over the frames before it.
+     *
+     * @return void
+     **/
+    void replaceTerrainCoarseToFine();
+    
+    /**
+     * Show the next finer level of replaceTerrainCoarseToFine on the next frame. Each level goes through
+     * showCoarseTerrain or replaceTerrain, which release the level it replaces, so only one is ever held.
+     *
+     * @param level The detail level to show, 0 is the full terrain.
+     * @param version The terrain version when it was queued.
+     * @return void
+     **/
+    void refineTerrain(unsigned int level, unsigned int version);
+    
+    /**
+     * Cancel the background refinement of the preview, if there is one.
+     *
+     * @return void
+     **/
+    void stopRefining();
+     
+    /**
+     * The current terrain object.
+     **/
+    Terrain *_terrain;
+    
+    /**
+     * The heightmap that generated the terrain.
+     **/
+    HeightField *_heightField;
+    
+    /**
+     * The resolution of the texture blend maps (they are square)
+     **/
+    unsigned int _blendResolution;
+    
+    /**
+     * The resolution of the height map.
+     **/
+    unsigned int _heightFieldSize;
+    
+    /**
+     * The patch size for the generated terrain.
+     **/
+    unsigned int _patchSize;
+    
+    /**
+     * The number of detail levels to use in the terrain.
+     **/
+    unsigned int _detailLevels;
+    
+    /**
+     * Random seed that gets set before generating the random terrain.
+     **/
+    unsigned int _seed;
+    
+    /**
+     * Whether the terrain is a tile of a larger world.
+     **/
+    bool _worldTile;
+    
+    /**
+     * The tile column, when the terrain is a tile of a larger world.
+     **/
+    int _worldTileX;
+    
+    /**
+     * The tile row, when the terrain is a tile of a larger world.
+     **/
+    int _worldTileZ;
+    
+    /**
+     * Which noise generator to use.
+     **/
+    NoiseType _noiseType;
+    
+    /**
+     * The number of hydraulic erosion steps run after generating the noise.
+     **/
+    unsigned int _erosionIterations;
+    
+    /**
+     * The number of thermal erosion sweeps run after generating the noise.
+     **/
+    unsigned int _thermalIterations;
+    
+    /**
+     * The number of erosion droplets traced after generating the noise.
+     **/
+    unsigned int _erosionDroplets;
+    
+    /**
+     * Scale of the terrain.
+     **/
+    Vector3 _terrainScale;
+    
+    /**
+     * Vertical skirt height.
+     **/
+    float _skirtScale;
+    
+    /**
+     * Minimum bounds for height values in the terrain.
+     **/
+    float _minHeight;
+    
+    /**
+     * Maximum bounds for height values in the terrain.
+     **/
+    float _maxHeight;
+    
+    /**
+     * Triggering isDirty causes the terrain to be regenerated.
+     **/
+    bool _isDirty;
+    
+    /**
+     * Maps between world and height field coordinates.
+     **/
+    mutable HeightSampler _heightSampler;
+    
+    /**
+     * The world matrix of the terrain node when the sampler was set.
+     **/
+    mutable Matrix _samplerWorldMatrix;
+    
+    /**
+     * The terrain version when the sampler was set.
+     **/
+    mutable unsigned int _samplerVersion;
+    
+    /**
+     * Runs the generation in parallel, or NULL.
+     **/
+    JobSystem *_jobSystem;
+    
+    /**
+     * The blend weights for the texture layers.
+     **/
+    SplatMap _splatMap;
+    
+    /**
+     * The normals used to light the terrain.
+     **/
+    NormalMap _normalMap;
+    
+    /**
+     * The baked lighting, kept up to date with edits once it has been baked.
+     **/
+    LightMap _lightMap;
+    
+    /**
+     * The shape of the sculpting brushes.
+     **/
+    BrushStamp _brush;
+    
+    /**
+     * Whether a brush stroke is in progress.
+     **/
+    bool _stroking;
+    
+    /**
+     * The brush of the stroke.
+     **/
+    BrushType _strokeType;
+    
+    /**
+     * The distance between stamps, as a fraction of the brush radius.
+     **/
+    float _strokeSpacing;
+    
+    /**
+     * The radius of the stroke, in cells.
+     **/
+    float _strokeRadius;
+    
+    /**
+     * The distance between stamps of the stroke, in cells.
+     **/
+    float _strokeStep;
+    
+    /**
+     * The distance along the path to the next stamp, in cells.
+     **/
+    float _strokeDistance;
+    
+    /**
+     * The last point of the stroke, in cells.
+     **/
+    float _strokeX, _strokeZ;
+    
+    /**
+     * The height a flatten stroke flattens to.
+     **/
+    float _strokeTarget;
+    
+    /**
+     * The stamps waiting for flushStroke, in cells.
+     **/
+    std::vector<Vector2> _strokeStamps;
+    
+    /**
+     * How stamps are combined with the terrain.
+     **/
+    HeightStamp::Mode _stampMode;
+    
+    /**
+     * The rotation of stamps, in degrees.
+     **/
+    float _stampRotation;
+    
+    /**
+     * The height of the white parts of a stamp.
+     **/
+    float _stampHeight;
+    
+    /**
+     * How edits are repeated around the center of the terrain.
+     **/
+    SymmetryMode _symmetry;
+    
+    /**
+     * The number of copies made by RotateSymmetry.
+     **/
+    unsigned int _symmetryWays;
+    
+    /**
+     * The decoded stamps, by path.
+     **/
+    std::map<std::string, HeightStamp*> _heightStamps;
+    
+    /**
+     * The heightmap of the preview or coarse terrain being shown, or NULL.
+     **/
+    HeightField *_coarseHeightField;
+    
+    /**
+     * Counts the terrains put on show, so stale refinements can tell they have been replaced.
+     **/
+    unsigned int _terrainVersion;
+    
+    /**
+     * Whether a preview is being shown instead of the terrain.
+     **/
+    bool _showingPreview;
+    
+    /**
+     * The size of one side of the quick previews, halved when they are too slow.
+     **/
+    unsigned int _previewSize;
+    
+    /**
+     * Set to cancel the refinement in progress, shared with its jobs.
+     **/
+    std::shared_ptr<std::atomic<bool> > _refineCancelled;
+    
+    /**
+     * The settings used for the last finished refinement.
+     **/
+    NoiseSettings _refinedSettings;
+    
+    /**
+     * Whether the last refinement really was generated as a tile.
+     **/
+    bool _refinedWorldTile;
     
     /**
-     * Used to map coordinates.
+     * The full resolution noise from the last finished refinement, or empty.
      **/
-    mutable Matrix _inverseWorldMatrix;
+    std::vector<float> _refinedHeights;
 };
 
 #endif // TERRAINGENERATOR_H
@@ -35,9 +35,14 @@ TerrainToolMain::TerrainToolMain()
       MOVE_SPEED(10.0f), 
       _selectionScale(100.0f),
       _inputMode(NAVIGATION),
-      _doAction(false)
+      _doAction(false),
+      _paintLayer(TerrainGenerator::Grass),
+      _previewPending(false),
+      _activeBrush(TerrainGenerator::RaiseBrush),
+      _stroking(false)
       
 {
+    _terrainGenerator.setJobSystem(&_jobSystem);
 }
 
 void TerrainToolMain::initialize()
@@ -68,10 +73,33 @@ void TerrainToolMain::initialize()
     control = _mainForm->getControl("NavigateButton");
     control->addListener(this, Control::Listener::CLICK);
      
-    /* Not implemented yet
     control = _mainForm->getControl("PaintButton");
     control->addListener(this, Control::Listener::CLICK);
-    */
+    
+    control = _mainForm->getControl("ExportButton");
+    control->addListener(this, Control::Listener::CLICK);
+    
+    control = _mainForm->getControl("ExportMeshButton");
+    control->addListener(this, Control::Listener::CLICK);
+    
+    control = _mainForm->getControl("ExportTerrainButton");
+    control->addListener(this, Control::Listener::CLICK);
+    
+    control = _mainForm->getControl("BakeLightingButton");
+    control->addListener(this, Control::Listener::CLICK);
+    
+    control = _mainForm->getControl("GrassButton");
+    control->addListener(this, Control::Listener::CLICK);
+   
+    control = _mainForm->getControl("RocksButton");
+    control->addListener(this, Control::Listener::CLICK);
+   
+    control = _mainForm->getControl("DrawButton");
+    control->addListener(this, Control::Listener::CLICK);
+   
+    control = _mainForm->getControl("EraseButton");
+    control->addListener(this, Control::Listener::CLICK);
+    
     control = _mainForm->getControl("RaiseButton");
     control->addListener(this, Control::Listener::CLICK);
    
@@ -83,6 +111,33 @@ void TerrainToolMain::initialize()
    
     control = _mainForm->getControl("SmoothButton");
     control->addListener(this, Control::Listener::CLICK);
+    
+    control = _mainForm->getControl("ErodeButton");
+    control->addListener(this, Control::Listener::CLICK);
+    
+    control = _mainForm->getControl("ThermalButton");
+    control->addListener(this, Control::Listener::CLICK);
+    
+    control = _mainForm->getControl("TerraceButton");
+    control->addListener(this, Control::Listener::CLICK);
+    
+    control = _mainForm->getControl("NoiseButton");
+    control->addListener(this, Control::Listener::CLICK);
+    
+    control = _mainForm->getControl("SharpenButton");
+    control->addListener(this, Control::Listener::CLICK);
+    
+    control = _mainForm->getControl("SlopeButton");
+    control->addListener(this, Control::Listener::CLICK);
+   
+    control = _mainForm->getControl("StampButton");
+    control->addListener(this, Control::Listener::CLICK);
+    control = _mainForm->getControl("AddStampButton");
+    control->addListener(this, Control::Listener::CLICK);
+    control = _mainForm->getControl("MaxStampButton");
+    control->addListener(this, Control::Listener::CLICK);
+    control = _mainForm->getControl("ReplaceStampButton");
+    control->addListener(this, Control::Listener::CLICK);
    
     control = _mainForm->getControl("GenerateButton");
     control->addListener(this, Control::Listener::CLICK);
@@ -94,6 +149,43 @@ void TerrainToolMain::initialize()
     
     _selectionScale = slider->getValue();
     
+    slider = (Slider *) _mainForm->getControl("StrengthSlider");
+    slider->addListener(this, Control::Listener::VALUE_CHANGED);
+    _terrainGenerator.getBrush().setStrength(slider->getValue());
+    slider = (Slider *) _mainForm->getControl("OpacitySlider");
+    slider->addListener(this, Control::Listener::VALUE_CHANGED);
+    _terrainGenerator.getBrush().setOpacity(slider->getValue());
+    
+    slider = (Slider *) _mainForm->getControl("StampHeightSlider");
+    slider->addListener(this, Control::Listener::VALUE_CHANGED);
+    _terrainGenerator.setStampHeight(slider->getValue());
+    slider = (Slider *) _mainForm->getControl("StampRotationSlider");
+    slider->addListener(this, Control::Listener::VALUE_CHANGED);
+    _terrainGenerator.setStampRotation(slider->getValue());
+    
+    control = _mainForm->getControl("SmoothFalloffButton");
+    control->addListener(this, Control::Listener::CLICK);
+    control = _mainForm->getControl("GaussianFalloffButton");
+    control->addListener(this, Control::Listener::CLICK);
+    control = _mainForm->getControl("CustomFalloffButton");
+    control->addListener(this, Control::Listener::CLICK);
+    
+    const char *symmetryControls[] = { "NoSymmetryButton", "MirrorXButton", "MirrorZButton", "MirrorXZButton", "RotateSymmetryButton" };
+    for (unsigned int i = 0; i < sizeof(symmetryControls) / sizeof(symmetryControls[0]); i++) {
+        control = _mainForm->getControl(symmetryControls[i]);
+        control->addListener(this, Control::Listener::CLICK);
+    }
+    slider = (Slider *) _mainForm->getControl("SymmetryWaysSlider");
+    slider->addListener(this, Control::Listener::VALUE_CHANGED);
+    
+    // The custom falloff is a mesa - flat on top with steep sides.
+    std::vector<Vector2> mesa;
+    mesa.push_back(Vector2(0.0f, 1.0f));
+    mesa.push_back(Vector2(0.6f, 1.0f));
+    mesa.push_back(Vector2(0.8f, 0.25f));
+    mesa.push_back(Vector2(1.0f, 0.0f));
+    _terrainGenerator.getBrush().setCurve(mesa);
+    
     _generateForm = Form::create("res/generate.form");
     _generateForm->setVisible(false);
     
@@ -102,6 +194,20 @@ void TerrainToolMain::initialize()
    
     control = _generateForm->getControl("ConfirmGenerateButton");
     control->addListener(this, Control::Listener::CLICK);
+    
+    // Anything that changes the shape of the noise updates the preview.
+    const char *previewControls[] = { "HeightFieldSizeSlider", "ScaleXZSlider", "ScaleYSlider", "MinHeightSlider", "MaxHeightSlider",
+                                     "SimplexNoiseRadio", "DiamondSquareNoiseRadio", "FractalNoiseRadio", "WarpedNoiseRadio", "CellularNoiseRadio",
+                                     "CraterNoiseRadio", "RidgeNoiseRadio" };
+    for (unsigned int i = 0; i < sizeof(previewControls) / sizeof(previewControls[0]); i++) {
+        control = _generateForm->getControl(previewControls[i]);
+        control->addListener(this, Control::Listener::VALUE_CHANGED);
+    }
+    const char *previewTextBoxes[] = { "SeedTextBox", "TileXTextBox", "TileZTextBox" };
+    for (unsigned int i = 0; i < sizeof(previewTextBoxes) / sizeof(previewTextBoxes[0]); i++) {
+        control = _generateForm->getControl(previewTextBoxes[i]);
+        control->addListener(this, Control::Listener::TEXT_CHANGED);
+    }
    
     _binding = new TerrainToolAutoBindingResolver();
     _binding->setLight(_light);
@@ -112,15 +218,12 @@ void TerrainToolMain::initialize()
     node->setTranslation(Vector3(0, 0, 0));
     Terrain * terrain = _terrainGenerator.getTerrain();
     node->setTerrain(terrain);
-    PhysicsRigidBody::Parameters *rigidParams = new PhysicsRigidBody::Parameters();
-    rigidParams->mass = 0;
-    rigidParams->kinematic = true;
-    node->setCollisionObject(PhysicsCollisionObject::RIGID_BODY, PhysicsCollisionShape::heightfield(), rigidParams);
     
-    _selectionRing->setPosition(0, 0, terrain);
+    const HeightSampler &sampler = _terrainGenerator.getHeightSampler();
+    _selectionRing->setPosition(0, 0, sampler);
    
-    _selectionRing->setScale(_selectionScale, terrain);
-    _camera.setPosition(Vector3(0, terrain->getHeight(0, 1000) + 1000, 1000));
+    _selectionRing->setScale(_selectionScale, sampler);
+    _camera.setPosition(Vector3(0, sampler.getHeight(0, 1000) + 1000, 1000));
     
     
 }
@@ -142,52 +245,175 @@ void TerrainToolMain::controlEvent(Control* control, Control::Listener::EventTyp
         _inputMode = NAVIGATION;
         _mainForm->getControl("PaintToolbar")->setVisible(false);
         _mainForm->getControl("TerrainToolbar")->setVisible(false);
+        _mainForm->getControl("ExportToolbar")->setVisible(false);
     } else if (strcmp(control->getId(), "TerrainButton") == 0) {
         _inputMode = TERRAIN;
         _mainForm->getControl("PaintToolbar")->setVisible(false);
+        _mainForm->getControl("ExportToolbar")->setVisible(false);
         _mainForm->getControl("TerrainToolbar")->setVisible(true);
         
     } else if (strcmp(control->getId(), "PaintButton") == 0) {
         _inputMode = PAINT;
         _mainForm->getControl("TerrainToolbar")->setVisible(false);
+        _mainForm->getControl("ExportToolbar")->setVisible(false);
         _mainForm->getControl("PaintToolbar")->setVisible(true);
         
+    } else if (strcmp(control->getId(), "ExportButton") == 0) {
+        // Exporting only needs the camera.
+        _inputMode = NAVIGATION;
+        _mainForm->getControl("TerrainToolbar")->setVisible(false);
+        _mainForm->getControl("PaintToolbar")->setVisible(false);
+        _mainForm->getControl("ExportToolbar")->setVisible(true);
+        
+    } else if (strcmp(control->getId(), "ExportMeshButton") == 0) {
+        TextBox * textBox = (TextBox *) _mainForm->getControl("ExportPathTextBox");
+        Slider * errorSlider = (Slider *) _mainForm->getControl("MeshErrorSlider");
+        Slider * trianglesSlider = (Slider *) _mainForm->getControl("MeshTrianglesSlider");
+        _terrainGenerator.exportMesh(textBox->getText(), errorSlider->getValue(), (unsigned int) trianglesSlider->getValue());
+        
+    } else if (strcmp(control->getId(), "ExportTerrainButton") == 0) {
+        TextBox * textBox = (TextBox *) _mainForm->getControl("TerrainPathTextBox");
+        this->updateSun();
+        _terrainGenerator.exportTerrain(textBox->getText());
+        
+    } else if (strcmp(control->getId(), "BakeLightingButton") == 0) {
+        TextBox * textBox = (TextBox *) _mainForm->getControl("LightMapPathTextBox");
+        this->updateSun();
+        _terrainGenerator.saveLightMap(textBox->getText());
+        
     } else if (strcmp(control->getId(), "SizeSlider") == 0) {
         Slider * slider = (Slider *) control;
         _selectionScale = slider->getValue();
-        _selectionRing->setScale(_selectionScale, _terrainGenerator.getTerrain());
+        _selectionRing->setScale(_selectionScale, _terrainGenerator.getHeightSampler());
          Slider *slider2 = (Slider *) _mainForm->getControl("SizeSlider2");
         slider2->setValue(slider->getValue());
     } else if (strcmp(control->getId(), "SizeSlider2") == 0) {
         Slider * slider = (Slider *) control;
         _selectionScale = slider->getValue();
-        _selectionRing->setScale(_selectionScale, _terrainGenerator.getTerrain());
+        _selectionRing->setScale(_selectionScale, _terrainGenerator.getHeightSampler());
         Slider *slider2 = (Slider *) _mainForm->getControl("SizeSlider");
         slider2->setValue(slider->getValue());
         
+    } else if (strcmp(control->getId(), "StrengthSlider") == 0) {
+        Slider * slider = (Slider *) control;
+        _terrainGenerator.getBrush().setStrength(slider->getValue());
+    } else if (strcmp(control->getId(), "OpacitySlider") == 0) {
+        Slider * slider = (Slider *) control;
+        _terrainGenerator.getBrush().setOpacity(slider->getValue());
+    } else if (strcmp(control->getId(), "SmoothFalloffButton") == 0) {
+        _terrainGenerator.getBrush().setFalloff(BrushStamp::SMOOTHSTEP);
+    } else if (strcmp(control->getId(), "GaussianFalloffButton") == 0) {
+        _terrainGenerator.getBrush().setFalloff(BrushStamp::GAUSSIAN);
+    } else if (strcmp(control->getId(), "CustomFalloffButton") == 0) {
+        _terrainGenerator.getBrush().setFalloff(BrushStamp::CUSTOM);
+    } else if (strcmp(control->getId(), "NoSymmetryButton") == 0 || strcmp(control->getId(), "MirrorXButton") == 0 ||
+               strcmp(control->getId(), "MirrorZButton") == 0 || strcmp(control->getId(), "MirrorXZButton") == 0 ||
+               strcmp(control->getId(), "RotateSymmetryButton") == 0 || strcmp(control->getId(), "SymmetryWaysSlider") == 0) {
+        this->updateSymmetry();
     } else if (strcmp(control->getId(), "RaiseButton") == 0) {
+        _activeBrush = TerrainGenerator::RaiseBrush;
         _terrainGenerator.raise(_selectionRing->getPositionX(), _selectionRing->getPositionZ(), _selectionRing->getScale());
     } else if (strcmp(control->getId(), "LowerButton") == 0) {
+        _activeBrush = TerrainGenerator::LowerBrush;
         _terrainGenerator.lower(_selectionRing->getPositionX(), _selectionRing->getPositionZ(), _selectionRing->getScale());
     } else if (strcmp(control->getId(), "FlattenButton") == 0) {
+        _activeBrush = TerrainGenerator::FlattenBrush;
         _terrainGenerator.flatten(_selectionRing->getPositionX(), _selectionRing->getPositionZ(), _selectionRing->getScale());
     } else if (strcmp(control->getId(), "SmoothButton") == 0) {
+        _activeBrush = TerrainGenerator::SmoothBrush;
         _terrainGenerator.smooth(_selectionRing->getPositionX(), _selectionRing->getPositionZ(), _selectionRing->getScale());
+    } else if (strcmp(control->getId(), "ErodeButton") == 0) {
+        _activeBrush = TerrainGenerator::ErodeBrush;
+        _terrainGenerator.erode(_selectionRing->getPositionX(), _selectionRing->getPositionZ(), _selectionRing->getScale());
+    } else if (strcmp(control->getId(), "ThermalButton") == 0) {
+        _activeBrush = TerrainGenerator::CrumbleBrush;
+        _terrainGenerator.thermalErode(_selectionRing->getPositionX(), _selectionRing->getPositionZ(), _selectionRing->getScale());
+    } else if (strcmp(control->getId(), "TerraceButton") == 0) {
+        _activeBrush = TerrainGenerator::TerraceBrush;
+        _terrainGenerator.terrace(_selectionRing->getPositionX(), _selectionRing->getPositionZ(), _selectionRing->getScale());
+    } else if (strcmp(control->getId(), "NoiseButton") == 0) {
+        _activeBrush = TerrainGenerator::NoiseBrush;
+        _terrainGenerator.roughen(_selectionRing->getPositionX(), _selectionRing->getPositionZ(), _selectionRing->getScale());
+    } else if (strcmp(control->getId(), "SharpenButton") == 0) {
+        _activeBrush = TerrainGenerator::SharpenBrush;
+        _terrainGenerator.sharpen(_selectionRing->getPositionX(), _selectionRing->getPositionZ(), _selectionRing->getScale());
+    } else if (strcmp(control->getId(), "SlopeButton") == 0) {
+        _activeBrush = TerrainGenerator::SlopeBrush;
+        _terrainGenerator.limitSlope(_selectionRing->getPositionX(), _selectionRing->getPositionZ(), _selectionRing->getScale());
+    } else if (strcmp(control->getId(), "StampButton") == 0) {
+        TextBox * textBox = (TextBox *) _mainForm->getControl("StampPathTextBox");
+        _terrainGenerator.stamp(textBox->getText(), _selectionRing->getPositionX(), _selectionRing->getPositionZ(), _selectionRing->getScale());
+    } else if (strcmp(control->getId(), "StampHeightSlider") == 0) {
+        Slider * slider = (Slider *) control;
+        _terrainGenerator.setStampHeight(slider->getValue());
+    } else if (strcmp(control->getId(), "StampRotationSlider") == 0) {
+        Slider * slider = (Slider *) control;
+        _terrainGenerator.setStampRotation(slider->getValue());
+    } else if (strcmp(control->getId(), "AddStampButton") == 0) {
+        _terrainGenerator.setStampMode(HeightStamp::ADD);
+    } else if (strcmp(control->getId(), "MaxStampButton") == 0) {
+        _terrainGenerator.setStampMode(HeightStamp::MAX);
+    } else if (strcmp(control->getId(), "ReplaceStampButton") == 0) {
+        _terrainGenerator.setStampMode(HeightStamp::REPLACE);
+    } else if (strcmp(control->getId(), "GrassButton") == 0) {
+        _paintLayer = TerrainGenerator::Grass;
+    } else if (strcmp(control->getId(), "RocksButton") == 0) {
+        _paintLayer = TerrainGenerator::Rock;
+    } else if (strcmp(control->getId(), "DrawButton") == 0) {
+        _terrainGenerator.paint(_selectionRing->getPositionX(), _selectionRing->getPositionZ(), _selectionRing->getScale(), _paintLayer, 1.0f);
+    } else if (strcmp(control->getId(), "EraseButton") == 0) {
+        _terrainGenerator.paint(_selectionRing->getPositionX(), _selectionRing->getPositionZ(), _selectionRing->getScale(), _paintLayer, -1.0f);
     } else if (strcmp(control->getId(), "GenerateButton") == 0) {
         _mainForm->setVisible(false);
         _generateForm->setVisible(true);
     } else if (strcmp(control->getId(), "CancelGenerateButton") == 0) {
         _mainForm->setVisible(true);
         _generateForm->setVisible(false);
+        _previewPending = false;
+        _terrainGenerator.cancelPreview();
    } else if (strcmp(control->getId(), "ConfirmGenerateButton") == 0) {
         _mainForm->setVisible(true);
         _generateForm->setVisible(false);
+        _previewPending = false;
         this->generateNewTerrain();
+    } else if (evt == Control::Listener::VALUE_CHANGED || evt == Control::Listener::TEXT_CHANGED) {
+        // A slider can send many changes a frame, only the last one is previewed.
+        if (_generateForm->isVisible()) {
+            _previewPending = true;
+        }
     }
    
 }
 
-void TerrainToolMain::generateNewTerrain()
+void TerrainToolMain::updateSymmetry()
+{
+    const char *symmetryControls[] = { "NoSymmetryButton", "MirrorXButton", "MirrorZButton", "MirrorXZButton", "RotateSymmetryButton" };
+    const TerrainGenerator::SymmetryMode symmetryModes[] = { TerrainGenerator::NoSymmetry, TerrainGenerator::MirrorX, TerrainGenerator::MirrorZ,
+                                                             TerrainGenerator::MirrorXZ, TerrainGenerator::RotateSymmetry };
+    TerrainGenerator::SymmetryMode mode = TerrainGenerator::NoSymmetry;
+    
+    for (unsigned int i = 0; i < sizeof(symmetryControls) / sizeof(symmetryControls[0]); i++) {
+        RadioButton *radioButton = (RadioButton *) _mainForm->getControl(symmetryControls[i]);
+        if (radioButton->isSelected()) {
+            mode = symmetryModes[i];
+        }
+    }
+    
+    // A stroke in progress finishes with the old symmetry.
+    _terrainGenerator.flushStroke();
+    
+    Slider *slider = (Slider *) _mainForm->getControl("SymmetryWaysSlider");
+    _terrainGenerator.setSymmetry(mode, (unsigned int) slider->getValue());
+}
+
+void TerrainToolMain::updateSun()
+{
+    Slider *azimuthSlider = (Slider *) _mainForm->getControl("SunAzimuthSlider");
+    Slider *elevationSlider = (Slider *) _mainForm->getControl("SunElevationSlider");
+    _terrainGenerator.setSun(azimuthSlider->getValue(), elevationSlider->getValue());
+}
+
+void TerrainToolMain::readNoiseSettings(TerrainGenerator::NoiseSettings &settings, Vector3 &terrainScale)
 {
     Control * control;
     Slider * slider;
@@ -195,29 +421,32 @@ void TerrainToolMain::generateNewTerrain()
     RadioButton * radioButton;
     float xz = 0, y = 0;
     
-    control = _generateForm->getControl("DetailLevelsSlider");
-    slider = (Slider *) control;
-    _terrainGenerator.setDetailLevels(slider->getValue());
-    
     control = _generateForm->getControl("HeightFieldSizeSlider");
     slider = (Slider *) control;
-    _terrainGenerator.setHeightFieldSize(slider->getValue());
+    settings.size = slider->getValue();
     
     control = _generateForm->getControl("MaxHeightSlider");
     slider = (Slider *) control;
-    _terrainGenerator.setMaxHeight(slider->getValue());
+    settings.maxHeight = slider->getValue();
     
     control = _generateForm->getControl("MinHeightSlider");
     slider = (Slider *) control;
-    _terrainGenerator.setMinHeight(slider->getValue());
-    
-    control = _generateForm->getControl("PatchSizeSlider");
-    slider = (Slider *) control;
-    _terrainGenerator.setPatchSize(slider->getValue());
+    settings.minHeight = slider->getValue();
     
     control = _generateForm->getControl("SeedTextBox");
     textBox = (TextBox *) control;
-    _terrainGenerator.setSeed(strtol(textBox->getText(), NULL, 10));
+    settings.seed = strtol(textBox->getText(), NULL, 10);
+    
+    // Both tile coordinates are needed to generate a tile of a larger world.
+    control = _generateForm->getControl("TileXTextBox");
+    textBox = (TextBox *) control;
+    const char *tileX = textBox->getText();
+    control = _generateForm->getControl("TileZTextBox");
+    textBox = (TextBox *) control;
+    const char *tileZ = textBox->getText();
+    settings.worldTile = tileX && tileZ && *tileX && *tileZ;
+    settings.worldTileX = settings.worldTile ? strtol(tileX, NULL, 10) : 0;
+    settings.worldTileZ = settings.worldTile ? strtol(tileZ, NULL, 10) : 0;
     
     control = _generateForm->getControl("ScaleXZSlider");
     slider = (Slider *) control;
@@ -227,21 +456,77 @@ void TerrainToolMain::generateNewTerrain()
     slider = (Slider *) control;
     y = slider->getValue();
     
-    _terrainGenerator.setTerrainScale(Vector3(xz, y, xz));
+    terrainScale.set(xz, y, xz);
+    
+    const char *noiseRadios[] = { "SimplexNoiseRadio", "FractalNoiseRadio", "WarpedNoiseRadio", "CellularNoiseRadio",
+                                  "CraterNoiseRadio", "RidgeNoiseRadio" };
+    const TerrainGenerator::NoiseType noiseTypes[] = { TerrainGenerator::Simplex, TerrainGenerator::Fractal, TerrainGenerator::DomainWarp, TerrainGenerator::Cellular,
+                                                       TerrainGenerator::CellularCraters, TerrainGenerator::CellularRidges };
+    settings.noiseType = TerrainGenerator::DiamondSquare;
+    for (unsigned int i = 0; i < sizeof(noiseRadios) / sizeof(noiseRadios[0]); i++) {
+        control = _generateForm->getControl(noiseRadios[i]);
+        radioButton = (RadioButton *) control;
+        if (radioButton->isSelected()) {
+            settings.noiseType = noiseTypes[i];
+            break;
+        }
+    }
+}
+
+void TerrainToolMain::previewNewTerrain()
+{
+    TerrainGenerator::NoiseSettings settings;
+    Vector3 terrainScale;
     
-    control = _generateForm->getControl("SimplexNoiseRadio");
-    radioButton = (RadioButton *) control;
-    if (radioButton->isSelected()) {
-        _terrainGenerator.setNoiseType(TerrainGenerator::Simplex);
+    this->readNoiseSettings(settings, terrainScale);
+    _terrainGenerator.buildPreview(settings, terrainScale);
+}
+
+void TerrainToolMain::generateNewTerrain()
+{
+    Control * control;
+    Slider * slider;
+    TerrainGenerator::NoiseSettings settings;
+    Vector3 terrainScale;
+    
+    this->readNoiseSettings(settings, terrainScale);
+    _terrainGenerator.setHeightFieldSize(settings.size);
+    _terrainGenerator.setMaxHeight(settings.maxHeight);
+    _terrainGenerator.setMinHeight(settings.minHeight);
+    _terrainGenerator.setSeed(settings.seed);
+    if (settings.worldTile) {
+        _terrainGenerator.setWorldTile(settings.worldTileX, settings.worldTileZ);
     } else {
-        _terrainGenerator.setNoiseType(TerrainGenerator::DiamondSquare);
+        _terrainGenerator.clearWorldTile();
     }
+    _terrainGenerator.setNoiseType(settings.noiseType);
+    _terrainGenerator.setTerrainScale(terrainScale);
+    
+    control = _generateForm->getControl("DetailLevelsSlider");
+    slider = (Slider *) control;
+    _terrainGenerator.setDetailLevels(slider->getValue());
+    
+    control = _generateForm->getControl("PatchSizeSlider");
+    slider = (Slider *) control;
+    _terrainGenerator.setPatchSize(slider->getValue());
     
+    control = _generateForm->getControl("ErosionSlider");
+    slider = (Slider *) control;
+    _terrainGenerator.setErosionIterations(slider->getValue());
+    
+    control = _generateForm->getControl("DropletSlider");
+    slider = (Slider *) control;
+    _terrainGenerator.setErosionDroplets(slider->getValue() * 1000);
+    
+    control = _generateForm->getControl("ThermalSlider");
+    slider = (Slider *) control;
+    _terrainGenerator.setThermalIterations(slider->getValue());
+    
+    // Reuses the noise from the preview if it got as far as full resolution.
     _terrainGenerator.buildTerrain();
     
-    Terrain * terrain = _terrainGenerator.getTerrain();
     Vector3 pos = _camera.getPosition();
-    pos.y = terrain->getHeight(pos.x, pos.z) + 1000;
+    pos.y = _terrainGenerator.getHeightSampler().getHeight(pos.x, pos.z) + 1000;
     _camera.setPosition(pos);
     
 }
@@ -266,6 +551,17 @@ void TerrainToolMain::moveCamera(float elapsedTime)
 
 void TerrainToolMain::update(float elapsedTime)
 {
+    // Finish off any background work that has to touch the scene.
+    _jobSystem.pumpMainThread();
+    
+    // Every stamp of the stroke since the last frame is applied at once.
+    _terrainGenerator.flushStroke();
+    
+    if (_previewPending) {
+        _previewPending = false;
+        this->previewNewTerrain();
+    }
+    
     moveCamera(elapsedTime);
     
     if (_mainForm) {
@@ -400,6 +696,10 @@ void TerrainToolMain::touchEvent(Touch::TouchEvent evt, int x, int y, unsigned i
         if (_inputMode == TERRAIN) {
             _doAction = false;
         }
+        if (_stroking) {
+            _stroking = false;
+            _terrainGenerator.endStroke();
+        }
         
         break;
     case Touch::TOUCH_MOVE:
@@ -413,13 +713,24 @@ void TerrainToolMain::touchEvent(Touch::TouchEvent evt, int x, int y, unsigned i
         } else if (_inputMode == TERRAIN || _inputMode == PAINT) {
             Ray pickRay;
             _scene->getActiveCamera()->pickRay(Rectangle (0, 0, getWidth(), getHeight()), x, y, &pickRay);
-            Terrain *terrain = _terrainGenerator.getTerrain();
             
-            TerrainHitFilter hitFilter(terrain);
-            PhysicsController::HitResult hitResult;
-            if (Game::getInstance()->getPhysicsController()->rayTest(pickRay, 1000000, &hitResult, &hitFilter)) {
-                if (hitResult.object == terrain->getNode()->getCollisionObject()) {            
-                    _selectionRing->setPosition(hitResult.point.x, hitResult.point.z, terrain);
+            // getTerrain rebuilds the terrain if its settings have changed, so the pick is made against the
+            // heights that will be drawn. The pick is straight against the heights, so the ring follows edits
+            // the moment they are made.
+            Terrain *terrain = _terrainGenerator.getTerrain();
+            const HeightSampler &sampler = _terrainGenerator.getHeightSampler();
+            Vector3 point;
+            if (terrain && sampler.intersectRay(pickRay.getOrigin(), pickRay.getDirection(), 1000000, point)) {
+                _selectionRing->setPosition(point.x, point.z, sampler);
+                
+                // Dragging with the button held sculpts with the last brush used.
+                if (_inputMode == TERRAIN && _doAction) {
+                    if (_stroking) {
+                        _terrainGenerator.continueStroke(point.x, point.z);
+                    } else {
+                        _stroking = true;
+                        _terrainGenerator.beginStroke(_activeBrush, point.x, point.z, _selectionRing->getScale());
+                    }
                 }
             }
 
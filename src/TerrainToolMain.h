@@ -23,6 +23,7 @@
 
 #include "FirstPersonCamera.h"
 #include "TerrainGenerator.h"
+#include "JobSystem.h"
 #include "SelectionRing.h"
 #include "TerrainToolAutoBindingResolver.h"
 
@@ -99,6 +100,36 @@ private:
      **/
     void generateNewTerrain();
     
+    /**
+     * Show a quick preview of the terrain for the parameters in the terrain generation form.
+     *
+     * @return void
+     **/
+    void previewNewTerrain();
+    
+    /**
+     * Pass the symmetry chosen on the toolbar to the terrain generator.
+     *
+     * @return void
+     **/
+    void updateSymmetry();
+    
+    /**
+     * Pass the sun chosen on the export toolbar to the terrain generator.
+     *
+     * @return void
+     **/
+    void updateSun();
+    
+    /**
+     * Read the noise parameters from the terrain generation form.
+     *
+     * @param settings Filled with the noise settings.
+     * @param terrainScale Set to the terrain scale.
+     * @return void
+     **/
+    void readNoiseSettings(TerrainGenerator::NoiseSettings &settings, Vector3 &terrainScale);
+    
     /**
      * Used by the ui to switch input states.
      **/
@@ -134,6 +165,11 @@ private:
      **/
     FirstPersonCamera _camera;
     
+    /**
+     * Runs background and parallel work for the whole tool.
+     **/
+    JobSystem _jobSystem;
+    
     /**
      * Used to generate and modify the terrain.
      **/
@@ -189,41 +225,26 @@ private:
      * The current input mode.
      **/
     INPUT_MODE _inputMode;
-};
-
-/**
- * Used to quickly filter ray collisions to collisions with the terrain (for picking).
- **/
-
-struct TerrainHitFilter : public PhysicsController::HitFilter {
-
+    
     /**
-     * Constructor -- stores a reference to the terrain.
-     *
-     * @param terrain ...
+     * The texture layer used by the paint tools.
      **/
-    TerrainHitFilter(Terrain* terrain)
-    {
-        terrainObject = terrain->getNode()->getCollisionObject();
-    }
-
+    TerrainGenerator::TextureLayer _paintLayer;
+    
     /**
-     * Only return true if the hit is on the terrain.
-     *
-     * @param object The result of the ray collision test.
-     * @return bool
+     * Set when the terrain generation form changes, the preview is rebuilt once on the next update.
      **/
-    bool filter(PhysicsCollisionObject* object)
-    {
-        // Filter out all objects but the terrain
-        return (object != terrainObject);
-    }
-
+    bool _previewPending;
+    
     /**
-     * Stored so it can be used in the hit detection.
+     * The brush used when dragging over the terrain, the last one picked from the toolbar.
      **/
-    PhysicsCollisionObject* terrainObject;
+    TerrainGenerator::BrushType _activeBrush;
+    
+    /**
+     * Whether a brush stroke is in progress.
+     **/
+    bool _stroking;
 };
 
-
 #endif
@@ -0,0 +1,138 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ThermalErosion.h"
+#include <math.h>
+#include <vector>
+
+/**
+ * The width of the tiles relaxed by one job. Must be at least 2, so the tiles of a round never touch.
+ **/
+static const int TILE_SIZE = 32;
+
+/**
+ * The offsets and distances of the 8 neighbours of a cell.
+ **/
+static const int NEIGHBOUR_X[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+static const int NEIGHBOUR_Z[8] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+static const float NEIGHBOUR_DISTANCE[8] = { 1.41421356f, 1.0f, 1.41421356f, 1.0f, 1.0f, 1.41421356f, 1.0f, 1.41421356f };
+
+ThermalErosionSettings::ThermalErosionSettings() :
+iterations(50),
+talusSlope(1.0f),
+rate(0.5f)
+{
+}
+
+ThermalErosion::ThermalErosion(const ThermalErosionSettings &settings) :
+_settings(settings),
+_jobSystem(NULL)
+{
+}
+
+ThermalErosion::~ThermalErosion()
+{
+}
+
+void ThermalErosion::setJobSystem(JobSystem *jobSystem)
+{
+    _jobSystem = jobSystem;
+}
+
+void ThermalErosion::relax(float *heights, unsigned int size, const DirtyRect &region, int x, int z) const
+{
+    float excess[8];
+    float total = 0, largest = 0;
+    unsigned int n;
+    float height = heights[x + z * size];
+
+    for (n = 0; n < 8; n++) {
+        int nx = x + NEIGHBOUR_X[n], nz = z + NEIGHBOUR_Z[n];
+
+        excess[n] = 0;
+        if (nx < region.minX || nx > region.maxX || nz < region.minZ || nz > region.maxZ) {
+            continue;
+        }
+        float drop = height - heights[nx + nz * size] - _settings.talusSlope * NEIGHBOUR_DISTANCE[n];
+        if (drop > 0) {
+            excess[n] = drop;
+            total += drop;
+            largest = drop > largest ? drop : largest;
+        }
+    }
+    if (total <= 0) {
+        return;
+    }
+
+    // Move half of the steepest drop, so this cell and that neighbour meet in the middle,
+    // shared between all the neighbours that are too low.
+    float amount = _settings.rate * largest * 0.5f;
+    heights[x + z * size] -= amount;
+    for (n = 0; n < 8; n++) {
+        if (excess[n] > 0) {
+            heights[(x + NEIGHBOUR_X[n]) + (z + NEIGHBOUR_Z[n]) * size] += amount * excess[n] / total;
+        }
+    }
+}
+
+void ThermalErosion::erode(float *heights, unsigned int size, const DirtyRect &cells)
+{
+    DirtyRect region = cells;
+    unsigned int iteration, round;
+
+    region.clip(size, size);
+    if (region.isEmpty()) {
+        return;
+    }
+
+    int tilesX = (region.maxX - region.minX + TILE_SIZE) / TILE_SIZE;
+    int tilesZ = (region.maxZ - region.minZ + TILE_SIZE) / TILE_SIZE;
+
+    for (iteration = 0; iteration < _settings.iterations; iteration++) {
+        for (round = 0; round < 4; round++) {
+            std::vector<DirtyRect> tiles;
+            int tx, tz;
+
+            // Every other tile in each direction.
+            for (tz = round / 2; tz < tilesZ; tz += 2) {
+                for (tx = round % 2; tx < tilesX; tx += 2) {
+                    DirtyRect tile(region.minX + tx * TILE_SIZE, region.minZ + tz * TILE_SIZE, 0, 0);
+                    tile.maxX = tile.minX + TILE_SIZE - 1 < region.maxX ? tile.minX + TILE_SIZE - 1 : region.maxX;
+                    tile.maxZ = tile.minZ + TILE_SIZE - 1 < region.maxZ ? tile.minZ + TILE_SIZE - 1 : region.maxZ;
+                    tiles.push_back(tile);
+                }
+            }
+
+            JobSystem::RangeTask task = [&](unsigned int begin, unsigned int end) {
+                for (unsigned int t = begin; t < end; t++) {
+                    for (int z = tiles[t].minZ; z <= tiles[t].maxZ; z++) {
+                        for (int x = tiles[t].minX; x <= tiles[t].maxX; x++) {
+                            this->relax(heights, size, region, x, z);
+                        }
+                    }
+                }
+            };
+            if (_jobSystem) {
+                _jobSystem->parallelFor(0, tiles.size(), 1, task);
+            } else {
+                task(0, tiles.size());
+            }
+        }
+    }
+}
@@ -0,0 +1,118 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef THERMALEROSION_H
+#define THERMALEROSION_H
+
+#include "DirtyRect.h"
+#include "JobSystem.h"
+
+/**
+ * Settings for thermal erosion. Slopes are in height units per height field cell.
+ **/
+struct ThermalErosionSettings
+{
+    /**
+     * Constructor
+     **/
+    ThermalErosionSettings();
+
+    /**
+     * The number of relaxation sweeps.
+     **/
+    unsigned int iterations;
+
+    /**
+     * The steepest slope that is left alone (the talus angle as rise over run).
+     **/
+    float talusSlope;
+
+    /**
+     * The share of the excess material moved in each sweep, up to 1.
+     **/
+    float rate;
+};
+
+/**
+ * Thermal erosion crumbles slopes that are steeper than the talus angle, moving material from
+ * each cell to its lower neighbours until the slopes settle at the angle.
+ *
+ * Each sweep works on the region in square tiles, in four rounds where no two tiles of a round touch
+ * (like the squares of a checkerboard, in each direction). The tiles of a round run in parallel on the
+ * job system, and each can relax its cells in place because the neighbours it writes to belong to
+ * tiles that are not running.
+ **/
+class ThermalErosion
+{
+public:
+    /**
+     * Constructor
+     *
+     * @param settings How to erode.
+     **/
+    ThermalErosion(const ThermalErosionSettings &settings);
+
+    /**
+     * Destructor
+     **/
+    ~ThermalErosion();
+
+    /**
+     * Set the jobs used for the sweeps. Without a job system everything runs on the calling thread.
+     *
+     * @param jobSystem The job system, which must outlive the erosion.
+     * @return void
+     **/
+    void setJobSystem(JobSystem *jobSystem);
+
+    /**
+     * Erode part of a height array. Cells outside the region are never changed.
+     *
+     * @param heights The height array, size * size values.
+     * @param size The size of one side of the height array.
+     * @param cells The region to erode.
+     * @return void
+     **/
+    void erode(float *heights, unsigned int size, const DirtyRect &cells);
+
+private:
+    /**
+     * Move the excess material off one cell.
+     *
+     * @param heights The height array.
+     * @param size The size of one side of the height array.
+     * @param region The cells that may be changed.
+     * @param x The column of the cell.
+     * @param z The row of the cell.
+     * @return void
+     **/
+    void relax(float *heights, unsigned int size, const DirtyRect &region, int x, int z) const;
+
+    /**
+     * The settings.
+     **/
+    ThermalErosionSettings _settings;
+
+    /**
+     * The jobs to run on, or NULL.
+     **/
+    JobSystem *_jobSystem;
+};
+
+#endif // THERMALEROSION_H
@@ -0,0 +1,181 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "WorleyNoise.h"
+#include <math.h>
+#include <algorithm>
+
+/**
+ * Hash a cell position and seed into 32 random bits.
+ **/
+static unsigned int hashCell(int column, int row, int seed)
+{
+    unsigned int h = static_cast<unsigned int>(column) * 0x8DA6B343u;
+    h ^= static_cast<unsigned int>(row) * 0xD8163841u;
+    h ^= static_cast<unsigned int>(seed) * 0xCB1AB31Fu;
+    h ^= h >> 13;
+    h *= 0x5BD1E995u;
+    h ^= h >> 15;
+    return h;
+}
+
+/**
+ * Floor without the library call.
+ **/
+static inline int fastFloor(double value)
+{
+    int i = static_cast<int>(value);
+    return i - (value < i);
+}
+
+WorleyNoise::WorleyNoise() :
+_mode(PLATEAU),
+_cellsAcross(12),
+_cellSize(1),
+_min(0),
+_max(0),
+_seed(0)
+{
+}
+
+WorleyNoise::~WorleyNoise()
+{
+}
+
+void WorleyNoise::setMode(Mode mode)
+{
+    _mode = mode;
+}
+
+void WorleyNoise::setCellsAcross(double cells)
+{
+    GP_ASSERT(cells > 0);
+    _cellsAcross = cells;
+}
+
+bool WorleyNoise::isTileable() const
+{
+    return true;
+}
+
+void WorleyNoise::init(double maxx, double maxz, double rangemin, double rangemax, int seed)
+{
+    _min = rangemin;
+    _max = rangemax;
+    _seed = seed;
+    double worldScale = maxx;
+    if (maxz > maxx) {
+        worldScale = maxz;
+    }
+    _cellSize = worldScale / _cellsAcross;
+}
+
+void WorleyNoise::getFeature(int column, int row, Feature &feature) const
+{
+    unsigned int h = hashCell(column, row, _seed);
+    feature.x = (h & 0x3ff) / 1024.0f;
+    feature.z = ((h >> 10) & 0x3ff) / 1024.0f;
+    feature.value = (h >> 20) / 4096.0f;
+}
+
+float WorleyNoise::shade(float x, float z, const Feature *features, unsigned int stride) const
+{
+    // Squared distances and cell values of the nearest and second nearest points.
+    float nearest = 1e9f, second = 1e9f;
+    float nearestValue = 0.0f, secondValue = 0.0f;
+    int row, column;
+    for (row = 0; row < 5; row++) {
+        const Feature *feature = features + (row * stride);
+        for (column = 0; column < 5; column++, feature++) {
+            float dx = (column - 2) + feature->x - x;
+            float dz = (row - 2) + feature->z - z;
+            float distance = dx * dx + dz * dz;
+            if (distance < nearest) {
+                second = nearest;
+                secondValue = nearestValue;
+                nearest = distance;
+                nearestValue = feature->value;
+            } else if (distance < second) {
+                second = distance;
+                secondValue = feature->value;
+            }
+        }
+    }
+
+    if (_mode == CRATER) {
+        // Round bowls with flat ground between them.
+        return std::min(nearest * 2.5f, 1.0f);
+    }
+
+    // Zero on the border between two cells.
+    float edge = sqrtf(second) - sqrtf(nearest);
+    if (_mode == RIDGE) {
+        return 1.0f - std::min(edge * 2.0f, 1.0f);
+    }
+
+    // Each cell is flat at its own height, with a steep smooth step halfway between the heights at the border.
+    float t = std::min(edge / 0.15f, 1.0f);
+    t = t * t * (3.0f - 2.0f * t);
+    return secondValue + (nearestValue - secondValue) * (0.5f + 0.5f * t);
+}
+
+double WorleyNoise::noise(double x, double z)
+{
+    float height;
+    this->noiseTile(x, z, 1, 1, &height);
+    return height;
+}
+
+void WorleyNoise::noiseTile(double x, double z, unsigned int width, unsigned int height, float *output)
+{
+    double scale = 1.0 / _cellSize;
+
+    // Hash the feature points for every cell under the tile, plus a border of two cells, once.
+    int firstColumn = fastFloor(x * scale) - 2;
+    int lastColumn = fastFloor((x + width - 1) * scale) + 2;
+    int firstRow = fastFloor(z * scale) - 2;
+    int lastRow = fastFloor((z + height - 1) * scale) + 2;
+    unsigned int columns = lastColumn - firstColumn + 1;
+    unsigned int rows = lastRow - firstRow + 1;
+    std::vector<Feature> features(columns * rows);
+    unsigned int i, j, index = 0;
+    for (j = 0; j < rows; j++) {
+        for (i = 0; i < columns; i++, index++) {
+            this->getFeature(firstColumn + i, firstRow + j, features[index]);
+        }
+    }
+
+    float range = _max - _min;
+    float offset = _min;
+    for (j = 0; j < height; j++) {
+        // Positions within the cell are worked out from the world position alone, so tiles agree exactly.
+        double cellZ = (z + j) * scale;
+        int row = fastFloor(cellZ);
+        float fz = static_cast<float>(cellZ - row);
+        const Feature *block = &features[(row - 2 - firstRow) * columns];
+
+        float *heights = output + (j * width);
+        for (i = 0; i < width; i++) {
+            double cellX = (x + i) * scale;
+            int column = fastFloor(cellX);
+            float fx = static_cast<float>(cellX - column);
+            heights[i] = this->shade(fx, fz, block + (column - 2 - firstColumn), columns) * range + offset;
+        }
+    }
+}
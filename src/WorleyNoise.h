@@ -0,0 +1,187 @@
+/*
+    Terrain Tool - Interactive terrain editor.
+    Copyright (C) 2014  Damyon Wiese <damyon.wiese@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef WORLEYNOISE_H
+#define WORLEYNOISE_H
+
+#include "INoiseAlgorithm.h"
+
+#include "gameplay.h"
+
+using namespace gameplay;
+
+/**
+ * Worley (cellular) noise. The world is cut into a grid of square cells with one feature point
+ * jittered randomly inside each, and the height comes from the distances to the nearest feature points.
+ * Because every cell holds exactly one point, the second nearest is never more than about 1.8 cells
+ * away - the points of the sample's own cell and of the neighbour on its nearer side are both that
+ * close - and cells three away are more than 2 cells off, so the 5x5 block of cells around a sample is
+ * always enough. Even the nearest point can be two cells away, so a 3x3 block would not be.
+ *
+ * The feature points are a hash of the cell position, so the noise is a fixed function of position and
+ * can be tiled. noiseTile hashes the cells under a tile once and reuses them for every sample.
+ **/
+class WorleyNoise : public INoiseAlgorithm
+{
+    public:
+        /**
+         * The shape made from the distances.
+         *
+         * PLATEAU - flat cells at random heights, with cliffs where they meet.
+         * CRATER - bowls around each feature point.
+         * RIDGE - sharp ridges along the cell borders.
+         **/
+        enum Mode { PLATEAU, CRATER, RIDGE };
+
+        /**
+         * Constructor
+         **/
+        WorleyNoise();
+
+        /**
+         * Destructor
+         **/
+        virtual ~WorleyNoise();
+
+        /**
+         * Initialiser - store the parameters for the noise generation.
+         *
+         * @param maxx Maximum X value this generator will be called with.
+         * @param maxz Maximum Z value this generator will be called with.
+         * @param rangemin The minumum height value to generate.
+         * @param rangemax The maximum height value to generate.
+         * @param seed A random seed
+         * @return void
+         **/
+        virtual void init(double maxx, double maxz, double rangemin, double rangemax, int seed);
+
+        /**
+         * Get the height value for a given x and z coordinate.
+         *
+         * @param x X coordinate
+         * @param z Z coordinate
+         * @return double
+         **/
+        virtual double noise(double x, double z);
+
+        /**
+         * Get the heights for a tile of coordinates.
+         *
+         * @param x The x coordinate of the first column
+         * @param z The z coordinate of the first row
+         * @param width The number of columns
+         * @param height The number of rows
+         * @param output Filled with width * height heights
+         * @return void
+         **/
+        virtual void noiseTile(double x, double z, unsigned int width, unsigned int height, float *output);
+
+        /**
+         * Cellular noise can be sampled anywhere.
+         *
+         * @return bool
+         **/
+        virtual bool isTileable() const;
+
+        /**
+         * Choose the shape made from the distances. Call before init.
+         *
+         * @param mode The mode.
+         * @return void
+         **/
+        void setMode(Mode mode);
+
+        /**
+         * Set the number of cells across the terrain. Call before init.
+         *
+         * @param cells The number of cells.
+         * @return void
+         **/
+        void setCellsAcross(double cells);
+
+    private:
+        /**
+         * The feature point of one cell.
+         **/
+        struct Feature
+        {
+            /**
+             * Position in cell units.
+             **/
+            float x, z;
+
+            /**
+             * A random value from 0 to 1 for the cell.
+             **/
+            float value;
+        };
+
+        /**
+         * Work out the feature point of a cell.
+         *
+         * @param column The cell column, counted from the world origin.
+         * @param row The cell row.
+         * @param feature Filled with the feature point.
+         * @return void
+         **/
+        void getFeature(int column, int row, Feature &feature) const;
+
+        /**
+         * Find the nearest two feature points to a sample and turn them into a height from 0 to 1.
+         *
+         * @param x The sample x, in cell units.
+         * @param z The sample z, in cell units.
+         * @param features The feature points of the 5x5 cells around the sample, 5 rows of stride points.
+         * @param stride The distance between the rows of features.
+         * @return float
+         **/
+        float shade(float x, float z, const Feature *features, unsigned int stride) const;
+
+        /**
+         * The shape made from the distances.
+         **/
+        Mode _mode;
+
+        /**
+         * The number of cells across the terrain.
+         **/
+        double _cellsAcross;
+
+        /**
+         * The size of a cell in height field units.
+         **/
+        double _cellSize;
+
+        /**
+         * The minumum allowed height value.
+         **/
+        double _min;
+
+        /**
+         * The max allowed height value.
+         **/
+        double _max;
+
+        /**
+         * Seed - mixed into the hash of every cell.
+         **/
+        int _seed;
+};
+
+#endif // WORLEYNOISE_H